@@ -40,6 +40,7 @@
 #include <Debug.h>
 #include <FileStream.h>
 #include <Ipc.h>
+#include <MemoryManager.h>
 #include <Session.h>
 #include <String.h>
 #include <Types.h>
@@ -55,12 +56,15 @@ protected:
     static const size_t BUFFER_SIZE = PAGE_SIZE;
 
     char                testbuf[BUFFER_SIZE];
+    char                pagebuf[BUFFER_SIZE]
+                            __attribute__ ((aligned (PAGE_SIZE)));
     FileStream          _stream;
 
     L4_ThreadId_t GetFileSystem(const char* name);
 
     bool OpenClose(const char* path, int count);
     bool OpenReadClose(const char* path, int count);
+    bool OpenMoveClose(const char* path, int count);
 
 public:
     FileSystemTest(const char* name);
@@ -183,6 +187,41 @@ FileSystemTest::OpenReadClose(const char* path, int count)
     return true;
 }
 
+bool
+FileSystemTest::OpenMoveClose(const char* path, int count)
+{
+    size_t  rsize;
+    addr_t  buf = reinterpret_cast<addr_t>(pagebuf);
+    addr_t  phys = ~0UL;
+
+    PRINT("Open-move-close ... ");
+    for (int i = 0; i < count; i++) {
+        if (_stream.Open(path, FileStream::READ | FileStream::MAP)
+            != ERR_NONE) {
+            PRINT("not found\n");
+            return false;
+        }
+
+        if (_stream.Read(pagebuf, BUFFER_SIZE, &rsize) != ERR_NONE) {
+            PRINT("read failed\n");
+            return false;
+        }
+
+        _stream.Close();
+
+        // Each read takes a new frame over from the server.  The same frame
+        // means the data was copied into the buffer.
+        if (Pager.Phys(buf) == phys) {
+            PRINT("not moved\n");
+            return false;
+        }
+        phys = Pager.Phys(buf);
+    }
+    PRINT("OK\n");
+
+    return true;
+}
+
 /*
 void
 Test_OpenWriteClose(int count)
@@ -393,6 +432,7 @@ FileSystemTest::Run()
     const char* path = "/test1/hello.txt";
     OpenClose(path, 10);
     OpenReadClose(path, 10);
+    OpenMoveClose(path, 10);
 }
 
 int
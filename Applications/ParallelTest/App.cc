@@ -1,28 +1,299 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
 
-//$Id: App.cc 349 2008-05-29 01:54:02Z hro $
+///
+/// @brief  Benchmark of the work-stealing task runtime
+/// @file   Applications/ParallelTest/App.cc
+/// @since  October 2008
+///
 
-#include <arc/debug.h>
-#include <arc/console.h>
-#include <arc/system.h>
-#include <arc/types.h>
-#include <l4/schedule.h>
-#include <l4/types.h>
-#include <arc/driver.h>
+#include <Debug.h>
+#include <IpcProfile.h>
+#include <PageAllocator.h>
+#include <System.h>
+#include <TaskPool.h>
+#include <Types.h>
+#include <sys/Config.h>
+#include <l4/thread.h>
 
-#include <stdio.h>
-#include <arc/parallel.h>
+static const size_t DATA_PAGES = 256;
+static const size_t SCREEN_WIDTH = 640;
+static const size_t SCREEN_HEIGHT = 480;
+static const UInt   FIB_ARGUMENT = 24;
+static const UInt   FIB_CUTOFF = 12;
 
-int
-main()
+///
+/// Checksums every page of a buffer
+///
+class ChecksumBody : public RangeBody
+{
+private:
+    const UInt*     _data;
+    UInt*           _sums;
+
+public:
+    ChecksumBody(addr_t data, UInt* sums)
+        : _data(reinterpret_cast<const UInt*>(data)), _sums(sums) {}
+
+    void Run(size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++) {
+            const UInt* p = &_data[i * PAGE_SIZE / sizeof(UInt)];
+            UInt        a = 1;
+            UInt        b = 0;
+
+            for (size_t j = 0; j < PAGE_SIZE / sizeof(UInt); j++) {
+                a += p[j];
+                b += a;
+            }
+            _sums[i] = (b << 16) ^ a;
+        }
+    }
+};
+
+///
+/// Blurs the rows of a 32-bit image into another
+///
+class BlurBody : public RangeBody
+{
+private:
+    const UInt*     _src;
+    UInt*           _dst;
+
+public:
+    BlurBody(addr_t src, addr_t dst)
+        : _src(reinterpret_cast<const UInt*>(src)),
+          _dst(reinterpret_cast<UInt*>(dst)) {}
+
+    void Run(size_t begin, size_t end)
+    {
+        for (size_t y = begin; y < end; y++) {
+            const UInt* up = &_src[(y == 0 ? y : y - 1) * SCREEN_WIDTH];
+            const UInt* row = &_src[y * SCREEN_WIDTH];
+            const UInt* down = &_src[(y == SCREEN_HEIGHT - 1 ? y : y + 1) *
+                                     SCREEN_WIDTH];
+
+            for (size_t x = 1; x < SCREEN_WIDTH - 1; x++) {
+                UInt pixel = 0;
+
+                // Average each channel of the four neighbors
+                for (UInt shift = 0; shift < 32; shift += 8) {
+                    UInt c = ((up[x] >> shift) & 0xFF) +
+                             ((down[x] >> shift) & 0xFF) +
+                             ((row[x - 1] >> shift) & 0xFF) +
+                             ((row[x + 1] >> shift) & 0xFF);
+                    pixel |= (c >> 2) << shift;
+                }
+                _dst[y * SCREEN_WIDTH + x] = pixel;
+            }
+        }
+    }
+};
+
+static UInt
+Fib(UInt n)
+{
+    return n < 2 ? n : Fib(n - 1) + Fib(n - 2);
+}
+
+///
+/// Measures spawn and sync with a recursion of fine tasks
+///
+class FibTask : public Task
+{
+private:
+    UInt            _n;
+
+public:
+    UInt            result;
+
+    FibTask(UInt n) : _n(n), result(0) {}
+
+    void Run()
+    {
+        if (_n < FIB_CUTOFF) {
+            result = Fib(_n);
+            return;
+        }
+
+        TaskGroup   group;
+        FibTask     left(_n - 1);
+        FibTask     right(_n - 2);
+
+        spawn(&left, &group);
+        right.Run();
+        sync(&group);
+        result = left.result + right.result;
+    }
+};
+
+static void
+Report(const char* name, ULong serial, ULong parallel)
+{
+    System.Print("%-10s serial %12llu  parallel %12llu  speedup %lu.%02lu\n",
+                 name, serial, parallel,
+                 static_cast<UInt>(serial / parallel),
+                 static_cast<UInt>(serial * 100 / parallel % 100));
+}
+
+static void
+BenchChecksum()
+{
+    addr_t  data = palloc(DATA_PAGES);
+    UInt    serial_sums[DATA_PAGES];
+    UInt    parallel_sums[DATA_PAGES];
+    ULong   start;
+    ULong   serial;
+    ULong   parallel;
+
+    if (data == 0) {
+        System.Print(System.ERROR, "checksum: out of memory\n");
+        return;
+    }
+
+    for (size_t i = 0; i < DATA_PAGES * PAGE_SIZE / sizeof(UInt); i++) {
+        reinterpret_cast<UInt*>(data)[i] = i * 2654435761UL;
+    }
+
+    ChecksumBody    s(data, serial_sums);
+    ChecksumBody    p(data, parallel_sums);
+
+    start = IpcProfile::Now();
+    s.Run(0, DATA_PAGES);
+    serial = IpcProfile::Now() - start;
+
+    start = IpcProfile::Now();
+    parallel_for(0, DATA_PAGES, &p);
+    parallel = IpcProfile::Now() - start;
+
+    for (size_t i = 0; i < DATA_PAGES; i++) {
+        if (serial_sums[i] != parallel_sums[i]) {
+            System.Print(System.ERROR, "checksum mismatch at page %u\n", i);
+            break;
+        }
+    }
+    Report("checksum", serial, parallel);
+    pfree(data, DATA_PAGES);
+}
+
+static void
+BenchBlur()
 {
-    printf("Paralell driver test\n");
+    size_t  pages = PAGE_ALIGN(SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(UInt)) /
+                    PAGE_SIZE;
+    addr_t  src = palloc(pages);
+    addr_t  dst = palloc(pages);
+    ULong   start;
+    ULong   serial;
+    ULong   parallel;
 
-    for (int counter = 0; counter < 10000000; counter++) {
-        if (counter % 10000 == 0) {
-            parallel_write("ABCDEFGHIJKLMNOPQRSTUVWXYZ\n", 27);
+    if (src == 0 || dst == 0) {
+        System.Print(System.ERROR, "blur: out of memory\n");
+        if (dst != 0) {
+            pfree(dst, pages);
+        }
+        if (src != 0) {
+            pfree(src, pages);
         }
-        L4_Yield();
+        return;
+    }
+
+    for (size_t i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++) {
+        reinterpret_cast<UInt*>(src)[i] = i * 0x010203;
+    }
+
+    BlurBody    body(src, dst);
+
+    start = IpcProfile::Now();
+    body.Run(0, SCREEN_HEIGHT);
+    serial = IpcProfile::Now() - start;
+
+    start = IpcProfile::Now();
+    parallel_for(0, SCREEN_HEIGHT, &body);
+    parallel = IpcProfile::Now() - start;
+
+    Report("blur", serial, parallel);
+    pfree(dst, pages);
+    pfree(src, pages);
+}
+
+static void
+BenchFib()
+{
+    ULong   start;
+    ULong   serial;
+    ULong   parallel;
+    UInt    expected;
+
+    start = IpcProfile::Now();
+    expected = Fib(FIB_ARGUMENT);
+    serial = IpcProfile::Now() - start;
+
+    FibTask     task(FIB_ARGUMENT);
+    TaskGroup   group;
+
+    start = IpcProfile::Now();
+    spawn(&task, &group);
+    sync(&group);
+    parallel = IpcProfile::Now() - start;
+
+    if (task.result != expected) {
+        System.Print(System.ERROR, "fib mismatch %u != %u\n",
+                     task.result, expected);
     }
+    Report("fib", serial, parallel);
+}
+
+int
+main(int argc, char* argv[])
+{
+    TaskPool    pool;
+    size_t      workers = 2;
+    stat_t      err;
+
+    if (argc > 1) {
+        workers = atoi(argv[1]);
+    }
+
+    err = pool.Start(workers);
+    if (err != ERR_NONE) {
+        System.Print(System.ERROR, "failed to start %u workers: %s\n",
+                     workers, stat2msg[err]);
+        return 1;
+    }
+
+    System.Print("Task runtime benchmark with %u workers (cycles)\n",
+                 pool.Count());
+    BenchChecksum();
+    BenchBlur();
+    BenchFib();
 
-    return EXIT_SUCCESS;
+    pool.Stop();
+    return 0;
 }
@@ -73,6 +73,10 @@
 #define MSG_PAGER_RELEASE               MSG_PAGER_PROTO(-11UL)
 // page mapping request
 #define MSG_PAGER_MAP                   MSG_PAGER_PROTO(-12UL)
+// flag of the mapping request: the ownership of the source pages moves to
+// the destination.  The owner grants it with the flag in the rights of the
+// allocation request.
+#define MSG_PAGER_MAP_MOVE              0x8
 // page unmapping request
 #define MSG_PAGER_UNMAP                 MSG_PAGER_PROTO(-13UL)
 // page mapping request
@@ -88,6 +92,10 @@
 // Map a page from the first megabyte of physical memory
 // (containing BIOS area)
 #define MSG_PAGER_MAPBIOSPAGE           MSG_PAGER_PROTO(-19UL)
+// Query the request statistics of the pager
+#define MSG_PAGER_PROFILE               MSG_PAGER_PROTO(-20UL)
+// Scan the pages to merge (from the page merger of the root task)
+#define MSG_PAGER_MERGE                 MSG_PAGER_PROTO(-21UL)
 
 
 //
@@ -112,6 +120,43 @@
 #define MSG_ROOT_FIND_AS            0x0110
 #define MSG_ROOT_INJECT             0x0200
 #define MSG_ROOT_FREE_COUNT         0x0210
+#define MSG_ROOT_FAULT_AROUND       0x0220
+// Memory statistics
+//   Request: [first space]
+//   Reply:   [total, free, allocated, cached, shared, cow, snapshot,
+//             orders, free blocks of each order..., spaces,
+//             (root thread, resident pages) of each space...]
+#define MSG_ROOT_MEM_STAT           0x0230
+// Pre-zeroed page pool
+//   Request: [low, high, rate, period]  (0 leaves a parameter unchanged)
+//   Reply:   [low, high, rate, period, pages in the pool]
+#define MSG_ROOT_CLEAN_POOL         0x0240
+// Swap server registration
+//   Request: [server, window, slots, pinned threads...]
+#define MSG_ROOT_SWAP               0x0250
+// Same-page merging
+//   Request: [enable, rate, period]  (0 leaves the rate or period unchanged)
+//   Reply:   [enabled, rate, period, merged frames, pages merged]
+#define MSG_ROOT_MERGE              0x0260
+// Program image cache.  The path follows the words.
+//   Map request: [fs, mtime, size, path...]
+//   Map reply:   [entry, text start, text size, data start, data size,
+//                 pm start, pm size]
+//   Add request: [fs, mtime, size, task map (7 words), segments,
+//                 (start, size) of each segment..., path...]
+#define MSG_ROOT_IMAGE_MAP          0x0270
+#define MSG_ROOT_IMAGE_ADD          0x0280
+// Snapshot depth of a task
+//   Request: [task, depth, unpacked generations]  (nil for the caller; 0
+//            leaves a parameter unchanged)
+//   Reply:   [depth, unpacked generations, generations, packed pages,
+//             pool pages]
+#define MSG_ROOT_SNAPSHOT_DEPTH     0x0290
+// Snapshot mode of a task.  Switching the mode discards the snapshots.
+// Switching to the incremental mode splits the superpages of the task.
+//   Request: [task, incremental]  (nil for the caller)
+//   Reply:   [incremental]
+#define MSG_ROOT_SNAPSHOT_MODE      0x02A0
 
 //
 //  Shadow Task
@@ -153,6 +198,12 @@
 #define MSG_SESSION_PUT             0x5050
 #define MSG_SESSION_GET             0x5060
 #define MSG_SESSION_PUT_ASYNC       0x5070
+#define MSG_SESSION_MAP             0x5080
+#define MSG_SESSION_SUBMIT          0x5090
+#define MSG_SESSION_COMPLETE        0x50A0
+#define MSG_SESSION_GET_BATCH       0x50B0
+#define MSG_SESSION_PUT_BATCH       0x50C0
+#define MSG_SESSION_WAKE            0x50D0
 
 //
 //  Event notification
@@ -165,5 +216,17 @@
 #define MSG_EVENT_STOP              0x6060
 #define MSG_EVENT_CONFIG            0x6070
 
+//
+//  Swap Server
+//
+//   Request: [slot]  The page is lent at the window of the server.
+#define MSG_SWAP_OUT                0x8010
+#define MSG_SWAP_IN                 0x8020
+
+//
+//  Profiling
+//
+#define MSG_SERVER_PROFILE          0x7010
+
 #endif // ARC_PROTOCOL_H
 
@@ -77,5 +77,11 @@ struct VirtLayout
 
 #define PAGE_ALIGN(addr)            (((addr) + PAGE_SIZE - 1UL) & PAGE_MASK)
 
+// Large page (4 MB without PAE)
+#define SUPERPAGE_BITS  22UL
+#define SUPERPAGE_SIZE  (1UL << SUPERPAGE_BITS)
+#define SUPERPAGE_MASK  ~(SUPERPAGE_SIZE - 1UL)
+#define SUPERPAGE_PAGES (1UL << (SUPERPAGE_BITS - PAGE_BITS))
+
 #endif // ARC_IA32_CONFIG_H
 
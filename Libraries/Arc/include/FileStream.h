@@ -51,6 +51,15 @@ protected:
     Session*    _ss;
     Int         _offset;
     Int         _size;
+    Bool        _map;
+
+    ///
+    /// The last modification time of the file, or 0 if the file system
+    /// does not keep it
+    ///
+    L4_Word_t   _mtime;
+
+    stat_t ReadPages(addr_t ptr, UInt offset, Int length, Int* rsize);
 
 public:
     enum Mode {
@@ -66,6 +75,9 @@ public:
         APPEND =        0x020,
         //
         EXISTENCE =     0x040,
+        // Read page-aligned data by moving the server's pages instead of
+        // copying it through the shared memory
+        MAP =           0x100,
     };
 
     enum SeekMode {
@@ -74,7 +86,7 @@ public:
         SEEK_END =      2,
     };
 
-    FileStream() {}
+    FileStream() : _ss(0), _map(FALSE), _mtime(0) {}
 
     virtual ~FileStream() { Disconnect(); }
 
@@ -161,6 +173,27 @@ public:
         while (0 < length) {
             L4_Word_t   reg[2];
             Int         ssize = static_cast<Int>(_ss->Size());
+            Int         read;
+
+            if (_map && (ptr & ~PAGE_MASK) == 0 &&
+                PAGE_SIZE <= static_cast<size_t>(length)) {
+                len = length & PAGE_MASK;
+                err = ReadPages(ptr, offset, len, &read);
+                if (err == ERR_NONE) {
+                    ptr += read;
+                    offset += read;
+                    length -= read;
+                    if (read < len) {
+                        break;
+                    }
+                    continue;
+                }
+                // The server doesn't lend pages.  Fall back to copying for
+                // good; other errors fall back only for this part.
+                if (err == ERR_NOT_FOUND) {
+                    _map = FALSE;
+                }
+            }
 
             len = (length < ssize) ? length : ssize;
 
@@ -172,7 +205,7 @@ public:
                 return err;
             }
 
-            Int read = reg[0];
+            read = reg[0];
 
             //DOUT("copy 0x%lX -> %p\n", _ss->GetBaseAddress(), ptr);
             memcpy(reinterpret_cast<void*>(ptr),
@@ -244,6 +277,8 @@ public:
     }
 
     virtual Int Size() { return _size; }
+
+    L4_Word_t ModifiedTime() { return _mtime; }
 };
 
 #endif // ARC_FILE_STREAM_H
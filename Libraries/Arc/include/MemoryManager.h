@@ -46,9 +46,15 @@ class MemoryManager
 {
 private:
     stat_t Map(addr_t dest, L4_ThreadId_t did, UInt rwx,
-               addr_t src, L4_ThreadId_t sid);
+               addr_t src, L4_ThreadId_t sid, size_t count);
 
 public:
+    ///
+    /// The largest count of pages the pager maps in a reply.  A map item
+    /// occupies two message registers.
+    ///
+    static const size_t MAX_MAP_PAGES = 31;
+
     ///
     /// Reserves an anonymous page for the base.  The permission of the
     /// reserved page is read-write-only.
@@ -61,6 +67,16 @@ public:
     ///
     stat_t Reserve(addr_t base, L4_ThreadId_t peer, UInt rwx);
 
+    ///
+    /// Reserves contiguous anonymous pages for the base and the peer.
+    ///
+    /// @param base     the base address of the region
+    /// @param count    the count of pages
+    /// @param peer     the thread allowed to share the pages
+    /// @param rwx      the permission of the peer
+    ///
+    stat_t Reserve(addr_t base, size_t count, L4_ThreadId_t peer, UInt rwx);
+
     ///
     /// An anonymous page is mapped to the destination.
     ///
@@ -85,6 +101,22 @@ public:
     ///
     stat_t Map(addr_t dest, UInt rwx, addr_t src, L4_ThreadId_t sid);
 
+    ///
+    /// Maps the count of pages starting at the source to the destination.
+    /// The pager maps up to MAX_MAP_PAGES pages per request.
+    ///
+    stat_t Map(addr_t dest, UInt rwx, addr_t src, L4_ThreadId_t sid,
+               size_t count);
+
+    ///
+    /// Moves the pages at the source to the destination.  The source pages
+    /// must be reserved for this task by the source, with MSG_PAGER_MAP_MOVE
+    /// in the rights.  They replace the pages at the destination and are
+    /// owned by this task afterwards; the source loses its mapping.
+    ///
+    stat_t Move(addr_t dest, UInt rwx, addr_t src, L4_ThreadId_t sid,
+                size_t count);
+
     ///
     /// Unmaps and releases the specified page.
     ///
@@ -45,26 +45,96 @@
 #include <l4/message.h>
 #include <l4/types.h>
 #include <Ipc.h>
+#include <IpcProfile.h>
+#include <SessionRing.h>
 #include <System.h>
 
+class WorkerPool;
+
 class BasicServer
 {
 protected:
+    ///
+    /// The request statistics.  Null until profiling is enabled.
+    ///
+    IpcProfile*     _profile;
+
+    ///
+    /// Processes MSG_SERVER_PROFILE.  The query can enable the profiling of
+    /// a running server.
+    ///
+    void HandleProfile(L4_Msg_t& msg);
+
+    ///
+    /// Processes the requests queued in the ring of a session through
+    /// ServeRequest() and replies with the count of them.
+    ///
+    /// @param client   the client, handed to ServeRequest()
+    /// @param base     the shared memory of the session
+    /// @param size     the size of the shared memory in bytes
+    ///
+    stat_t RunRing(void* client, addr_t base, size_t size, L4_Msg_t& msg);
+
+    ///
+    /// Processes a request from the ring of a client.  The buffer is
+    /// already checked to be in the data area of the ring.
+    ///
+    virtual void ServeRequest(void* client, const IoRequest& req,
+                              addr_t buf, IoCompletion& cmp)
+    {
+        cmp.status = ERR_NOT_FOUND;
+        cmp.result = 0;
+    }
+
+    ///
+    /// Runs the Get or Put request of each entry of a batch through
+    /// IpcHandler() and replies with the status and the result of each.
+    ///
+    stat_t RunBatch(const L4_ThreadId_t& tid, L4_Msg_t& msg);
+
     virtual stat_t IpcHandler(const L4_ThreadId_t& tid, L4_Msg_t& msg)
     { return ERR_NONE; }
 
+    ///
+    /// Hands a request over to another thread, which replies to the client.
+    /// Returns TRUE if the request is taken.
+    ///
+    virtual Bool Defer(const L4_ThreadId_t& tid, L4_Msg_t& msg)
+    { return FALSE; }
+
 public:
+    BasicServer() : _profile(0) {}
+    virtual ~BasicServer();
+
     stat_t Run();
     virtual const char* const Name() = 0;
     virtual stat_t Initialize(Int argc, char* argv[]) = 0;
     virtual stat_t Exit() { return ERR_NONE; }
+
+    ///
+    /// Starts or stops recording the request statistics.
+    ///
+    stat_t EnableProfile(Bool on);
+
+    friend class WorkerPool;
 };
 
+//
+// Servers built with IPC_PROFILE record the request statistics from the
+// start.
+//
+#ifdef IPC_PROFILE
+#define SERVER_PROFILE(server)  (server).EnableProfile(TRUE)
+#else
+#define SERVER_PROFILE(server)
+#endif // IPC_PROFILE
+
 #define ARC_SERVER(CLASS)                                   \
     int server_main(int argc, char* argv[], int state)      \
     {                                                       \
         stat_t  err;                                        \
         CLASS   server;                                     \
+        SERVER_PROFILE(server);                             \
         err = server.Initialize(argc, argv);                \
         System.Print("'%s' [%.8lX] initialized.\n",         \
                      argv[0], L4_Myself().raw);             \
@@ -126,6 +196,7 @@ public:
         if (err != ERR_NONE) {                              \
             return static_cast<int>(err);                   \
         }                                                   \
+        SERVER_PROFILE(server);                             \
         server.Run(state);                                  \
         err = server.Exit();                                \
         return static_cast<int>(err);                       \
@@ -137,8 +208,15 @@ struct SessionClient
     addr_t          base;
     size_t          size;
 
+    ///
+    /// The last thread found in the space of the client
+    ///
+    L4_ThreadId_t   thread;
+
+    SessionClient*  next;
+
     SessionClient(L4_ThreadId_t t, addr_t b, size_t s)
-        : tid(t), base(b), size(s) {}
+        : tid(t), base(b), size(s), thread(L4_nilthread), next(0) {}
 
     virtual ~SessionClient() {}
 };
@@ -146,7 +224,31 @@ struct SessionClient
 class SessionServer : public BasicServer
 {
 protected:
-    List<SessionClient*>        _clients;
+    static const size_t         CLIENT_BUCKETS = 32;
+
+    ///
+    /// The clients hashed by the shared memory
+    ///
+    SessionClient*              _clients[CLIENT_BUCKETS];
+
+    ///
+    /// The worker threads.  Null unless StartWorkers() is called.
+    ///
+    WorkerPool*                 _pool;
+
+    ///
+    /// Runs the data transfer requests in worker threads, so that a slow
+    /// request doesn't block the other clients.  The requests of a session
+    /// are processed in order by the same worker.  Connect, disconnect and
+    /// the messages of the derived server are processed by the main thread
+    /// after the workers become idle.  The handlers must be reentrant for
+    /// different sessions.
+    ///
+    /// @param count    the number of the workers
+    ///
+    stat_t StartWorkers(size_t count);
+
+    virtual Bool Defer(const L4_ThreadId_t& tid, L4_Msg_t& msg);
 
     virtual void Register(const L4_ThreadId_t& tid, addr_t base, size_t size)
     {
@@ -156,17 +258,43 @@ protected:
             //XXX
             return;
         }
-        _clients.Append(c);
+        Insert(c, tid);
     }
 
     virtual void Deregister(SessionClient* c)
     {
-        _clients.Remove(c);
+        Remove(c);
         delete c;
     }
 
+    static size_t Bucket(addr_t base)
+    { return (base >> PAGE_BITS) % CLIENT_BUCKETS; }
+
+    ///
+    /// Adds a client to the hash table.
+    ///
+    /// @param c        the client
+    /// @param tid      the thread that connected
+    ///
+    void Insert(SessionClient* c, const L4_ThreadId_t& tid);
+
+    ///
+    /// Removes a client from the hash table.
+    ///
+    void Remove(SessionClient* c);
+
+    ///
+    /// Finds the client of the shared memory.  The space of the thread is
+    /// asked to the root task only when the thread differs from the last
+    /// one of the client.
+    ///
     SessionClient* Search(const L4_ThreadId_t& tid, addr_t base);
 
+    ///
+    /// Obtains the largest shared memory granted to a client, in pages.
+    ///
+    virtual size_t MaxShmPages();
+
     virtual stat_t IpcHandler(const L4_ThreadId_t& tid, L4_Msg_t& msg);
     virtual stat_t HandleConnect(const L4_ThreadId_t& tid, L4_Msg_t& msg);
     virtual stat_t HandleDisconnect(const L4_ThreadId_t& tid, L4_Msg_t& msg);
@@ -196,6 +324,65 @@ protected:
         return ERR_NONE;
     }
 
+    ///
+    /// Fills pages lent to the client.  Servers that don't lend pages make
+    /// the client fall back to Get.
+    ///
+    virtual stat_t HandleMap(const L4_ThreadId_t& tid, L4_Msg_t& msg)
+    {
+        Ipc::ReturnError(&msg, ERR_NOT_FOUND);
+        return ERR_NONE;
+    }
+
+    ///
+    /// Runs the Get or Put handler for each entry of a batch, in one
+    /// wakeup.  The handlers see an ordinary single request.
+    ///
+    virtual stat_t HandleBatch(const L4_ThreadId_t& tid, L4_Msg_t& msg);
+
+    ///
+    /// Processes the requests queued in the ring of the client.
+    ///
+    virtual stat_t HandleSubmit(const L4_ThreadId_t& tid, L4_Msg_t& msg);
+
+    ///
+    /// Processes a request from the ring.  The buffer is already checked
+    /// to be in the data area of the ring.
+    ///
+    /// @param c        the client
+    /// @param req      the request
+    /// @param buf      the address of the data of the request
+    /// @param cmp      the completion to be filled
+    ///
+    virtual void HandleRequest(SessionClient* c, const IoRequest& req,
+                               addr_t buf, IoCompletion& cmp)
+    {
+        cmp.status = ERR_NOT_FOUND;
+        cmp.result = 0;
+    }
+
+    virtual void ServeRequest(void* client, const IoRequest& req,
+                              addr_t buf, IoCompletion& cmp);
+
+    ///
+    /// Notifies the client of completions posted out of HandleSubmit.
+    /// Call only when SessionRing::TakeWaiter() returns TRUE.
+    ///
+    void Notify(const L4_ThreadId_t& tid)
+    {
+        L4_Msg_t msg;
+        L4_Put(&msg, MSG_SESSION_COMPLETE, 0, 0, 0, 0);
+        Propagate(&msg);
+        L4_Load(&msg);
+        L4_Send_Timeout(tid, L4_ZeroTime);
+    }
+
+    ///
+    /// Makes a message sent by a worker appear to come from the main
+    /// thread.
+    ///
+    void Propagate(L4_Msg_t* msg);
+
     L4_ThreadId_t FindSpace(L4_ThreadId_t t)
     {
         L4_Msg_t        msg;
@@ -207,8 +394,14 @@ protected:
     }
 
 public:
-    SessionServer() {}
-    virtual ~SessionServer() {}
+    SessionServer() : _pool(0)
+    {
+        for (size_t i = 0; i < CLIENT_BUCKETS; i++) {
+            _clients[i] = 0;
+        }
+    }
+
+    virtual ~SessionServer();
 };
 
 #endif // ARC_SERVER_H
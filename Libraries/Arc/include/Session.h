@@ -39,6 +39,7 @@
 #define ARC_SESSION_H
 
 #include <Ipc.h>
+#include <SessionRing.h>
 #include <Types.h>
 #include <l4/types.h>
 #include <l4/message.h>
@@ -69,16 +70,49 @@ protected:
     ///
     addr_t          _shm;
 
+    void Load(L4_Word_t label, L4_Word_t* regs, size_t count);
+
     stat_t Xfer(L4_Word_t label, L4_Word_t* regs, size_t count);
 
     stat_t Xfer(L4_Word_t label, L4_Word_t* sregs, size_t scount,
                 L4_Word_t* rregs, size_t rcount);
 
+    stat_t XferBatch(L4_Word_t label, L4_Word_t* entries, size_t count,
+                     size_t width, L4_Word_t* results);
+
     void Disconnect(L4_ThreadId_t tid, addr_t dest);
 
 public:
     static const size_t DEFAULT_SHM_PAGES = 2;
 
+    ///
+    /// The largest shared memory a session server grants by default, in
+    /// pages.
+    ///
+    static const size_t MAX_SHM_PAGES = 64;
+
+    ///
+    /// Obtains the count of pages a client asks for in the connect message,
+    /// limited by the server's maximum.
+    ///
+    /// @param msg      the connect message
+    /// @param limit    the largest count of pages the server grants
+    ///
+    static size_t RequestedPages(L4_Msg_t* msg, size_t limit)
+    {
+        size_t pages = DEFAULT_SHM_PAGES;
+        if (L4_UntypedWords(L4_MsgTag(msg)) > 0) {
+            pages = static_cast<size_t>(L4_Get(msg, 0));
+        }
+        if (pages == 0) {
+            pages = DEFAULT_SHM_PAGES;
+        }
+        if (limit < pages) {
+            pages = limit;
+        }
+        return pages;
+    }
+
     Session() : _peer(L4_nilthread), _shm(0) {}
 
     ///
@@ -87,11 +121,25 @@ public:
     virtual ~Session();
 
     ///
-    /// Establishes a session with the peer.
+    /// Establishes a session with the peer.  The peer may grant less shared
+    /// memory than requested; Size() tells the granted size.
+    ///
+    /// @param peer         the server
+    /// @param pages        the requested size of the shared memory in pages
+    /// @param recv_regs    the registers following the granted size
+    /// @param count        the count of the receiving registers
     ///
-    stat_t Connect(L4_ThreadId_t peer, L4_Word_t* recv_regs, size_t count);
+    stat_t Connect(L4_ThreadId_t peer, size_t pages,
+                   L4_Word_t* recv_regs, size_t count);
+
+    stat_t Connect(L4_ThreadId_t peer, L4_Word_t* recv_regs, size_t count)
+    { return Connect(peer, DEFAULT_SHM_PAGES, recv_regs, count); }
+
+    stat_t Connect(L4_ThreadId_t peer, size_t pages)
+    { return Connect(peer, pages, 0, 0); }
 
-    stat_t Connect(L4_ThreadId_t peer) { return Connect(peer, 0, 0); }
+    stat_t Connect(L4_ThreadId_t peer)
+    { return Connect(peer, DEFAULT_SHM_PAGES, 0, 0); }
 
     virtual Bool IsConnected()
     { return L4_IsThreadNotEqual(_peer, L4_nilthread); }
@@ -129,6 +177,18 @@ public:
     ///
     virtual stat_t PutAsync(L4_Word_t* send_regs, size_t count);
 
+    ///
+    /// Rings the peer to process the requests queued in the ring formatted
+    /// over the shared memory.  Doesn't wait for the completions.
+    ///
+    virtual stat_t Submit();
+
+    ///
+    /// Takes a completion from the ring.  Blocks until the peer posts one.
+    /// Returns ERR_NOT_FOUND if no request waits for its completion.
+    ///
+    virtual stat_t Wait(SessionRing* ring, IoCompletion* cmp);
+
     virtual stat_t Get(L4_Word_t* send_regs, size_t scount,
                        L4_Word_t* recv_regs, size_t rcount)
     { return Xfer(MSG_SESSION_GET, send_regs, scount, recv_regs, rcount); }
@@ -138,6 +198,59 @@ public:
     ///
     virtual stat_t Get(L4_Word_t* send_regs, size_t count)
     { return Xfer(MSG_SESSION_GET, send_regs, count); }
+
+    ///
+    /// Obtains the largest count of entries in a batch of the given width.
+    /// The reply takes two registers per entry.
+    ///
+    static size_t MaxBatch(size_t width)
+    {
+        size_t n = (MAX_REGISTERS - 3) / width;
+        return (n < MAX_REGISTERS / 2) ? n : MAX_REGISTERS / 2;
+    }
+
+    ///
+    /// Issues several Get requests in one message.  Each entry holds the
+    /// registers of a single Get, excluding the session; the server defines
+    /// them, e.g. (length, offset, shm-offset) for a file.  The peer runs
+    /// its Get handler for each entry in order.
+    ///
+    /// @param entries      the registers of the entries
+    /// @param count        the count of entries, up to MaxBatch(width)
+    /// @param width        the count of registers per entry
+    /// @param results      (status, result) of each entry; 2 * count words
+    ///
+    virtual stat_t GetBatch(L4_Word_t* entries, size_t count, size_t width,
+                            L4_Word_t* results)
+    {
+        return XferBatch(MSG_SESSION_GET_BATCH, entries, count, width,
+                         results);
+    }
+
+    ///
+    /// Issues several Put requests in one message.  See GetBatch().
+    ///
+    virtual stat_t PutBatch(L4_Word_t* entries, size_t count, size_t width,
+                            L4_Word_t* results)
+    {
+        return XferBatch(MSG_SESSION_PUT_BATCH, entries, count, width,
+                         results);
+    }
+
+    ///
+    /// Asks the peer to fill pages of its own and moves them to the
+    /// destination instead of copying through the shared memory.  The peer
+    /// replies with the address and the count of the pages, followed by the
+    /// receiving registers.
+    ///
+    /// @param dest         the page-aligned destination
+    /// @param send_regs    the sending registers
+    /// @param scount       the count of sending registers
+    /// @param recv_regs    the receiving registers
+    /// @param rcount       the count of receiving registers
+    ///
+    virtual stat_t Receive(addr_t dest, L4_Word_t* send_regs, size_t scount,
+                           L4_Word_t* recv_regs, size_t rcount);
 };
 
 #endif // ARC_SESSION_H
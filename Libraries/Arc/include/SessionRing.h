@@ -0,0 +1,220 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @brief  Submission and completion rings in the shared memory of a session
+/// @file   Libraries/Arc/include/SessionRing.h
+/// @since  October 2008
+///
+
+#ifndef ARC_SESSION_RING_H
+#define ARC_SESSION_RING_H
+
+#include <Types.h>
+#include <l4/types.h>
+
+///
+/// A request queued by the client
+///
+struct IoRequest
+{
+    /// The operation (SessionRing::OP_READ, SessionRing::OP_WRITE, ...)
+    L4_Word_t   op;
+    /// Identifies the request in the completion
+    L4_Word_t   tag;
+    /// Server specific argument, such as a device number
+    L4_Word_t   arg;
+    /// The position in the file or the device
+    L4_Word_t   offset;
+    /// The length of the data in bytes
+    L4_Word_t   length;
+    /// The offset of the data in the data area of the shared memory
+    L4_Word_t   data;
+};
+
+///
+/// A completion posted by the server
+///
+struct IoCompletion
+{
+    L4_Word_t   tag;
+    L4_Word_t   status;
+    L4_Word_t   result;
+};
+
+///
+/// A pair of single-producer single-consumer rings placed at the beginning
+/// of the shared memory.  The client produces requests and consumes
+/// completions; the server does the opposite.  The rest of the shared
+/// memory is the data area.  Neither side takes a lock.
+///
+class SessionRing
+{
+public:
+    enum Operation {
+        OP_READ =           1,
+        OP_WRITE =          2,
+    };
+
+    static const UInt   MAGIC = 0x474E4952;     // "RING"
+
+protected:
+    struct Header
+    {
+        volatile UInt   magic;
+        volatile UInt   entries;
+        // Written by the client
+        volatile UInt   sq_tail;
+        volatile UInt   cq_head;
+        // Written by the server
+        volatile UInt   sq_head;
+        volatile UInt   cq_tail;
+        // The offset of the data area from the header
+        volatile UInt   data;
+        // Raised by the client before it blocks for a completion, and taken
+        // down by the server that wakes it
+        volatile UInt   waiting;
+    };
+
+    Header*         _hdr;
+    IoRequest*      _sq;
+    IoCompletion*   _cq;
+
+    ///
+    /// The count of entries.  The server never trusts the header after
+    /// attaching.
+    ///
+    UInt            _entries;
+
+    ///
+    /// The size of the shared memory in bytes
+    ///
+    size_t          _size;
+
+    static void Barrier() { __asm__ __volatile__ ("" ::: "memory"); }
+
+    ///
+    /// Orders a store before the following loads
+    ///
+    static void Fence()
+    {
+        __asm__ __volatile__ ("lock; addl $0, (%%esp)" ::: "memory");
+    }
+
+    static UInt Exchange(volatile UInt* ptr, UInt val)
+    {
+        __asm__ __volatile__ ("xchgl %0, %1"
+                              : "=r" (val), "+m" (*ptr)
+                              : "0" (val)
+                              : "memory");
+        return val;
+    }
+
+    static size_t DataOffset(UInt entries);
+
+public:
+    SessionRing() : _hdr(0), _sq(0), _cq(0), _entries(0), _size(0) {}
+
+    ///
+    /// Lays out the rings over the shared memory (client side).
+    ///
+    /// @param base     the base address of the shared memory
+    /// @param size     the size of the shared memory in bytes
+    /// @param entries  the count of entries of each ring; a power of two
+    ///
+    stat_t Format(addr_t base, size_t size, UInt entries);
+
+    ///
+    /// Checks the layout made by the client and attaches to it (server
+    /// side).
+    ///
+    stat_t Attach(addr_t base, size_t size);
+
+    Bool IsReady() const { return _hdr != 0; }
+
+    ///
+    /// Queues a request.  Returns FALSE if the ring is full.
+    ///
+    Bool Submit(const IoRequest& req);
+
+    ///
+    /// Takes a completion.  Returns FALSE if there is none.
+    ///
+    Bool Reap(IoCompletion* cmp);
+
+    ///
+    /// Takes a request.  Returns FALSE if there is none, or if the
+    /// completion ring has no room for its completion.
+    ///
+    Bool Fetch(IoRequest* req);
+
+    ///
+    /// Posts a completion.  Returns TRUE if the completion ring was empty.
+    ///
+    Bool Post(const IoCompletion& cmp);
+
+    ///
+    /// Checks if the client has requests whose completions it has not
+    /// taken yet (client side).
+    ///
+    Bool IsBusy() const { return _hdr->sq_tail != _hdr->cq_head; }
+
+    ///
+    /// Raises the waiting flag after Reap() has failed (client side).
+    /// Returns TRUE if the client has to block for a wake from the server,
+    /// or FALSE if a completion has been posted in the meantime.
+    ///
+    Bool PrepareWait();
+
+    ///
+    /// Takes down the waiting flag after posting completions (server side).
+    /// Returns TRUE if the client waits and has to be woken up.
+    ///
+    Bool TakeWaiter()
+    {
+        // The completions posted before the flag.  Pairs with the fence in
+        // PrepareWait().
+        Fence();
+        return _hdr->waiting != 0 && Exchange(&_hdr->waiting, 0) != 0;
+    }
+
+    ///
+    /// Obtains the address of a buffer in the data area.
+    ///
+    /// @return 0 if the buffer exceeds the data area.
+    ///
+    addr_t Buffer(L4_Word_t data, L4_Word_t length) const;
+
+    addr_t DataArea() const
+    { return reinterpret_cast<addr_t>(_hdr) + DataOffset(_entries); }
+
+    size_t DataSize() const { return _size - DataOffset(_entries); }
+};
+
+#endif // ARC_SESSION_RING_H
@@ -0,0 +1,272 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @brief  Lock-free rings of fixed-size items in the shared memory
+/// @file   Libraries/Arc/include/SharedRing.h
+/// @since  October 2008
+///
+
+#ifndef ARC_SHARED_RING_H
+#define ARC_SHARED_RING_H
+
+#include <Types.h>
+#include <l4/types.h>
+
+///
+/// A ring of fixed-size items that is shared by tasks, e.g., in the window
+/// of a session.  The header keeps only indices and offsets so that the
+/// ring can be mapped at a different address in each task.  The indices of
+/// the consumer and the producers sit on their own cache lines.
+///
+/// The ring has either a single producer, or many producers that reserve
+/// their slots with an atomic operation.  It always has a single consumer.
+/// A side that finds the ring empty (full) raises its sleeping flag before
+/// it blocks, and the peer sends a wake only when it takes the flag down.
+///
+class SharedRing
+{
+public:
+    enum Side {
+        CONSUMER =          0,
+        PRODUCER =          1,
+    };
+
+    static const UInt   MAGIC = 0x474E5253;     // "SRNG"
+
+    ///
+    /// The ring has many producers
+    ///
+    static const UInt   MULTI_PRODUCER = 0x01;
+
+    static const size_t CACHE_LINE = 64;
+
+    ///
+    /// The longest time in microseconds a lost wake delays the sleeping side
+    ///
+    static const L4_Word_t  POLL_INTERVAL = 10000;
+
+    ///
+    /// The time in microseconds a wake waits for the peer to receive it
+    ///
+    static const L4_Word_t  WAKE_TIMEOUT = 1000;
+
+protected:
+    struct Header
+    {
+        // Set up by Format()
+        volatile UInt   magic;
+        volatile UInt   flags;
+        volatile UInt   entries;
+        volatile UInt   item_size;
+        // The distance between the slots in bytes
+        volatile UInt   stride;
+        // The offset of the first slot from the header
+        volatile UInt   data;
+        UByte           pad0[CACHE_LINE - 6 * sizeof(UInt)];
+
+        // Written by the consumer
+        volatile UInt   head;
+        volatile UInt   consumer_sleeping;
+        UByte           pad1[CACHE_LINE - 2 * sizeof(UInt)];
+
+        // Written by the producers
+        volatile UInt   tail;
+        volatile UInt   producer_sleeping;
+        UByte           pad2[CACHE_LINE - 2 * sizeof(UInt)];
+    };
+
+    Header*         _hdr;
+
+    ///
+    /// The first slot in this address space
+    ///
+    addr_t          _data;
+
+    ///
+    /// The layout read at Format() or Attach().  Neither side trusts the
+    /// header afterwards.
+    ///
+    UInt            _entries;
+    UInt            _item_size;
+    UInt            _stride;
+    Bool            _multi;
+
+    static void Barrier() { __asm__ __volatile__ ("" ::: "memory"); }
+
+    ///
+    /// Orders a store before the following loads
+    ///
+    static void Fence()
+    {
+        __asm__ __volatile__ ("lock; addl $0, (%%esp)" ::: "memory");
+    }
+
+    static UInt Exchange(volatile UInt* ptr, UInt val)
+    {
+        __asm__ __volatile__ ("xchgl %0, %1"
+                              : "=r" (val), "+m" (*ptr)
+                              : "0" (val)
+                              : "memory");
+        return val;
+    }
+
+    static UInt CompareAndSwap(volatile UInt* ptr, UInt cmp, UInt val)
+    {
+        UInt    ret;
+
+        __asm__ __volatile__ ("lock             \n"
+                              "cmpxchgl %2, %1  \n"
+                              : "=a" (ret), "+m" (*ptr)
+                              : "r" (val), "0" (cmp)
+                              : "memory");
+        return ret;
+    }
+
+    addr_t Slot(UInt index) const
+    { return _data + (index & (_entries - 1)) * _stride; }
+
+    ///
+    /// The sequence number at the beginning of a slot of a multi-producer
+    /// ring.  It tells the round of the slot and whether the item in it is
+    /// complete.
+    ///
+    volatile UInt* Sequence(UInt index) const
+    { return reinterpret_cast<volatile UInt*>(Slot(index)); }
+
+    addr_t Item(UInt index) const
+    { return _multi ? Slot(index) + sizeof(UInt) : Slot(index); }
+
+    volatile UInt* Flag(Side side) const
+    { return side == CONSUMER ? &_hdr->consumer_sleeping :
+                                &_hdr->producer_sleeping; }
+
+    static UInt Stride(size_t item_size, Bool multi);
+
+    Bool PutSingle(const void* item);
+
+    Bool PutMulti(const void* item);
+
+    stat_t Sleep(L4_ThreadId_t peer);
+
+public:
+    SharedRing() : _hdr(0), _data(0), _entries(0), _item_size(0),
+                   _stride(0), _multi(FALSE) {}
+
+    ///
+    /// Lays out the ring over the shared memory.  The ring takes as many
+    /// entries as fit, rounded down to a power of two.
+    ///
+    /// @param base         the base address of the shared memory
+    /// @param size         the size of the shared memory in bytes
+    /// @param item_size    the size of an item in bytes
+    /// @param multi        the ring has many producers
+    ///
+    stat_t Format(addr_t base, size_t size, size_t item_size, Bool multi);
+
+    ///
+    /// Checks the layout made by the peer and attaches to it.
+    ///
+    /// @param base         the base address of the shared memory
+    /// @param size         the size of the shared memory in bytes
+    /// @param item_size    the size of an item expected by the caller
+    ///
+    stat_t Attach(addr_t base, size_t size, size_t item_size);
+
+    Bool IsReady() const { return _hdr != 0; }
+
+    UInt Entries() const { return _entries; }
+
+    size_t ItemSize() const { return _item_size; }
+
+    ///
+    /// Queues an item.  Returns FALSE if the ring is full.
+    ///
+    Bool Put(const void* item)
+    { return _multi ? PutMulti(item) : PutSingle(item); }
+
+    ///
+    /// Takes an item.  Returns FALSE if the ring is empty.
+    ///
+    Bool Get(void* item);
+
+    Bool IsEmpty() const;
+
+    ///
+    /// Checks if a single producer has no room.  Each of many producers
+    /// learns it only from Put().
+    ///
+    Bool IsFull() const
+    { return _hdr->tail - _hdr->head >= _entries; }
+
+    ///
+    /// Raises the sleeping flag of the side after Get() (Put()) has failed.
+    /// Returns TRUE if the side has to wait for a wake from the peer, or
+    /// FALSE if the ring has changed in the meantime.  The producers of a
+    /// multi-producer ring never sleep on the flag.
+    ///
+    Bool PrepareSleep(Side side);
+
+    ///
+    /// Takes down the sleeping flag of the peer after a Put() (Get()).
+    /// Returns TRUE if the peer was sleeping and has to be woken up.
+    ///
+    Bool TakeSleeper(Side side)
+    {
+        volatile UInt*  flag = Flag(side);
+
+        // The index published by the caller before the flag of the peer
+        Fence();
+        return *flag != 0 && Exchange(flag, 0) != 0;
+    }
+
+    ///
+    /// Queues an item, blocking while the ring is full, and wakes the
+    /// consumer if it sleeps.
+    ///
+    /// @param consumer     the thread consuming the ring
+    ///
+    stat_t Push(const void* item, L4_ThreadId_t consumer);
+
+    ///
+    /// Takes an item, blocking while the ring is empty, and wakes the
+    /// single producer if it sleeps.  The calling thread must not receive
+    /// other messages from the producers meanwhile.
+    ///
+    /// @param producer     the producing thread, or nil for any thread
+    ///
+    stat_t Pop(void* item, L4_ThreadId_t producer);
+
+    ///
+    /// Sends a wake to the sleeping side.
+    ///
+    static void Wake(L4_ThreadId_t tid);
+};
+
+#endif // ARC_SHARED_RING_H
@@ -42,6 +42,7 @@
 #include <List.h>
 #include <Mutex.h>
 #include <PageAllocator.h>
+#include <ThreadCache.h>
 #include <Assert.h>
 #include <Types.h>
 #include <sys/Config.h>
@@ -97,6 +98,16 @@ protected:
     ///
     addr_t              _sp;
 
+    ///
+    /// The base of the stack
+    ///
+    addr_t              _stack;
+
+    ///
+    /// The number of the pages of the stack
+    ///
+    size_t              _stack_pages;
+
     ///
     /// The current priority of the thread
     ///
@@ -121,11 +132,34 @@ protected:
 
     L4_ThreadId_t       _destructor;
 
+    ///
+    /// The L4 thread is taken from the thread cache
+    ///
+    Bool                _pooled;
+
+    Bool                _started;
+
+    ///
+    /// The L4 thread has returned to the thread cache
+    ///
+    Bool                _parked;
+
     ///
     /// The default entry point
     ///
     static void BootStrap(Thread<STACK_SIZE> *th);
 
+    ///
+    /// The entry point of a thread from the cache
+    ///
+    static Bool Resume(L4_Word_t arg);
+
+    ///
+    /// Runs the thread and notifies the joining threads.  Returns TRUE if
+    /// the L4 thread goes back to the cache.
+    ///
+    Bool Body();
+
     void SetState(UByte s) {
         _state_lock.Lock();
         _state = s;
@@ -208,12 +242,23 @@ public:
 
 template <size_t STACK_SIZE>
 Thread<STACK_SIZE>::Thread(size_t stack_size = STACK_SIZE)
-    : _priority(DEFAULT_PRIORITY), _state(READY), _destructor(L4_nilthread)
+    : _stack(0), _stack_pages(0), _priority(DEFAULT_PRIORITY),
+      _state(READY), _destructor(L4_nilthread), _pooled(FALSE),
+      _started(FALSE), _parked(FALSE)
 {
-    UInt        count;
     L4_Msg_t    msg;
     stat_t      err;
 
+    // A parked thread is started with a single IPC.  A new one comes from
+    // the cache so that it is parked when it finishes.
+    if (stack_size <= ThreadCache::STACK_SIZE &&
+        (ThreadCache::Acquire(&_tid, &_stack) ||
+         ThreadCache::Create(&_tid, &_stack, FALSE) == ERR_NONE)) {
+        _stack_pages = ThreadCache::STACK_SIZE / PAGE_SIZE;
+        _pooled = TRUE;
+        return;
+    }
+
     L4_Put(&msg, MSG_ROOT_NEW_TH, 0, 0, 0, 0);
     err = Ipc::Call(L4_Pager(), &msg, &msg);
     if (err != ERR_NONE) {
@@ -224,8 +269,9 @@ Thread<STACK_SIZE>::Thread(size_t stack_size = STACK_SIZE)
     _tid.raw = L4_Get(&msg, 0);
 
     // Allocate stack
-    for (count = 0; (1UL << count) < PAGE_ALIGN(stack_size); count++) ;
-    _sp = palloc(count) + stack_size - sizeof(this);
+    _stack_pages = PAGE_ALIGN(stack_size) / PAGE_SIZE;
+    _stack = palloc(_stack_pages);
+    _sp = _stack + stack_size - sizeof(this);
     *reinterpret_cast<addr_t *>(_sp) = reinterpret_cast<addr_t>(this);
     _sp -= 4;
 
@@ -238,12 +284,8 @@ Thread<STACK_SIZE>::~Thread()
 {
     ENTER;
 
-    L4_Msg_t    msg;
-    L4_Word_t   reg[2];
-    stat_t      err;
-
     _state_lock.Lock();
-    if (_state == READY) {
+    if (_started && _state == READY) {
         _destructor = L4_Myself();
         _state_lock.Unlock();
         L4_Receive(_tid);
@@ -252,40 +294,68 @@ Thread<STACK_SIZE>::~Thread()
         _state_lock.Unlock();
     }
 
-    reg[0] = _tid.raw;
-    reg[1] = L4_Myself().raw;
-    L4_Put(&msg, MSG_ROOT_DEL_TH, 2, reg, 0, 0);
-    err = Ipc::Call(L4_Pager(), &msg, &msg);
-    if (err != ERR_NONE) {
-        System.Print(System.ERROR, "thread deletion failed\n");
+    if (_parked) {
+        return;
+    }
+    if (_pooled && !_started && ThreadCache::Release(_tid, _stack)) {
         return;
     }
 
+    ThreadCache::Destroy(_tid, _stack, _stack_pages);
+
     EXIT;
 }
 
 
 template <size_t STACK_SIZE>
-void
-Thread<STACK_SIZE>::BootStrap(Thread<STACK_SIZE> *th)
+Bool
+Thread<STACK_SIZE>::Body()
 {
-    assert(th != 0);
-    th->Run();
-    th->SetState(READY);
+    Bool    parked;
 
-    Iterator<L4_ThreadId_t>& it = th->_listeners.GetIterator();
+    Run();
+    SetState(READY);
+
+    Iterator<L4_ThreadId_t>& it = _listeners.GetIterator();
     while (it.HasNext()) {
         L4_ThreadId_t tid = it.Next();
         L4_Send(tid);
-        th->DelListener(tid);
+        DelListener(tid);
     }
-    th->SetState(TERMINATED);
-    if (!L4_IsNilThread(th->_destructor)) {
-        L4_Send(th->_destructor);
+
+    // Decide before the object can be deleted
+    parked = _pooled && ThreadCache::Reserve();
+    if (parked && _priority != DEFAULT_PRIORITY) {
+        SetPriority(DEFAULT_PRIORITY);
     }
+    _parked = parked;
+
+    SetState(TERMINATED);
+    if (!L4_IsNilThread(_destructor)) {
+        L4_Send(_destructor);
+    }
+    return parked;
+}
+
+template <size_t STACK_SIZE>
+void
+Thread<STACK_SIZE>::BootStrap(Thread<STACK_SIZE> *th)
+{
+    assert(th != 0);
+    th->Body();
     L4_Sleep(L4_Never);
 }
 
+template <size_t STACK_SIZE>
+Bool
+Thread<STACK_SIZE>::Resume(L4_Word_t arg)
+{
+    Thread<STACK_SIZE>* th = reinterpret_cast<Thread<STACK_SIZE>*>(arg);
+
+    assert(th != 0);
+    return th->Body();
+}
+
 template <size_t STACK_SIZE>
 stat_t
 Thread<STACK_SIZE>::Start()
@@ -295,21 +365,33 @@ Thread<STACK_SIZE>::Start()
         return ERR_NONE;
     }
 
-    L4_Msg_t    msg;
-    L4_Word_t   reg[3];
-    stat_t      err;
+    ThreadStartRequest  req;
+    stat_t              err;
+
+    if (_pooled) {
+        // The thread may finish before the send returns.
+        SetState(RUNNING);
+        _started = TRUE;
+        err = ThreadCache::Start(_tid, Resume,
+                                 reinterpret_cast<L4_Word_t>(this));
+        if (err != ERR_NONE) {
+            _started = FALSE;
+            SetState(READY);
+        }
+        return err;
+    }
 
-    reg[0] = _tid.raw;
-    reg[1] = (L4_Word_t)BootStrap;
-    reg[2] = _sp;
+    req.tid = _tid;
+    req.ip = (L4_Word_t)BootStrap;
+    req.sp = _sp;
 
-    L4_Put(&msg, MSG_PEL_START_TH, 3, reg, 0, 0);
-    err = Ipc::Call(L4_Pager(), &msg, &msg);
+    err = Ipc::Call<ThreadStartMessage>(L4_Pager(), req);
     if (err != ERR_NONE) {
         return err;
     }
 
     SetState(RUNNING);
+    _started = TRUE;
     L4_ThreadSwitch(_tid);
 
     EXIT;
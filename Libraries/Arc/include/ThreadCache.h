@@ -0,0 +1,137 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @brief  Cache of parked threads of a task
+/// @file   Libraries/Arc/include/ThreadCache.h
+/// @since  October 2008
+///
+
+#ifndef ARC_THREAD_CACHE_H
+#define ARC_THREAD_CACHE_H
+
+#include <Mutex.h>
+#include <Types.h>
+#include <sys/Config.h>
+#include <l4/types.h>
+
+///
+/// Keeps the L4 threads of the task that have finished their work, each
+/// with a stack already faulted in.  A parked thread waits in Loop() for a
+/// start message from a thread of the task, which makes the start a single
+/// local IPC instead of the requests to the root task.
+///
+class ThreadCache
+{
+public:
+    ///
+    /// The number of parked threads kept at most
+    ///
+    static const size_t     CAPACITY = 8;
+
+    ///
+    /// The size of the stack of a cached thread.  Threads with larger
+    /// stacks are not cached.
+    ///
+    static const size_t     STACK_SIZE = 4 * PAGE_SIZE;
+
+    static const L4_Word_t  START_LABEL = 0xFFE0;
+
+    ///
+    /// Runs the work given by a start message.  Returns TRUE if the thread
+    /// has reserved its place in the cache with Reserve().
+    ///
+    typedef Bool (*Entry)(L4_Word_t arg);
+
+private:
+    struct Parked
+    {
+        L4_ThreadId_t   tid;
+        addr_t          stack;
+    };
+
+    static Mutex        _lock;
+
+    static Parked       _parked[CAPACITY];
+
+    static size_t       _count;
+
+    ///
+    /// The places promised to the threads on their way to the cache
+    ///
+    static size_t       _reserved;
+
+    static void Insert(L4_ThreadId_t tid, addr_t stack);
+
+    static void Loop(addr_t stack, Bool cached);
+
+public:
+    ///
+    /// Creates a thread that waits for a start message.
+    ///
+    /// @param tid      the new thread
+    /// @param stack    the base of its stack
+    /// @param cached   the thread parks itself in the cache
+    ///
+    static stat_t Create(L4_ThreadId_t* tid, addr_t* stack, Bool cached);
+
+    ///
+    /// Deletes a thread that is not in the cache, and frees its stack.
+    ///
+    static void Destroy(L4_ThreadId_t tid, addr_t stack, size_t pages);
+
+    ///
+    /// Fills the cache with new threads ahead of their use.
+    ///
+    static stat_t Prefill(size_t count);
+
+    ///
+    /// Takes a parked thread.  Returns FALSE if the cache is empty.
+    ///
+    static Bool Acquire(L4_ThreadId_t* tid, addr_t* stack);
+
+    ///
+    /// Gives back a thread taken by Acquire() or made by Create() that has
+    /// not been started.  Returns FALSE if the cache is full.
+    ///
+    static Bool Release(L4_ThreadId_t tid, addr_t stack);
+
+    ///
+    /// Reserves a place for the calling thread before it returns to
+    /// Loop().  Returns FALSE if the cache is full.
+    ///
+    static Bool Reserve();
+
+    ///
+    /// Hands work to a parked thread.
+    ///
+    static stat_t Start(L4_ThreadId_t tid, Entry entry, L4_Word_t arg);
+};
+
+#endif // ARC_THREAD_CACHE_H
@@ -0,0 +1,188 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @brief  Worker threads of a server
+/// @file   Libraries/Arc/include/WorkerPool.h
+/// @since  October 2008
+///
+
+#ifndef ARC_WORKER_POOL_H
+#define ARC_WORKER_POOL_H
+
+#include <Semaphore.h>
+#include <Thread.h>
+#include <Types.h>
+#include <l4/message.h>
+#include <l4/types.h>
+
+class BasicServer;
+class WorkerPool;
+
+///
+/// A thread that processes the requests handed over by the dispatcher.
+/// The requests are queued and processed in order.
+///
+class ServerWorker : public Thread<2 * PAGE_SIZE>
+{
+public:
+    ///
+    /// The number of requests waiting for a worker
+    ///
+    static const size_t QUEUE_LENGTH = 8;
+
+private:
+    struct Job
+    {
+        L4_ThreadId_t   tid;
+        L4_Msg_t        msg;
+
+        ///
+        /// The time the job was queued, or 0 if not profiled
+        ///
+        ULong           stamp;
+    };
+
+    WorkerPool*         _pool;
+
+    Job                 _queue[QUEUE_LENGTH];
+
+    ///
+    /// The job being processed.  Only the worker advances it.
+    ///
+    size_t              _head;
+
+    ///
+    /// The next free slot.  Only the dispatcher advances it.
+    ///
+    size_t              _tail;
+
+    ///
+    /// Counts the jobs queued.  The worker blocks on it while idle.
+    ///
+    Semaphore           _jobs;
+
+    ///
+    /// Counts the free slots.  The dispatcher blocks on it while the queue
+    /// is full.
+    ///
+    Semaphore           _slots;
+
+    ServerWorker();
+
+public:
+    ServerWorker(WorkerPool* pool)
+        : Thread<2 * PAGE_SIZE>(), _pool(pool), _head(0), _tail(0),
+          _jobs(0), _slots(0, QUEUE_LENGTH) {}
+
+    virtual ~ServerWorker() {}
+
+    ///
+    /// Queues a request.  Blocks while the queue is full.
+    ///
+    void Push(const L4_ThreadId_t& tid, const L4_Msg_t& msg, ULong stamp);
+
+    ///
+    /// Blocks until the queued requests are processed.
+    ///
+    void Drain();
+
+    void Run();
+};
+
+///
+/// Runs the requests of a server in worker threads.  The thread that
+/// receives the requests, the dispatcher, hands each of them to a worker
+/// chosen by a key, and the worker replies to the client on behalf of the
+/// dispatcher.  Requests with the same key are processed in the order they
+/// arrive.
+///
+/// The handlers of the server must be reentrant for the requests with
+/// different keys.
+///
+class WorkerPool
+{
+public:
+    static const size_t MAX_WORKERS = 8;
+
+private:
+    BasicServer*        _server;
+
+    L4_ThreadId_t       _dispatcher;
+
+    ServerWorker*       _workers[MAX_WORKERS];
+
+    size_t              _count;
+
+public:
+    WorkerPool(BasicServer* server);
+
+    virtual ~WorkerPool();
+
+    ///
+    /// Creates the workers.  The calling thread becomes the dispatcher.
+    ///
+    /// @param count    the number of the workers
+    ///
+    stat_t Start(size_t count);
+
+    ///
+    /// Hands a request to the worker for the key.
+    ///
+    void Dispatch(const L4_ThreadId_t& tid, const L4_Msg_t& msg,
+                  L4_Word_t key);
+
+    ///
+    /// Blocks until all the workers finish the queued requests.  Used
+    /// before the dispatcher processes a request by itself.
+    ///
+    void Drain();
+
+    ///
+    /// Processes a request and replies to the client.  Called by the
+    /// workers.
+    ///
+    /// @param tid      the client
+    /// @param msg      the request
+    /// @param stamp    the time the request was queued
+    ///
+    void Handle(const L4_ThreadId_t& tid, L4_Msg_t& msg, ULong stamp);
+
+    ///
+    /// Makes a message from a worker appear to come from the dispatcher,
+    /// which is what the client waits for.
+    ///
+    void Propagate(L4_Msg_t* msg);
+
+    L4_ThreadId_t Dispatcher() const { return _dispatcher; }
+
+    size_t Count() const { return _count; }
+};
+
+#endif // ARC_WORKER_POOL_H
@@ -39,6 +39,7 @@
 #include <Debug.h>
 #include <FileStream.h>
 #include <Ipc.h>
+#include <MemoryManager.h>
 #include <Session.h>
 #include <String.h>
 #include <Types.h>
@@ -47,7 +48,7 @@ stat_t
 FileStream::Open(const char *path, UInt mode)
 {
     stat_t      err;
-    L4_Word_t   reg[2];
+    L4_Word_t   reg[3];
 
     ENTER;
 
@@ -55,12 +56,16 @@ FileStream::Open(const char *path, UInt mode)
     memcpy(reinterpret_cast<void*>(_ss->GetBaseAddress()),
            path, strlen(path) + 1);
 
-    reg[0] = mode;
-    err = _ss->Begin(reg, 1, reg, 2);
+    _map = (mode & MAP) != 0;
+    reg[0] = mode & ~MAP;
+    // Reply: [inode, size, mtime]
+    reg[2] = 0;
+    err = _ss->Begin(reg, 1, reg, 3);
     if (err != ERR_NONE) {
         return err;
     }
     _size = reg[1];
+    _mtime = reg[2];
 
     _offset = 0;
 
@@ -68,6 +73,46 @@ FileStream::Open(const char *path, UInt mode)
     return ERR_NONE;
 }
 
+///
+/// Reads whole pages by moving the pages filled by the server to the buffer.
+///
+stat_t
+FileStream::ReadPages(addr_t ptr, UInt offset, Int length, Int* rsize)
+{
+    L4_Word_t   reg[2];
+    Int         read = 0;
+    Int         max = MemoryManager::MAX_MAP_PAGES * PAGE_SIZE;
+    stat_t      err;
+
+    ENTER;
+
+    while (0 < length) {
+        Int len = (length < max) ? length : max;
+
+        reg[0] = len;
+        reg[1] = offset;
+        err = _ss->Receive(ptr, reg, 2, reg, 1);
+        if (err != ERR_NONE) {
+            if (read == 0) {
+                return err;
+            }
+            break;
+        }
+
+        ptr += reg[0];
+        offset += reg[0];
+        length -= reg[0];
+        read += reg[0];
+
+        if (static_cast<Int>(reg[0]) < len) {
+            break;
+        }
+    }
+
+    *rsize = read;
+    EXIT;
+    return ERR_NONE;
+}
 
 stat_t
 FileStream::Write(const void *buffer, size_t count, size_t* wsize)
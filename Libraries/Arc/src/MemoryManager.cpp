@@ -49,12 +49,19 @@ MemoryManager   Pager;
 
 stat_t
 MemoryManager::Reserve(addr_t base, L4_ThreadId_t peer, UInt perm)
+{
+    return Reserve(base, 1, peer, perm);
+}
+
+stat_t
+MemoryManager::Reserve(addr_t base, size_t count, L4_ThreadId_t peer,
+                       UInt perm)
 {
     L4_Msg_t    msg;
     L4_Word_t   reg[3];
 
     reg[0] = base;
-    reg[1] = 1;
+    reg[1] = count;
     reg[2] = L4_ThreadNo(peer) << 14 | perm;
 
     L4_Put(&msg, MSG_PAGER_ALLOCATE | L4_ReadWriteOnly, 3, reg, 0, 0);
@@ -96,43 +103,71 @@ MemoryManager::IsMapped(addr_t address, UInt rwx)
 
 stat_t
 MemoryManager::Map(addr_t dest, L4_ThreadId_t did, UInt rwx,
-                   addr_t src, L4_ThreadId_t sid)
+                   addr_t src, L4_ThreadId_t sid, size_t count)
 {
-    L4_Msg_t    msg;
-    L4_Word_t   reg[5];
-    stat_t      err;
+    PagerMapRequest req;
+    L4_Word_t       label;
+    stat_t          err;
 
-    if (IsMapped(dest, rwx)) {
+    if (count == 1 && (rwx & MSG_PAGER_MAP_MOVE) == 0 &&
+        IsMapped(dest, rwx)) {
         return ERR_NONE;
     }
 
-    reg[0] = dest;
-    reg[1] = did.raw;
-    reg[2] = src;
-    reg[3] = sid.raw;
-    reg[4] = 1;
+    label = MSG_PAGER_MAP | (rwx & (0x7 | MSG_PAGER_MAP_MOVE));
+    req.did = did;
+    req.sid = sid;
 
     L4_Accept(L4_MapGrantItems(L4_CompleteAddressSpace));
-    L4_Put(&msg, MSG_PAGER_MAP | (rwx & 0x7), 5, reg, 0, 0);
-    err = Ipc::Call(L4_Pager(), &msg, &msg);
-    L4_Accept(L4_MapGrantItems(L4_Nilpage));
-    if (err != ERR_NONE) {
-        return err;
+    while (count > 0) {
+        size_t n = count < MAX_MAP_PAGES ? count : MAX_MAP_PAGES;
+
+        req.dest = dest;
+        req.src = src;
+        req.count = n;
+
+        err = Ipc::Call<PagerMapMessage>(L4_Pager(), label, req);
+        if (err != ERR_NONE) {
+            L4_Accept(L4_MapGrantItems(L4_Nilpage));
+            return err;
+        }
+
+        dest += n * PAGE_SIZE;
+        if (src != 0) {
+            src += n * PAGE_SIZE;
+        }
+        count -= n;
     }
+    L4_Accept(L4_MapGrantItems(L4_Nilpage));
 
     return ERR_NONE;
 }
 
+stat_t
+MemoryManager::Map(addr_t dest, UInt rwx, addr_t src, L4_ThreadId_t sid,
+                   size_t count)
+{
+    return Map(dest, L4_Myself(), rwx, src, sid, count);
+}
+
+stat_t
+MemoryManager::Move(addr_t dest, UInt rwx, addr_t src, L4_ThreadId_t sid,
+                    size_t count)
+{
+    return Map(dest, L4_Myself(), (rwx & 0x7) | MSG_PAGER_MAP_MOVE,
+               src, sid, count);
+}
+
 stat_t
 MemoryManager::Map(addr_t dest, UInt rwx, addr_t src, L4_ThreadId_t sid)
 {
-    return Map(dest, L4_Myself(), rwx, src, sid);
+    return Map(dest, L4_Myself(), rwx, src, sid, 1);
 }
 
 stat_t
 MemoryManager::Map(addr_t dest, UInt rwx)
 {
-    return Map(dest, L4_Myself(), rwx, 0, L4_anythread);
+    return Map(dest, L4_Myself(), rwx, 0, L4_anythread, 1);
 }
 
 addr_t
@@ -57,20 +57,30 @@ palloc_shm(size_t count, L4_ThreadId_t tid, UInt perm)
     addr_t      base;
 
     base = palloc(count);
-    if (base != 0) {
-        addr_t tmp = base;
-        for (size_t i = 0; i < count; i++) {
-            //FIXME: atomic {
-            Pager.Release(tmp);
-            if (Pager.Reserve(tmp, tid, perm) != ERR_NONE) {
-                //FIXME: } atomic
-                for (size_t j = 0; j < i; j++) {
-                    Pager.Release(base + j * PAGE_SIZE);
-                }
-                pfree(base, count);
-                return 0;
+    if (base == 0) {
+        return 0;
+    }
+
+    //FIXME: atomic {
+    for (size_t i = 0; i < count; i++) {
+        Pager.Release(base + i * PAGE_SIZE);
+    }
+
+    // Reserve the region at once so that the pager can map it in a single
+    // request.  Fall back to page-by-page reservation if the pager has no
+    // contiguous frames.
+    if (Pager.Reserve(base, count, tid, perm) == ERR_NONE) {
+        return base;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (Pager.Reserve(base + i * PAGE_SIZE, tid, perm) != ERR_NONE) {
+            //FIXME: } atomic
+            for (size_t j = 0; j < i; j++) {
+                Pager.Release(base + j * PAGE_SIZE);
             }
-            tmp += PAGE_SIZE;
+            pfree(base, count);
+            return 0;
         }
     }
 
@@ -43,15 +43,166 @@
 #include <Session.h>
 #include <System.h>
 #include <Types.h>
+#include <WorkerPool.h>
 #include <l4/ipc.h>
 
 
+BasicServer::~BasicServer()
+{
+    if (_profile != 0) {
+        delete _profile;
+    }
+}
+
+stat_t
+BasicServer::EnableProfile(Bool on)
+{
+    if (_profile == 0) {
+        if (!on) {
+            return ERR_NONE;
+        }
+        _profile = new IpcProfile;
+        if (_profile == 0) {
+            return ERR_OUT_OF_MEMORY;
+        }
+    }
+
+    _profile->Enable(on);
+    return ERR_NONE;
+}
+
+void
+BasicServer::HandleProfile(L4_Msg_t& msg)
+{
+    stat_t  err;
+
+    if (L4_UntypedWords(L4_MsgTag(&msg)) > 0 &&
+        L4_Get(&msg, 0) == IpcProfile::OP_ENABLE) {
+        err = EnableProfile(TRUE);
+        if (err != ERR_NONE) {
+            Ipc::ReturnError(&msg, err);
+            return;
+        }
+    }
+
+    if (_profile == 0) {
+        Ipc::ReturnError(&msg, ERR_NOT_FOUND);
+        return;
+    }
+
+    _profile->Query(&msg);
+}
+
+stat_t
+BasicServer::RunRing(void* client, addr_t base, size_t size, L4_Msg_t& msg)
+{
+    SessionRing    ring;
+    IoRequest      req;
+    IoCompletion   cmp;
+    L4_Word_t      count = 0;
+    Bool           notify = FALSE;
+
+    ENTER;
+
+    if (ring.Attach(base, size) != ERR_NONE) {
+        Ipc::ReturnError(&msg, ERR_INVALID_ARGUMENTS);
+        return ERR_NONE;
+    }
+
+    while (ring.Fetch(&req)) {
+        addr_t buf = ring.Buffer(req.data, req.length);
+
+        cmp.tag = req.tag;
+        if (buf == 0) {
+            cmp.status = ERR_OUT_OF_RANGE;
+            cmp.result = 0;
+        }
+        else {
+            ServeRequest(client, req, buf, cmp);
+        }
+
+        ring.Post(cmp);
+        count++;
+    }
+
+    // The reply wakes up the client if it waits for the completions.
+    notify = ring.TakeWaiter();
+    L4_Put(&msg, notify ? MSG_SESSION_COMPLETE : ERR_NONE, 1, &count, 0, 0);
+
+    EXIT;
+    return ERR_NONE;
+}
+
+stat_t
+BasicServer::RunBatch(const L4_ThreadId_t& tid, L4_Msg_t& msg)
+{
+    L4_Msg_t    req;
+    L4_Word_t   words[__L4_NUM_MRS];
+    L4_Word_t   results[__L4_NUM_MRS];
+    L4_Word_t   label;
+    L4_Word_t   count;
+    L4_Word_t   width;
+    size_t      len;
+    stat_t      err;
+
+    ENTER;
+
+    len = L4_UntypedWords(L4_MsgTag(&msg));
+    if (len < 3) {
+        Ipc::ReturnError(&msg, ERR_INVALID_ARGUMENTS);
+        return ERR_NONE;
+    }
+
+    count = L4_Get(&msg, 1);
+    width = L4_Get(&msg, 2);
+    // Bound the count before multiplying so that the products cannot wrap.
+    if (width == 0 || count == 0 || (__L4_NUM_MRS - 4) / width < count ||
+        (__L4_NUM_MRS - 1) / 2 < count || len != 3 + count * width) {
+        Ipc::ReturnError(&msg, ERR_INVALID_ARGUMENTS);
+        return ERR_NONE;
+    }
+
+    label = (L4_Label(L4_MsgTag(&msg)) == MSG_SESSION_PUT_BATCH) ?
+            MSG_SESSION_PUT : MSG_SESSION_GET;
+
+    // The handlers overwrite the message with the reply.
+    for (size_t i = 0; i < len; i++) {
+        words[i] = L4_Get(&msg, i);
+    }
+
+    for (L4_Word_t i = 0; i < count; i++) {
+        L4_Clear(&req);
+        L4_Set_Label(&req, label);
+        L4_Append(&req, words[0]);
+        for (L4_Word_t j = 0; j < width; j++) {
+            L4_Append(&req, words[3 + i * width + j]);
+        }
+
+        err = IpcHandler(tid, req);
+        if (err != ERR_NONE) {
+            return err;
+        }
+
+        // Replies put the status in the label and the result in the
+        // second word.
+        results[2 * i] = L4_Label(L4_MsgTag(&req));
+        results[2 * i + 1] = (L4_UntypedWords(L4_MsgTag(&req)) > 1) ?
+                             L4_Get(&req, 1) : 0;
+    }
+
+    L4_Put(&msg, ERR_NONE, 2 * count, results, 0, 0);
+
+    EXIT;
+    return ERR_NONE;
+}
+
 stat_t
 BasicServer::Run()
 {
     L4_ThreadId_t   tid;
     L4_MsgTag_t     tag;
     L4_Msg_t        msg;
+    ULong           start;
     stat_t          err = ERR_UNKNOWN;
    
 begin:
@@ -76,6 +227,22 @@ begin:
         }
 
         L4_Store(tag, &msg);
+        if (L4_Label(tag) == MSG_SERVER_PROFILE) {
+            HandleProfile(msg);
+            L4_Load(&msg);
+            tag = L4_ReplyWait(tid, &tid);
+            continue;
+        }
+
+        start = (_profile != 0) ? _profile->Begin() : 0;
+        if (Defer(tid, msg)) {
+            if (_profile != 0) {
+                _profile->Resume();
+            }
+            tag = L4_Wait(&tid);
+            continue;
+        }
+
         err = IpcHandler(tid, msg);
         if (err != ERR_NONE) {
             System.Print(System.WARN,
@@ -83,6 +250,9 @@ begin:
                          Name(), L4_Label(tag), tid.raw);
             break;
         }
+        if (_profile != 0) {
+            _profile->End(L4_Label(tag), start);
+        }
         //DOUT("%.8lX\n", msg.tag);
         L4_Load(&msg);
         tag = L4_ReplyWait(tid, &tid);
@@ -115,6 +285,7 @@ SelfHealingServer::Run(int state)
 {
     L4_Msg_t        msg;
     L4_MsgTag_t     tag;
+    ULong           start = 0;
     stat_t          err = ERR_UNKNOWN;
    
     if (state == 1) {
@@ -145,6 +316,21 @@ begin:
         }
 
         L4_Store(tag, &_sh_msg);
+        if (L4_Label(tag) == MSG_SERVER_PROFILE) {
+            HandleProfile(_sh_msg);
+            L4_Load(&_sh_msg);
+            tag = L4_ReplyWait(_sh_tid, &_sh_tid);
+            continue;
+        }
+
+        start = (_profile != 0) ? _profile->Begin() : 0;
+        if (Defer(_sh_tid, _sh_msg)) {
+            if (_profile != 0) {
+                _profile->Resume();
+            }
+            tag = L4_Wait(&_sh_tid);
+            continue;
+        }
 restore:
         err = IpcHandler(_sh_tid, _sh_msg);
         if (err != ERR_NONE) {
@@ -153,6 +339,9 @@ restore:
                          Name(), L4_Label(tag), _sh_tid.raw);
             break;
         }
+        if (_profile != 0) {
+            _profile->End(L4_Label(tag), start);
+        }
         L4_Load(&_sh_msg);
         tag = L4_ReplyWait(_sh_tid, &_sh_tid);
     }
@@ -160,37 +349,150 @@ exit:
     return err;
 }
 
+SessionServer::~SessionServer()
+{
+    if (_pool != 0) {
+        delete _pool;
+    }
+}
+
+stat_t
+SessionServer::StartWorkers(size_t count)
+{
+    stat_t  err;
+
+    if (_pool != 0) {
+        return ERR_EXIST;
+    }
+
+    _pool = new WorkerPool(this);
+    if (_pool == 0) {
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    err = _pool->Start(count);
+    if (err != ERR_NONE) {
+        delete _pool;
+        _pool = 0;
+    }
+    return err;
+}
+
+Bool
+SessionServer::Defer(const L4_ThreadId_t& tid, L4_Msg_t& msg)
+{
+    if (_pool == 0) {
+        return FALSE;
+    }
+
+    switch (L4_Label(L4_MsgTag(&msg))) {
+        case MSG_SESSION_BEGIN:
+        case MSG_SESSION_END:
+        case MSG_SESSION_GET:
+        case MSG_SESSION_PUT:
+        case MSG_SESSION_MAP:
+        case MSG_SESSION_SUBMIT:
+        case MSG_SESSION_GET_BATCH:
+        case MSG_SESSION_PUT_BATCH:
+            if (L4_UntypedWords(L4_MsgTag(&msg)) > 0) {
+                // The shared memory identifies the session.
+                _pool->Dispatch(tid, msg, L4_Get(&msg, 0));
+                return TRUE;
+            }
+            break;
+        default:
+            break;
+    }
+
+    // The rest may change the clients, so the workers must be idle.
+    _pool->Drain();
+    return FALSE;
+}
+
+void
+SessionServer::Propagate(L4_Msg_t* msg)
+{
+    if (_pool != 0) {
+        _pool->Propagate(msg);
+    }
+}
+
+void
+SessionServer::Insert(SessionClient* c, const L4_ThreadId_t& tid)
+{
+    size_t  i = Bucket(c->base);
+
+    c->thread = tid;
+    c->next = _clients[i];
+    _clients[i] = c;
+}
+
+void
+SessionServer::Remove(SessionClient* c)
+{
+    SessionClient** p = &_clients[Bucket(c->base)];
+
+    while (*p != 0) {
+        if (*p == c) {
+            *p = c->next;
+            c->next = 0;
+            return;
+        }
+        p = &(*p)->next;
+    }
+}
+
 SessionClient*
 SessionServer::Search(const L4_ThreadId_t& tid, addr_t base)
 {
-    L4_ThreadId_t   sid = FindSpace(tid);
-    Iterator<SessionClient*>& it = _clients.GetIterator();
-    while (it.HasNext()) {
-        SessionClient* c = it.Next();
-        if (L4_IsThreadEqual(c->tid, sid) && c->base == base) {
+    for (SessionClient* c = _clients[Bucket(base)]; c != 0; c = c->next) {
+        if (c->base != base) {
+            continue;
+        }
+
+        if (L4_IsThreadEqual(c->thread, tid)) {
+            return c;
+        }
+
+        // Another thread, maybe of another space.  Check its space.
+        if (L4_IsThreadEqual(c->tid, FindSpace(tid))) {
+            c->thread = tid;
             return c;
         }
+        return 0;
     }
     return 0;
 }
 
+size_t
+SessionServer::MaxShmPages()
+{
+    return Session::MAX_SHM_PAGES;
+}
+
 stat_t
 SessionServer::HandleConnect(const L4_ThreadId_t& tid, L4_Msg_t& msg)
 {
     ENTER;
     L4_Word_t   reg[2];
-    addr_t      shm = palloc(Session::DEFAULT_SHM_PAGES);
+    size_t      pages = Session::RequestedPages(&msg, MaxShmPages());
+    addr_t      shm;
+
+    // Grant a smaller window rather than refusing the client.
+    for (;;) {
+        shm = palloc_shm(pages, tid, L4_ReadWriteOnly);
+        if (shm != 0 || pages <= Session::DEFAULT_SHM_PAGES) {
+            break;
+        }
+        pages >>= 1;
+    }
 
     if (shm == 0) {
         return ERR_OUT_OF_MEMORY;
     }
 
-    for (UInt i = 0; i < Session::DEFAULT_SHM_PAGES; i++) {
-        Pager.Release(shm + i * PAGE_SIZE);
-        Pager.Reserve(shm + i * PAGE_SIZE, tid, L4_ReadWriteOnly);
-    }
     reg[0] = shm;
-    reg[1] = Session::DEFAULT_SHM_PAGES;
+    reg[1] = pages;
     L4_Put(&msg, 0, 2, reg, 0, 0);
     Register(tid, reg[0], reg[1]);
 
@@ -214,6 +516,32 @@ SessionServer::HandleDisconnect(const L4_ThreadId_t& tid, L4_Msg_t& msg)
     return ERR_NONE;
 }
 
+stat_t
+SessionServer::HandleBatch(const L4_ThreadId_t& tid, L4_Msg_t& msg)
+{
+    return RunBatch(tid, msg);
+}
+
+stat_t
+SessionServer::HandleSubmit(const L4_ThreadId_t& tid, L4_Msg_t& msg)
+{
+    SessionClient* c;
+
+    c = Search(tid, L4_Get(&msg, 0));
+    if (c == 0) {
+        Ipc::ReturnError(&msg, ERR_NOT_FOUND);
+        return ERR_NONE;
+    }
+    return RunRing(c, c->base, c->size * PAGE_SIZE, msg);
+}
+
+void
+SessionServer::ServeRequest(void* client, const IoRequest& req, addr_t buf,
+                            IoCompletion& cmp)
+{
+    HandleRequest(static_cast<SessionClient*>(client), req, buf, cmp);
+}
+
 SERVER_HANDLER_BEGIN(SessionServer)
 SERVER_HANDLER_CONNECT(MSG_SESSION_CONNECT, HandleConnect)
 SERVER_HANDLER_CONNECT(MSG_SESSION_DISCONNECT, HandleDisconnect)
@@ -221,6 +549,10 @@ SERVER_HANDLER_CONNECT(MSG_SESSION_BEGIN, HandleBegin)
 SERVER_HANDLER_CONNECT(MSG_SESSION_END, HandleEnd)
 SERVER_HANDLER_CONNECT(MSG_SESSION_PUT, HandlePut)
 SERVER_HANDLER_CONNECT(MSG_SESSION_GET, HandleGet)
+SERVER_HANDLER_CONNECT(MSG_SESSION_MAP, HandleMap)
+SERVER_HANDLER_CONNECT(MSG_SESSION_SUBMIT, HandleSubmit)
+SERVER_HANDLER_CONNECT(MSG_SESSION_GET_BATCH, HandleBatch)
+SERVER_HANDLER_CONNECT(MSG_SESSION_PUT_BATCH, HandleBatch)
 SERVER_HANDLER_END
 
 
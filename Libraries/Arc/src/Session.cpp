@@ -64,15 +64,16 @@ Session::Disconnect(L4_ThreadId_t tid, addr_t dest)
 }
 
 stat_t
-Session::Connect(L4_ThreadId_t peer, L4_Word_t* regs, size_t count)
+Session::Connect(L4_ThreadId_t peer, size_t pages, L4_Word_t* regs,
+                 size_t count)
 {
     ENTER;
     stat_t      err;
     L4_Msg_t    msg;
+    L4_Word_t   req = pages;
 
-    DOUT("establish a sesson with %.8lX\n", peer.raw);
-    L4_Clear(&msg);
-    L4_Set_Label(&msg, MSG_SESSION_CONNECT);
+    DOUT("establish a sesson with %.8lX (%u pages)\n", peer.raw, pages);
+    L4_Put(&msg, MSG_SESSION_CONNECT, 1, &req, 0, 0);
     err = Ipc::Call(peer, &msg, &msg);
     if (err != ERR_NONE) {
         return err;
@@ -88,24 +89,13 @@ Session::Connect(L4_ThreadId_t peer, L4_Word_t* regs, size_t count)
     }
 
     DOUT("shm: %.8lX\n", _shm);
-    // Map the given pages to this address space.
-    for (size_t i = 0; i < _size; i++) {
-        err = Pager.Map(_shm + i * PAGE_SIZE, L4_ReadWriteOnly,
-                        _dest + i * PAGE_SIZE, peer);
-        DOUT("%u\n", err);
-        if (err != ERR_NONE) {
-            for (size_t j = 0; j < i; j++) {
-                err = Pager.Release(_shm + j * PAGE_SIZE);
-                if (err != ERR_NONE) {
-                    //XXX: PANIC
-                    FATAL("page release");
-                }
-            }
-            Disconnect(peer, _dest);
-            pfree(_shm, _size);
-            _shm = 0;
-            return err;
-        }
+    // Map the whole window to this address space at once.
+    err = Pager.Map(_shm, L4_ReadWriteOnly, _dest, peer, _size);
+    if (err != ERR_NONE) {
+        Disconnect(peer, _dest);
+        pfree(_shm, _size);
+        _shm = 0;
+        return err;
     }
 
     _peer = peer;
@@ -137,23 +127,40 @@ Session::~Session()
     EXIT;
 }
 
+///
+/// Writes a request to the message registers directly: [_dest, regs...]
+///
+void
+Session::Load(L4_Word_t label, L4_Word_t* regs, size_t count)
+{
+    L4_MsgTag_t tag;
+
+    if (regs == 0) {
+        count = 0;
+    }
+    else if (count > MAX_REGISTERS - 1) {
+        count = MAX_REGISTERS - 1;
+    }
+
+    tag.raw = 0;
+    tag.X.label = label;
+    tag.X.u = count + 1;
+    L4_LoadMR(0, tag.raw);
+    L4_LoadMR(1, _dest);
+    L4_LoadMRs(2, count, regs);
+}
+
 stat_t
 Session::Xfer(L4_Word_t label, L4_Word_t* regs, size_t count)
 {
-    L4_Msg_t msg;
+    L4_MsgTag_t tag;
 
-    L4_Clear(&msg);
-    L4_Set_Label(&msg, label);
-    L4_Append(&msg, _dest);
-    if (regs != 0) {
-        if (count > MAX_REGISTERS - 1) {
-            count = MAX_REGISTERS - 1;
-        }
-        for (size_t i = 0; i < count; i++) {
-            L4_Append(&msg, regs[i]);
-        }
+    Load(label, regs, count);
+    tag = L4_Call(_peer);
+    if (L4_IpcFailed(tag)) {
+        return Ipc::ErrorCode();
     }
-    return Ipc::Call(_peer, &msg, &msg);
+    return static_cast<stat_t>(L4_Label(tag));
 }
 
 ///
@@ -166,13 +173,84 @@ Session::Xfer(L4_Word_t label, L4_Word_t* regs, size_t count)
 stat_t
 Session::Xfer(L4_Word_t label, L4_Word_t* sregs, size_t scount,
               L4_Word_t* rregs, size_t rcount)
+{
+    L4_MsgTag_t tag;
+
+    Load(label, sregs, scount);
+    tag = L4_Call(_peer);
+    if (L4_IpcFailed(tag)) {
+        return Ipc::ErrorCode();
+    }
+    if (L4_Label(tag) != ERR_NONE) {
+        return static_cast<stat_t>(L4_Label(tag));
+    }
+
+    if (rregs != 0) {
+        // The first word of the reply is not used.
+        size_t len = L4_UntypedWords(tag);
+        if (len < rcount + 1) {
+            rcount = len > 0 ? len - 1 : 0;
+        }
+        L4_StoreMRs(2, rcount, rregs);
+    }
+    return ERR_NONE;
+}
+
+///
+/// @param label    the message label
+/// @param entries  the sending registers of the entries
+/// @param count    the count of entries
+/// @param width    the count of registers per entry
+/// @param results  the status and the result of each entry
+///
+stat_t
+Session::XferBatch(L4_Word_t label, L4_Word_t* entries, size_t count,
+                   size_t width, L4_Word_t* results)
 {
     L4_Msg_t    msg;
     stat_t      err;
 
+    if (width == 0 || count == 0 || MaxBatch(width) < count) {
+        return ERR_INVALID_ARGUMENTS;
+    }
+
     L4_Clear(&msg);
     L4_Set_Label(&msg, label);
     L4_Append(&msg, _dest);
+    L4_Append(&msg, static_cast<L4_Word_t>(count));
+    L4_Append(&msg, static_cast<L4_Word_t>(width));
+    for (size_t i = 0; i < count * width; i++) {
+        L4_Append(&msg, entries[i]);
+    }
+
+    err = Ipc::Call(_peer, &msg, &msg);
+    if (err != ERR_NONE) {
+        return err;
+    }
+
+    if (L4_UntypedWords(msg.tag) != 2 * count) {
+        return ERR_UNKNOWN;
+    }
+    if (results != 0) {
+        for (size_t i = 0; i < 2 * count; i++) {
+            results[i] = L4_Get(&msg, i);
+        }
+    }
+    return ERR_NONE;
+}
+
+stat_t
+Session::Receive(addr_t dest, L4_Word_t* sregs, size_t scount,
+                 L4_Word_t* rregs, size_t rcount)
+{
+    L4_Msg_t    msg;
+    addr_t      src;
+    size_t      pages;
+    stat_t      err;
+
+    L4_Clear(&msg);
+    L4_Set_Label(&msg, MSG_SESSION_MAP);
+    L4_Append(&msg, _dest);
     if (sregs != 0) {
         if (scount > MAX_REGISTERS - 1) {
             scount = MAX_REGISTERS - 1;
@@ -186,16 +264,26 @@ Session::Xfer(L4_Word_t label, L4_Word_t* sregs, size_t scount,
         return err;
     }
 
+    if (L4_UntypedWords(msg.tag) < 2) {
+        return ERR_INVALID_ARGUMENTS;
+    }
+    src = L4_Get(&msg, 0);
+    pages = L4_Get(&msg, 1);
+
     if (rregs != 0) {
-        size_t len = L4_UntypedWords(msg.tag);
+        size_t len = L4_UntypedWords(msg.tag) - 2;
         if (len < rcount) {
             rcount = len;
         }
         for (size_t i = 0; i < rcount; i++) {
-            rregs[i] = L4_Get(&msg, i + 1);
+            rregs[i] = L4_Get(&msg, i + 2);
         }
     }
-    return ERR_NONE;
+
+    if (pages == 0) {
+        return ERR_NONE;
+    }
+    return Pager.Move(dest, L4_ReadWriteOnly, src, _peer, pages);
 }
 
 stat_t
@@ -215,3 +303,38 @@ Session::PutAsync(L4_Word_t* regs, size_t count)
     return Ipc::Send(_peer, &msg);
 }
 
+
+stat_t
+Session::Submit()
+{
+    L4_Msg_t msg;
+
+    L4_Put(&msg, MSG_SESSION_SUBMIT, 1, &_dest, 0, 0);
+    return Ipc::Send(_peer, &msg);
+}
+
+stat_t
+Session::Wait(SessionRing* ring, IoCompletion* cmp)
+{
+    L4_Msg_t    msg;
+    stat_t      err;
+
+    while (!ring->Reap(cmp)) {
+        if (!ring->IsBusy()) {
+            return ERR_NOT_FOUND;
+        }
+        if (!ring->PrepareWait()) {
+            continue;
+        }
+
+        // Ring the peer and block for its reply in a single IPC, so that
+        // the wake cannot be missed however late it comes.  The peer takes
+        // the flag down when it replies.
+        L4_Put(&msg, MSG_SESSION_SUBMIT, 1, &_dest, 0, 0);
+        err = Ipc::Call(_peer, &msg, &msg);
+        if (err != ERR_NONE) {
+            return err;
+        }
+    }
+    return ERR_NONE;
+}
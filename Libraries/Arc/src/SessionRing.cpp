@@ -0,0 +1,192 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @brief  Submission and completion rings in the shared memory of a session
+/// @file   Libraries/Arc/src/SessionRing.cpp
+/// @since  October 2008
+///
+
+#include <SessionRing.h>
+#include <Types.h>
+#include <sys/Config.h>
+
+size_t
+SessionRing::DataOffset(UInt entries)
+{
+    size_t len = sizeof(Header) + sizeof(IoRequest) * entries +
+                 sizeof(IoCompletion) * entries;
+    // Keep the data area aligned to the sector size of the disks
+    return (len + 511) & ~511UL;
+}
+
+stat_t
+SessionRing::Format(addr_t base, size_t size, UInt entries)
+{
+    if (entries == 0 || (entries & (entries - 1)) != 0 ||
+        size <= DataOffset(entries)) {
+        return ERR_INVALID_ARGUMENTS;
+    }
+
+    _hdr = reinterpret_cast<Header*>(base);
+    _sq = reinterpret_cast<IoRequest*>(base + sizeof(Header));
+    _cq = reinterpret_cast<IoCompletion*>(_sq + entries);
+    _entries = entries;
+    _size = size;
+
+    _hdr->entries = entries;
+    _hdr->sq_head = 0;
+    _hdr->sq_tail = 0;
+    _hdr->cq_head = 0;
+    _hdr->cq_tail = 0;
+    _hdr->data = DataOffset(entries);
+    _hdr->waiting = 0;
+    Barrier();
+    _hdr->magic = MAGIC;
+
+    return ERR_NONE;
+}
+
+stat_t
+SessionRing::Attach(addr_t base, size_t size)
+{
+    Header* hdr = reinterpret_cast<Header*>(base);
+    UInt    entries = hdr->entries;
+
+    // The count comes from the client.  Bound it by the window before
+    // DataOffset() can overflow.
+    if (hdr->magic != MAGIC || entries == 0 ||
+        (entries & (entries - 1)) != 0 ||
+        size / (sizeof(IoRequest) + sizeof(IoCompletion)) < entries ||
+        size <= DataOffset(entries)) {
+        _hdr = 0;
+        return ERR_INVALID_ARGUMENTS;
+    }
+
+    _hdr = hdr;
+    _sq = reinterpret_cast<IoRequest*>(base + sizeof(Header));
+    _cq = reinterpret_cast<IoCompletion*>(_sq + entries);
+    _entries = entries;
+    _size = size;
+
+    return ERR_NONE;
+}
+
+Bool
+SessionRing::Submit(const IoRequest& req)
+{
+    UInt tail = _hdr->sq_tail;
+
+    if (tail - _hdr->sq_head >= _entries) {
+        return FALSE;
+    }
+
+    _sq[tail & (_entries - 1)] = req;
+    // Publish the entry before the index
+    Barrier();
+    _hdr->sq_tail = tail + 1;
+    return TRUE;
+}
+
+Bool
+SessionRing::Reap(IoCompletion* cmp)
+{
+    UInt head = _hdr->cq_head;
+
+    if (head == _hdr->cq_tail) {
+        return FALSE;
+    }
+
+    Barrier();
+    *cmp = _cq[head & (_entries - 1)];
+    Barrier();
+    _hdr->cq_head = head + 1;
+    return TRUE;
+}
+
+Bool
+SessionRing::Fetch(IoRequest* req)
+{
+    UInt head = _hdr->sq_head;
+    UInt tail = _hdr->sq_tail;
+
+    // A broken index from the client is treated as an empty ring.
+    if (head == tail || tail - head > _entries) {
+        return FALSE;
+    }
+
+    // Keep the count of requests in flight within the completion ring
+    if (_hdr->cq_tail - _hdr->cq_head >= _entries) {
+        return FALSE;
+    }
+
+    Barrier();
+    *req = _sq[head & (_entries - 1)];
+    Barrier();
+    _hdr->sq_head = head + 1;
+    return TRUE;
+}
+
+Bool
+SessionRing::Post(const IoCompletion& cmp)
+{
+    UInt tail = _hdr->cq_tail;
+    Bool empty = (tail == _hdr->cq_head);
+
+    _cq[tail & (_entries - 1)] = cmp;
+    Barrier();
+    _hdr->cq_tail = tail + 1;
+    return empty;
+}
+
+Bool
+SessionRing::PrepareWait()
+{
+    _hdr->waiting = 1;
+    // The flag before the index.  Pairs with the fence in TakeWaiter().
+    Fence();
+    if (_hdr->cq_head == _hdr->cq_tail) {
+        return TRUE;
+    }
+
+    // A completion has been posted in the meantime.
+    _hdr->waiting = 0;
+    return FALSE;
+}
+
+addr_t
+SessionRing::Buffer(L4_Word_t data, L4_Word_t length) const
+{
+    size_t  size = DataSize();
+
+    if (size < length || size - length < data) {
+        return 0;
+    }
+    return DataArea() + data;
+}
@@ -0,0 +1,310 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @brief  Lock-free rings of fixed-size items in the shared memory
+/// @file   Libraries/Arc/src/SharedRing.cpp
+/// @since  October 2008
+///
+
+#include <Ipc.h>
+#include <SharedRing.h>
+#include <String.h>
+#include <Types.h>
+#include <sys/Config.h>
+#include <l4/ipc.h>
+#include <l4/message.h>
+#include <l4/schedule.h>
+#include <l4/types.h>
+
+UInt
+SharedRing::Stride(size_t item_size, Bool multi)
+{
+    if (multi) {
+        item_size += sizeof(UInt);
+    }
+    return (item_size + sizeof(UInt) - 1) & ~(sizeof(UInt) - 1);
+}
+
+stat_t
+SharedRing::Format(addr_t base, size_t size, size_t item_size, Bool multi)
+{
+    UInt    stride = Stride(item_size, multi);
+    UInt    entries;
+
+    if (item_size == 0 || size < sizeof(Header) + stride) {
+        return ERR_INVALID_ARGUMENTS;
+    }
+
+    entries = 1;
+    while (sizeof(Header) + entries * 2 * stride <= size) {
+        entries *= 2;
+    }
+
+    _hdr = reinterpret_cast<Header*>(base);
+    _data = base + sizeof(Header);
+    _entries = entries;
+    _item_size = item_size;
+    _stride = stride;
+    _multi = multi;
+
+    _hdr->flags = multi ? MULTI_PRODUCER : 0;
+    _hdr->entries = entries;
+    _hdr->item_size = item_size;
+    _hdr->stride = stride;
+    _hdr->data = sizeof(Header);
+    _hdr->head = 0;
+    _hdr->consumer_sleeping = 0;
+    _hdr->tail = 0;
+    _hdr->producer_sleeping = 0;
+
+    if (multi) {
+        // The slot i is free for the producer of the index i.
+        for (UInt i = 0; i < entries; i++) {
+            *Sequence(i) = i;
+        }
+    }
+
+    Barrier();
+    _hdr->magic = MAGIC;
+    return ERR_NONE;
+}
+
+stat_t
+SharedRing::Attach(addr_t base, size_t size, size_t item_size)
+{
+    Header* hdr = reinterpret_cast<Header*>(base);
+    UInt    entries = hdr->entries;
+    UInt    stride = hdr->stride;
+    UInt    data = hdr->data;
+    Bool    multi = (hdr->flags & MULTI_PRODUCER) != 0;
+
+    // The peer must not choose how much Get() copies to the caller.  The
+    // item size of the caller bounds the stride before the division.
+    if (hdr->magic != MAGIC || item_size == 0 ||
+        hdr->item_size != item_size || stride == 0 || stride < item_size ||
+        stride < Stride(item_size, multi) || entries == 0 ||
+        (entries & (entries - 1)) != 0 || data < sizeof(Header) ||
+        data > size || (size - data) / stride < entries) {
+        _hdr = 0;
+        return ERR_INVALID_ARGUMENTS;
+    }
+
+    _hdr = hdr;
+    _data = base + data;
+    _entries = entries;
+    _item_size = item_size;
+    _stride = stride;
+    _multi = multi;
+    return ERR_NONE;
+}
+
+Bool
+SharedRing::PutSingle(const void* item)
+{
+    UInt tail = _hdr->tail;
+
+    if (tail - _hdr->head >= _entries) {
+        return FALSE;
+    }
+
+    memcpy(reinterpret_cast<void*>(Item(tail)), item, _item_size);
+    // Publish the item before the index
+    Barrier();
+    _hdr->tail = tail + 1;
+    return TRUE;
+}
+
+Bool
+SharedRing::PutMulti(const void* item)
+{
+    UInt    tail = _hdr->tail;
+    Int     diff;
+
+    for (;;) {
+        diff = static_cast<Int>(*Sequence(tail) - tail);
+        if (diff == 0) {
+            // The slot is free.  Reserve it against the other producers.
+            UInt cur = CompareAndSwap(&_hdr->tail, tail, tail + 1);
+            if (cur == tail) {
+                break;
+            }
+            tail = cur;
+        }
+        else if (diff < 0) {
+            // The consumer has not taken the item of the last round.
+            return FALSE;
+        }
+        else {
+            // Another producer has taken the slot.
+            tail = _hdr->tail;
+        }
+    }
+
+    memcpy(reinterpret_cast<void*>(Item(tail)), item, _item_size);
+    Barrier();
+    *Sequence(tail) = tail + 1;
+    return TRUE;
+}
+
+Bool
+SharedRing::Get(void* item)
+{
+    UInt head = _hdr->head;
+
+    if (_multi) {
+        // The item is complete when its producer has bumped the sequence.
+        if (*Sequence(head) != head + 1) {
+            return FALSE;
+        }
+    }
+    else {
+        UInt tail = _hdr->tail;
+
+        // A broken index from the peer is treated as an empty ring.
+        if (head == tail || tail - head > _entries) {
+            return FALSE;
+        }
+    }
+
+    Barrier();
+    memcpy(item, reinterpret_cast<const void*>(Item(head)), _item_size);
+    Barrier();
+    if (_multi) {
+        // Free the slot for the producer of the next round
+        *Sequence(head) = head + _entries;
+    }
+    _hdr->head = head + 1;
+    return TRUE;
+}
+
+Bool
+SharedRing::IsEmpty() const
+{
+    UInt head = _hdr->head;
+
+    if (_multi) {
+        return *Sequence(head) != head + 1;
+    }
+    return head == _hdr->tail;
+}
+
+Bool
+SharedRing::PrepareSleep(Side side)
+{
+    volatile UInt*  flag = Flag(side);
+
+    if (side == PRODUCER && _multi) {
+        return FALSE;
+    }
+
+    *flag = 1;
+    // The flag before the indices.  Pairs with the fence in TakeSleeper().
+    Fence();
+    if (side == CONSUMER ? IsEmpty() : IsFull()) {
+        return TRUE;
+    }
+
+    // The peer may have taken the flag down already.  Then its wake is on
+    // the way and has to be received.
+    return Exchange(flag, 0) == 0;
+}
+
+stat_t
+SharedRing::Sleep(L4_ThreadId_t peer)
+{
+    L4_MsgTag_t tag;
+
+    if (L4_IsNilThread(peer)) {
+        peer = L4_anythread;
+    }
+
+    // A wake is lost if the sender times out before we receive.  Poll the
+    // ring in that case.
+    tag = L4_Receive_Timeout(peer, L4_TimePeriod(POLL_INTERVAL));
+    if (L4_IpcFailed(tag)) {
+        stat_t err = Ipc::ErrorCode();
+        if (err != ERR_IPC_TIMEOUT && err != ERR_IPC_TIMEOUT_RECV) {
+            return err;
+        }
+    }
+    return ERR_NONE;
+}
+
+void
+SharedRing::Wake(L4_ThreadId_t tid)
+{
+    L4_Msg_t msg;
+    L4_Put(&msg, MSG_SESSION_WAKE, 0, 0, 0, 0);
+    L4_Load(&msg);
+    L4_Send_Timeout(tid, L4_TimePeriod(WAKE_TIMEOUT));
+}
+
+stat_t
+SharedRing::Push(const void* item, L4_ThreadId_t consumer)
+{
+    stat_t  err;
+
+    while (!Put(item)) {
+        if (_multi) {
+            L4_Sleep(L4_TimePeriod(POLL_INTERVAL));
+        }
+        else if (PrepareSleep(PRODUCER)) {
+            err = Sleep(consumer);
+            if (err != ERR_NONE) {
+                return err;
+            }
+        }
+    }
+
+    if (TakeSleeper(CONSUMER)) {
+        Wake(consumer);
+    }
+    return ERR_NONE;
+}
+
+stat_t
+SharedRing::Pop(void* item, L4_ThreadId_t producer)
+{
+    stat_t  err;
+
+    while (!Get(item)) {
+        if (PrepareSleep(CONSUMER)) {
+            err = Sleep(producer);
+            if (err != ERR_NONE) {
+                return err;
+            }
+        }
+    }
+
+    if (!_multi && !L4_IsNilThread(producer) && TakeSleeper(PRODUCER)) {
+        Wake(producer);
+    }
+    return ERR_NONE;
+}
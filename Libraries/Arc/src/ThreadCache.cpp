@@ -0,0 +1,248 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @brief  Cache of parked threads of a task
+/// @file   Libraries/Arc/src/ThreadCache.cpp
+/// @since  October 2008
+///
+
+//#define SYS_DEBUG
+//#define SYS_DEBUG_CALL
+
+#include <Debug.h>
+#include <Ipc.h>
+#include <PageAllocator.h>
+#include <System.h>
+#include <ThreadCache.h>
+#include <Types.h>
+#include <sys/Config.h>
+#include <l4/ipc.h>
+#include <l4/message.h>
+#include <l4/schedule.h>
+#include <l4/thread.h>
+#include <l4/types.h>
+
+Mutex                   ThreadCache::_lock;
+ThreadCache::Parked     ThreadCache::_parked[ThreadCache::CAPACITY];
+size_t                  ThreadCache::_count = 0;
+size_t                  ThreadCache::_reserved = 0;
+
+void
+ThreadCache::Insert(L4_ThreadId_t tid, addr_t stack)
+{
+    _lock.Lock();
+    _parked[_count].tid = tid;
+    _parked[_count].stack = stack;
+    _count++;
+    _reserved--;
+    _lock.Unlock();
+}
+
+///
+/// The entry point of a cached thread.  The stack is set up by Create().
+///
+void
+ThreadCache::Loop(addr_t stack, Bool cached)
+{
+    L4_ThreadId_t   me = L4_Myself();
+    L4_MsgTag_t     tag;
+    L4_Word_t       entry;
+    L4_Word_t       arg;
+
+    for (;;) {
+        if (cached) {
+            // Start() may come before the receive below, and blocks until
+            // then.
+            Insert(me, stack);
+        }
+
+        do {
+            tag = L4_Receive(L4_anylocalthread);
+        } while (L4_IpcFailed(tag) || L4_Label(tag) != START_LABEL);
+
+        L4_StoreMR(1, &entry);
+        L4_StoreMR(2, &arg);
+        cached = reinterpret_cast<Entry>(entry)(arg);
+        if (!cached) {
+            // The owner of the work deletes the thread.
+            L4_Sleep(L4_Never);
+        }
+    }
+}
+
+stat_t
+ThreadCache::Create(L4_ThreadId_t* tid, addr_t* stack, Bool cached)
+{
+    ThreadStartRequest  req;
+    L4_Msg_t            msg;
+    L4_Word_t*          sp;
+    addr_t              base;
+    stat_t              err;
+
+    ENTER;
+
+    L4_Put(&msg, MSG_ROOT_NEW_TH, 0, 0, 0, 0);
+    err = Ipc::Call(L4_Pager(), &msg, &msg);
+    if (err != ERR_NONE) {
+        return err;
+    }
+    tid->raw = L4_Get(&msg, 0);
+
+    base = palloc(STACK_SIZE / PAGE_SIZE);
+    if (base == 0) {
+        Destroy(*tid, 0, 0);
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    // Fault the stack in here so that the thread never faults on it.
+    for (size_t i = 0; i < STACK_SIZE / PAGE_SIZE; i++) {
+        *reinterpret_cast<volatile L4_Word_t*>(base + i * PAGE_SIZE) = 0;
+    }
+
+    // The arguments of Loop() above an empty return address
+    sp = reinterpret_cast<L4_Word_t*>(base + STACK_SIZE) - 3;
+    sp[0] = 0;
+    sp[1] = base;
+    sp[2] = cached;
+
+    req.tid = *tid;
+    req.ip = reinterpret_cast<L4_Word_t>(Loop);
+    req.sp = reinterpret_cast<L4_Word_t>(sp);
+    err = Ipc::Call<ThreadStartMessage>(L4_Pager(), req);
+    if (err != ERR_NONE) {
+        Destroy(*tid, base, STACK_SIZE / PAGE_SIZE);
+        return err;
+    }
+
+    *stack = base;
+    EXIT;
+    return ERR_NONE;
+}
+
+void
+ThreadCache::Destroy(L4_ThreadId_t tid, addr_t stack, size_t pages)
+{
+    L4_Msg_t    msg;
+    L4_Word_t   reg[2];
+
+    reg[0] = tid.raw;
+    reg[1] = L4_Myself().raw;
+    L4_Put(&msg, MSG_ROOT_DEL_TH, 2, reg, 0, 0);
+    if (Ipc::Call(L4_Pager(), &msg, &msg) != ERR_NONE) {
+        System.Print(System.ERROR, "thread deletion failed\n");
+        // The thread may still use the stack.
+        return;
+    }
+
+    if (stack != 0) {
+        pfree(stack, pages);
+    }
+}
+
+stat_t
+ThreadCache::Prefill(size_t count)
+{
+    L4_ThreadId_t   tid;
+    addr_t          stack;
+    stat_t          err;
+
+    for (size_t i = 0; i < count; i++) {
+        if (!Reserve()) {
+            break;
+        }
+
+        err = Create(&tid, &stack, TRUE);
+        if (err != ERR_NONE) {
+            _lock.Lock();
+            _reserved--;
+            _lock.Unlock();
+            return err;
+        }
+    }
+    return ERR_NONE;
+}
+
+Bool
+ThreadCache::Acquire(L4_ThreadId_t* tid, addr_t* stack)
+{
+    Bool    found = FALSE;
+
+    _lock.Lock();
+    if (_count > 0) {
+        _count--;
+        *tid = _parked[_count].tid;
+        *stack = _parked[_count].stack;
+        found = TRUE;
+    }
+    _lock.Unlock();
+    return found;
+}
+
+Bool
+ThreadCache::Release(L4_ThreadId_t tid, addr_t stack)
+{
+    Bool    kept = FALSE;
+
+    _lock.Lock();
+    if (_count + _reserved < CAPACITY) {
+        _parked[_count].tid = tid;
+        _parked[_count].stack = stack;
+        _count++;
+        kept = TRUE;
+    }
+    _lock.Unlock();
+    return kept;
+}
+
+Bool
+ThreadCache::Reserve()
+{
+    Bool    reserved = FALSE;
+
+    _lock.Lock();
+    if (_count + _reserved < CAPACITY) {
+        _reserved++;
+        reserved = TRUE;
+    }
+    _lock.Unlock();
+    return reserved;
+}
+
+stat_t
+ThreadCache::Start(L4_ThreadId_t tid, Entry entry, L4_Word_t arg)
+{
+    L4_Msg_t    msg;
+    L4_Word_t   reg[2];
+
+    reg[0] = reinterpret_cast<L4_Word_t>(entry);
+    reg[1] = arg;
+    L4_Put(&msg, START_LABEL, 2, reg, 0, 0);
+    return Ipc::Send(tid, &msg);
+}
@@ -0,0 +1,197 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @brief  Worker threads of a server
+/// @file   Libraries/Arc/src/WorkerPool.cpp
+/// @since  October 2008
+///
+
+#include <Debug.h>
+#include <Ipc.h>
+#include <Server.h>
+#include <System.h>
+#include <Types.h>
+#include <WorkerPool.h>
+#include <l4/ipc.h>
+#include <l4/thread.h>
+
+void
+ServerWorker::Push(const L4_ThreadId_t& tid, const L4_Msg_t& msg, ULong stamp)
+{
+    Job*    job;
+
+    _slots.Down();
+
+    job = &_queue[_tail % QUEUE_LENGTH];
+    job->tid = tid;
+    job->msg = msg;
+    job->stamp = stamp;
+    _tail++;
+
+    _jobs.Up();
+}
+
+void
+ServerWorker::Drain()
+{
+    // The worker gives a slot back after it processes the job, so all the
+    // slots are free only when the queue is done.
+    for (size_t i = 0; i < QUEUE_LENGTH; i++) {
+        _slots.Down();
+    }
+    for (size_t i = 0; i < QUEUE_LENGTH; i++) {
+        _slots.Up();
+    }
+}
+
+void
+ServerWorker::Run()
+{
+    Job*    job;
+
+    for (;;) {
+        _jobs.Down();
+
+        // The slot is not reused until it is given back.
+        job = &_queue[_head % QUEUE_LENGTH];
+        _pool->Handle(job->tid, job->msg, job->stamp);
+        _head++;
+
+        _slots.Up();
+    }
+}
+
+WorkerPool::WorkerPool(BasicServer* server)
+    : _server(server), _dispatcher(L4_nilthread), _count(0)
+{
+    for (size_t i = 0; i < MAX_WORKERS; i++) {
+        _workers[i] = 0;
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    for (size_t i = 0; i < _count; i++) {
+        delete _workers[i];
+    }
+}
+
+stat_t
+WorkerPool::Start(size_t count)
+{
+    stat_t  err;
+
+    ENTER;
+
+    if (count == 0 || MAX_WORKERS < count || _count != 0) {
+        return ERR_INVALID_ARGUMENTS;
+    }
+
+    _dispatcher = L4_Myself();
+
+    for (size_t i = 0; i < count; i++) {
+        _workers[i] = new ServerWorker(this);
+        if (_workers[i] == 0) {
+            return ERR_OUT_OF_MEMORY;
+        }
+
+        err = _workers[i]->Start();
+        if (err != ERR_NONE) {
+            delete _workers[i];
+            _workers[i] = 0;
+            return err;
+        }
+        _count++;
+    }
+
+    EXIT;
+    return ERR_NONE;
+}
+
+void
+WorkerPool::Dispatch(const L4_ThreadId_t& tid, const L4_Msg_t& msg,
+                     L4_Word_t key)
+{
+    IpcProfile* profile = _server->_profile;
+    ULong       stamp = 0;
+
+    if (profile != 0 && profile->IsEnabled()) {
+        stamp = IpcProfile::Now();
+    }
+    _workers[(key >> PAGE_BITS) % _count]->Push(tid, msg, stamp);
+}
+
+void
+WorkerPool::Drain()
+{
+    for (size_t i = 0; i < _count; i++) {
+        _workers[i]->Drain();
+    }
+}
+
+void
+WorkerPool::Handle(const L4_ThreadId_t& tid, L4_Msg_t& msg, ULong stamp)
+{
+    L4_Word_t   label = L4_Label(L4_MsgTag(&msg));
+    IpcProfile* profile = _server->_profile;
+    ULong       start = 0;
+    stat_t      err;
+
+    if (stamp != 0 && profile != 0) {
+        start = IpcProfile::Now();
+    }
+
+    err = _server->IpcHandler(tid, msg);
+    if (err != ERR_NONE) {
+        // The single-threaded loop stops here.  A worker keeps serving
+        // the other clients and returns the error instead.
+        System.Print(System.WARN,
+                     "%s: Error processing message %lx from %.8lX\n",
+                     _server->Name(), label, tid.raw);
+        Ipc::ReturnError(&msg, err);
+    }
+
+    if (start != 0) {
+        profile->Record(label, IpcProfile::Now() - start, start - stamp);
+    }
+
+    Propagate(&msg);
+    L4_Load(&msg);
+    L4_Send_Timeout(tid, L4_ZeroTime);
+}
+
+void
+WorkerPool::Propagate(L4_Msg_t* msg)
+{
+    if (!L4_IsThreadEqual(L4_Myself(), _dispatcher)) {
+        L4_Set_Propagation(&msg->tag);
+        L4_Set_VirtualSender(_dispatcher);
+    }
+}
@@ -230,6 +230,11 @@ public:
 
     PartitionType Type() const { return _type; }
 
+    ///
+    /// Obtains the size of the volume in sectors.
+    ///
+    UInt SectorCount() const { return _sectorCount; }
+
     friend class Disk;
 };
 
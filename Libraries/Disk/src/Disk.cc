@@ -178,18 +178,34 @@ Disk::Read(void *buffer, UInt sector, size_t seccnt)
 stat_t
 Disk::Write(const void *buffer, UInt sector, size_t count)
 {
-    stat_t        err;
+    size_t      sec_per_shm;    // in sectors
+    size_t      n;              // in sectors
+    const char* ptr;
+    stat_t      err;
     ENTER;
 
-    memcpy(reinterpret_cast<void*>(_address), buffer, count);
+    ptr = reinterpret_cast<const char*>(buffer);
+    sec_per_shm = _session->Size() / SECTOR_SIZE;
 
-    L4_Word_t reg[3];
-    reg[0] = (_iface << 16) | _dev;
-    reg[1] = sector;
-    reg[2] = count;
-    err = _session->Put(reg, 3);
-    if (err != ERR_NONE) {
-        return err;
+    // The count is in sectors.  Write through the shared memory piece by
+    // piece.
+    while (0 < count) {
+        n = count < sec_per_shm ? count : sec_per_shm;
+        memcpy(reinterpret_cast<void*>(_session->GetBaseAddress()), ptr,
+               n * SECTOR_SIZE);
+
+        L4_Word_t reg[3];
+        reg[0] = (_iface << 16) | _dev;
+        reg[1] = sector;
+        reg[2] = n;
+        err = _session->Put(reg, 3);
+        if (err != ERR_NONE) {
+            return err;
+        }
+
+        ptr += n * SECTOR_SIZE;
+        sector += n;
+        count -= n;
     }
 
     EXIT;
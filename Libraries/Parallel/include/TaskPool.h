@@ -0,0 +1,298 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @brief  Work-stealing task runtime
+/// @file   Libraries/Parallel/include/TaskPool.h
+/// @since  October 2008
+///
+
+#ifndef ARC_TASK_POOL_H
+#define ARC_TASK_POOL_H
+
+#include <Mutex.h>
+#include <Semaphore.h>
+#include <Thread.h>
+#include <Types.h>
+#include <sys/Config.h>
+#include <l4/types.h>
+
+class TaskGroup;
+class TaskPool;
+
+///
+/// A piece of work run by the pool.  The object belongs to the caller of
+/// Spawn() and must stay alive until the group is synchronized.
+///
+class Task
+{
+    friend class TaskPool;
+
+private:
+    TaskGroup*          _group;
+
+public:
+    Task() : _group(0) {}
+
+    virtual ~Task() {}
+
+    virtual void Run() = 0;
+};
+
+///
+/// Counts the spawned tasks that have not finished yet
+///
+class TaskGroup
+{
+    friend class TaskPool;
+
+private:
+    volatile Int        _pending;
+
+public:
+    TaskGroup() : _pending(0) {}
+
+    Bool IsDone() const { return _pending == 0; }
+};
+
+///
+/// The body of a parallel loop.  Run() is called with disjoint ranges of
+/// the iteration space from many threads at a time.
+///
+class RangeBody
+{
+public:
+    virtual ~RangeBody() {}
+
+    virtual void Run(size_t begin, size_t end) = 0;
+};
+
+///
+/// A double-ended queue of tasks.  The owner pushes and pops at the
+/// bottom, the others steal from the top.  Only a steal and the pop of the
+/// last task take an atomic operation.
+///
+class TaskDeque
+{
+public:
+    static const Int    SIZE = 256;
+
+private:
+    static const size_t CACHE_LINE = 64;
+
+    Task* volatile      _slots[SIZE];
+
+    ///
+    /// Advanced by the thieves
+    ///
+    volatile Int        _top;
+    UByte               _pad[CACHE_LINE - sizeof(Int)];
+
+    ///
+    /// Advanced by the owner
+    ///
+    volatile Int        _bottom;
+
+public:
+    TaskDeque() : _top(0), _bottom(0) {}
+
+    ///
+    /// Pushes a task.  Returns FALSE if the deque is full.
+    ///
+    Bool Push(Task* task);
+
+    ///
+    /// Pops the task pushed last, or returns 0 if there is none.
+    ///
+    Task* Pop();
+
+    ///
+    /// Takes the task pushed first, or returns 0 if there is none or
+    /// another thread has taken it.
+    ///
+    Task* Steal();
+
+    Bool IsEmpty() const { return _bottom <= _top; }
+};
+
+///
+/// A thread of the pool.  It runs the tasks in its deque, steals from the
+/// others when it runs out, and sleeps when no deque has any.
+///
+class TaskWorker : public Thread<4 * PAGE_SIZE>
+{
+private:
+    TaskPool*           _pool;
+
+    size_t              _index;
+
+    TaskWorker();
+
+public:
+    TaskWorker(TaskPool* pool, size_t index)
+        : Thread<4 * PAGE_SIZE>(), _pool(pool), _index(index) {}
+
+    virtual ~TaskWorker() {}
+
+    void Run();
+};
+
+///
+/// A fixed set of workers that run tasks.  A task spawned by a worker goes
+/// to the deque of the worker; a task spawned by any other thread goes to
+/// the shared deque, which its owners use under a lock.  A thread waiting
+/// for a group runs the tasks instead of blocking.
+///
+class TaskPool
+{
+    friend class TaskWorker;
+
+public:
+    static const size_t MAX_WORKERS = 8;
+
+private:
+    TaskWorker*         _workers[MAX_WORKERS];
+
+    TaskDeque           _deques[MAX_WORKERS];
+
+    ///
+    /// The deque of the threads outside of the pool
+    ///
+    TaskDeque           _shared;
+
+    Mutex               _shared_lock;
+
+    size_t              _count;
+
+    ///
+    /// The count of the workers going to sleep.  A spawner takes one down
+    /// and wakes a worker with the semaphore.
+    ///
+    volatile Int        _sleepers;
+
+    Semaphore           _idle;
+
+    volatile Bool       _stopping;
+
+    static TaskPool*    _default;
+
+    ///
+    /// Obtains the index of the worker of the calling thread, or
+    /// MAX_WORKERS if it is not a worker.
+    ///
+    size_t Self() const;
+
+    ///
+    /// Finds a task for the thread: its own deque first, then the others.
+    ///
+    Task* Find(size_t self);
+
+    void Execute(Task* task);
+
+    Bool HasWork() const;
+
+    ///
+    /// Blocks the worker until a task is spawned
+    ///
+    void Sleep();
+
+    void Wake();
+
+public:
+    TaskPool();
+
+    virtual ~TaskPool();
+
+    ///
+    /// Creates the workers.  The first pool started becomes the default
+    /// one.
+    ///
+    /// @param count    the number of the workers
+    ///
+    stat_t Start(size_t count);
+
+    ///
+    /// Stops and deletes the workers.  The groups must be synchronized.
+    ///
+    void Stop();
+
+    ///
+    /// Queues a task of a group.  The task runs in the calling thread if
+    /// the deque is full.
+    ///
+    void Spawn(Task* task, TaskGroup* group);
+
+    ///
+    /// Runs the tasks until those of the group finish.
+    ///
+    void Sync(TaskGroup* group);
+
+    ///
+    /// Splits the range in halves down to the grain and runs the body over
+    /// the pieces in parallel.  Returns when the whole range is done.
+    ///
+    /// @param grain    the longest range given to the body, or 0 to choose
+    ///                 by the number of the workers
+    ///
+    void ParallelFor(size_t begin, size_t end, RangeBody* body,
+                     size_t grain = 0);
+
+    size_t Count() const { return _count; }
+
+    static TaskPool* Default() { return _default; }
+};
+
+///
+/// Spawns a task in the default pool
+///
+inline void
+spawn(Task* task, TaskGroup* group)
+{
+    TaskPool::Default()->Spawn(task, group);
+}
+
+///
+/// Waits for a group in the default pool
+///
+inline void
+sync(TaskGroup* group)
+{
+    TaskPool::Default()->Sync(group);
+}
+
+///
+/// Runs a parallel loop in the default pool
+///
+inline void
+parallel_for(size_t begin, size_t end, RangeBody* body, size_t grain = 0)
+{
+    TaskPool::Default()->ParallelFor(begin, end, body, grain);
+}
+
+#endif // ARC_TASK_POOL_H
@@ -0,0 +1,471 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @brief  Work-stealing task runtime
+/// @file   Libraries/Parallel/src/TaskPool.cpp
+/// @since  October 2008
+///
+
+//#define SYS_DEBUG
+//#define SYS_DEBUG_CALL
+
+#include <Debug.h>
+#include <TaskPool.h>
+#include <Types.h>
+#include <l4/schedule.h>
+#include <l4/thread.h>
+#include <l4/types.h>
+
+TaskPool*   TaskPool::_default = 0;
+
+static inline void
+Barrier()
+{
+    __asm__ __volatile__ ("" ::: "memory");
+}
+
+///
+/// Orders a store before the following loads
+///
+static inline void
+Fence()
+{
+    __asm__ __volatile__ ("lock; addl $0, (%%esp)" ::: "memory");
+}
+
+static inline Int
+CompareAndSwap(volatile Int* ptr, Int cmp, Int val)
+{
+    Int ret;
+
+    __asm__ __volatile__ ("lock             \n"
+                          "cmpxchgl %2, %1  \n"
+                          : "=a" (ret), "+m" (*ptr)
+                          : "r" (val), "0" (cmp)
+                          : "memory");
+    return ret;
+}
+
+static inline Int
+FetchAndAdd(volatile Int* ptr, Int val)
+{
+    __asm__ __volatile__ ("lock             \n"
+                          "xaddl %0, %1     \n"
+                          : "+r" (val), "+m" (*ptr)
+                          :
+                          : "memory");
+    return val;
+}
+
+///
+/// Splits a range of a parallel loop
+///
+class RangeTask : public Task
+{
+private:
+    TaskPool*   _pool;
+    size_t      _begin;
+    size_t      _end;
+    RangeBody*  _body;
+    size_t      _grain;
+
+public:
+    RangeTask(TaskPool* pool, size_t begin, size_t end, RangeBody* body,
+              size_t grain)
+        : _pool(pool), _begin(begin), _end(end), _body(body), _grain(grain)
+    {}
+
+    void Run() { _pool->ParallelFor(_begin, _end, _body, _grain); }
+};
+
+Bool
+TaskDeque::Push(Task* task)
+{
+    Int bottom = _bottom;
+
+    if (bottom - _top >= SIZE) {
+        return FALSE;
+    }
+
+    _slots[bottom & (SIZE - 1)] = task;
+    // Publish the task before the index
+    Barrier();
+    _bottom = bottom + 1;
+    return TRUE;
+}
+
+Task*
+TaskDeque::Pop()
+{
+    Int     bottom = _bottom - 1;
+    Int     top;
+    Task*   task;
+
+    // Claim the slot before looking at the thieves
+    _bottom = bottom;
+    Fence();
+    top = _top;
+
+    if (bottom < top) {
+        _bottom = top;
+        return 0;
+    }
+
+    task = _slots[bottom & (SIZE - 1)];
+    if (top < bottom) {
+        return task;
+    }
+
+    // The last task.  Race the thieves for it.
+    if (CompareAndSwap(&_top, top, top + 1) != top) {
+        task = 0;
+    }
+    _bottom = top + 1;
+    return task;
+}
+
+Task*
+TaskDeque::Steal()
+{
+    Int     top = _top;
+    Int     bottom;
+    Task*   task;
+
+    Barrier();
+    bottom = _bottom;
+    if (bottom <= top) {
+        return 0;
+    }
+
+    task = _slots[top & (SIZE - 1)];
+    if (CompareAndSwap(&_top, top, top + 1) != top) {
+        return 0;
+    }
+    return task;
+}
+
+void
+TaskWorker::Run()
+{
+    Task*   task;
+
+    while (!_pool->_stopping) {
+        task = _pool->Find(_index);
+        if (task != 0) {
+            _pool->Execute(task);
+        }
+        else {
+            _pool->Sleep();
+        }
+    }
+}
+
+TaskPool::TaskPool()
+    : _count(0), _sleepers(0), _idle(0), _stopping(FALSE)
+{
+    for (size_t i = 0; i < MAX_WORKERS; i++) {
+        _workers[i] = 0;
+    }
+}
+
+TaskPool::~TaskPool()
+{
+    Stop();
+}
+
+stat_t
+TaskPool::Start(size_t count)
+{
+    stat_t  err;
+
+    ENTER;
+
+    if (count == 0 || MAX_WORKERS < count || _count != 0) {
+        return ERR_INVALID_ARGUMENTS;
+    }
+
+    _stopping = FALSE;
+    for (size_t i = 0; i < count; i++) {
+        _workers[i] = new TaskWorker(this, i);
+        if (_workers[i] == 0) {
+            Stop();
+            return ERR_OUT_OF_MEMORY;
+        }
+
+        // The worker may steal from the others as soon as it starts.
+        _count++;
+        err = _workers[i]->Start();
+        if (err != ERR_NONE) {
+            _count--;
+            delete _workers[i];
+            _workers[i] = 0;
+            Stop();
+            return err;
+        }
+    }
+
+    if (_default == 0) {
+        _default = this;
+    }
+
+    EXIT;
+    return ERR_NONE;
+}
+
+void
+TaskPool::Stop()
+{
+    if (_count == 0) {
+        return;
+    }
+
+    _stopping = TRUE;
+    for (size_t i = 0; i < _count; i++) {
+        _idle.Up();
+    }
+
+    for (size_t i = 0; i < _count; i++) {
+        _workers[i]->Join();
+        delete _workers[i];
+        _workers[i] = 0;
+    }
+    _count = 0;
+    _sleepers = 0;
+
+    // The workers that never slept left their units.  A restarted pool
+    // would run through them instead of sleeping.
+    _idle.Reset();
+
+    if (_default == this) {
+        _default = 0;
+    }
+}
+
+size_t
+TaskPool::Self() const
+{
+    L4_ThreadId_t   me = L4_Myself();
+
+    for (size_t i = 0; i < _count; i++) {
+        if (_workers[i] != 0 && L4_IsThreadEqual(_workers[i]->Id(), me)) {
+            return i;
+        }
+    }
+    return MAX_WORKERS;
+}
+
+Task*
+TaskPool::Find(size_t self)
+{
+    Task*   task;
+    size_t  start;
+
+    if (self < _count) {
+        task = _deques[self].Pop();
+        start = self + 1;
+    }
+    else {
+        _shared_lock.Lock();
+        task = _shared.Pop();
+        _shared_lock.Unlock();
+        start = 0;
+    }
+    if (task != 0) {
+        return task;
+    }
+
+    if (self < _count) {
+        task = _shared.Steal();
+        if (task != 0) {
+            return task;
+        }
+    }
+
+    for (size_t i = 0; i < _count; i++) {
+        size_t victim = (start + i) % _count;
+
+        if (victim == self) {
+            continue;
+        }
+        task = _deques[victim].Steal();
+        if (task != 0) {
+            return task;
+        }
+    }
+    return 0;
+}
+
+void
+TaskPool::Execute(Task* task)
+{
+    TaskGroup*  group = task->_group;
+
+    task->Run();
+    // The task may be gone as soon as the group is done.
+    FetchAndAdd(&group->_pending, -1);
+}
+
+Bool
+TaskPool::HasWork() const
+{
+    if (!_shared.IsEmpty()) {
+        return TRUE;
+    }
+    for (size_t i = 0; i < _count; i++) {
+        if (!_deques[i].IsEmpty()) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+void
+TaskPool::Sleep()
+{
+    Int     count;
+
+    // The locked add orders the count before the checks below.  Pairs with
+    // the fence in Wake().
+    FetchAndAdd(&_sleepers, 1);
+    if (HasWork() || _stopping) {
+        // Take the count back unless a spawner has taken it, in which case
+        // its wake is on the way.
+        for (;;) {
+            count = _sleepers;
+            if (count <= 0) {
+                break;
+            }
+            if (CompareAndSwap(&_sleepers, count, count - 1) == count) {
+                return;
+            }
+        }
+    }
+    _idle.Down();
+}
+
+void
+TaskPool::Wake()
+{
+    Int     count;
+
+    // The task published before the count
+    Fence();
+    for (;;) {
+        count = _sleepers;
+        if (count <= 0) {
+            return;
+        }
+        if (CompareAndSwap(&_sleepers, count, count - 1) == count) {
+            _idle.Up();
+            return;
+        }
+    }
+}
+
+void
+TaskPool::Spawn(Task* task, TaskGroup* group)
+{
+    size_t  self;
+    Bool    queued;
+
+    task->_group = group;
+    FetchAndAdd(&group->_pending, 1);
+
+    if (_count == 0) {
+        Execute(task);
+        return;
+    }
+
+    self = Self();
+    if (self < _count) {
+        queued = _deques[self].Push(task);
+    }
+    else {
+        _shared_lock.Lock();
+        queued = _shared.Push(task);
+        _shared_lock.Unlock();
+    }
+
+    if (!queued) {
+        Execute(task);
+        return;
+    }
+    Wake();
+}
+
+void
+TaskPool::Sync(TaskGroup* group)
+{
+    size_t  self = Self();
+    Task*   task;
+
+    while (group->_pending != 0) {
+        task = Find(self);
+        if (task != 0) {
+            Execute(task);
+        }
+        else {
+            // The rest of the group is running in the other threads.
+            L4_ThreadSwitch(L4_nilthread);
+        }
+    }
+    Barrier();
+}
+
+void
+TaskPool::ParallelFor(size_t begin, size_t end, RangeBody* body,
+                      size_t grain)
+{
+    TaskGroup   group;
+    size_t      middle;
+
+    if (end <= begin) {
+        return;
+    }
+
+    if (grain == 0) {
+        grain = (end - begin) / (4 * (_count + 1));
+        if (grain == 0) {
+            grain = 1;
+        }
+    }
+
+    if (end - begin <= grain) {
+        body->Run(begin, end);
+        return;
+    }
+
+    // Leave the upper half to a thief and go on with the lower half
+    middle = begin + (end - begin) / 2;
+    RangeTask upper(this, middle, end, body, grain);
+    Spawn(&upper, &group);
+    ParallelFor(begin, middle, body, grain);
+    Sync(&group);
+}
@@ -47,17 +47,46 @@ struct SessionControlBlock
     addr_t          base;
     size_t          size;
     word_t          data;
+
+    ///
+    /// The last thread found in the space of the client
+    ///
+    L4_ThreadId_t   thread;
 };
 
 
 class SelfHealingSessionServer : public SelfHealingServer
 {
 protected:
+    ///
+    /// The worker threads.  Null unless StartWorkers() is called.
+    ///
+    WorkerPool*     _pool;
+
+    ///
+    /// Runs the data transfer requests in worker threads, so that a slow
+    /// request doesn't block the other clients.  The requests of a session
+    /// are processed in order by the same worker.  The requests in the
+    /// workers are not recovered after a failure.
+    ///
+    /// @param count    the number of the workers
+    ///
+    stat_t StartWorkers(size_t count);
+
+    virtual Bool Defer(const L4_ThreadId_t& tid, L4_Msg_t& msg);
+
     void Register(const L4_ThreadId_t& tid, addr_t base, size_t size);
     void Deregister(const L4_ThreadId_t& tid, addr_t base);
     void Deregister(SessionControlBlock* c);
     SessionControlBlock* Search(const L4_ThreadId_t& tid, addr_t base);
 
+    ///
+    /// Obtains the largest shared memory granted to a client, in pages.
+    /// The persistent shared memory heap is small, so the default is kept
+    /// well below Session::MAX_SHM_PAGES.
+    ///
+    virtual size_t MaxShmPages();
+
     virtual stat_t IpcHandler(const L4_ThreadId_t& tid, L4_Msg_t& msg);
     virtual stat_t HandleConnect(const L4_ThreadId_t& tid, L4_Msg_t& msg);
     virtual stat_t HandleDisconnect(const L4_ThreadId_t& tid, L4_Msg_t& msg);
@@ -86,6 +115,65 @@ protected:
         return ERR_NONE;
     }
 
+    ///
+    /// Fills pages lent to the client.  Servers that don't lend pages make
+    /// the client fall back to Get.
+    ///
+    virtual stat_t HandleMap(const L4_ThreadId_t& tid, L4_Msg_t& msg)
+    {
+        Ipc::ReturnError(&msg, ERR_NOT_FOUND);
+        return ERR_NONE;
+    }
+
+    ///
+    /// Runs the Get or Put handler for each entry of a batch, in one
+    /// wakeup.  The handlers see an ordinary single request.
+    ///
+    virtual stat_t HandleBatch(const L4_ThreadId_t& tid, L4_Msg_t& msg);
+
+    ///
+    /// Processes the requests queued in the ring of the client.
+    ///
+    virtual stat_t HandleSubmit(const L4_ThreadId_t& tid, L4_Msg_t& msg);
+
+    ///
+    /// Processes a request from the ring.  The buffer is already checked
+    /// to be in the data area of the ring.
+    ///
+    /// @param c        the client
+    /// @param req      the request
+    /// @param buf      the address of the data of the request
+    /// @param cmp      the completion to be filled
+    ///
+    virtual void HandleRequest(SessionControlBlock* c, const IoRequest& req,
+                               addr_t buf, IoCompletion& cmp)
+    {
+        cmp.status = ERR_NOT_FOUND;
+        cmp.result = 0;
+    }
+
+    virtual void ServeRequest(void* client, const IoRequest& req,
+                              addr_t buf, IoCompletion& cmp);
+
+    ///
+    /// Notifies the client of completions posted out of HandleSubmit.
+    /// Call only when SessionRing::TakeWaiter() returns TRUE.
+    ///
+    void Notify(const L4_ThreadId_t& tid)
+    {
+        L4_Msg_t msg;
+        L4_Put(&msg, MSG_SESSION_COMPLETE, 0, 0, 0, 0);
+        Propagate(&msg);
+        L4_Load(&msg);
+        L4_Send_Timeout(tid, L4_ZeroTime);
+    }
+
+    ///
+    /// Makes a message sent by a worker appear to come from the main
+    /// thread.
+    ///
+    void Propagate(L4_Msg_t* msg);
+
     L4_ThreadId_t FindSpace(L4_ThreadId_t t)
     {
         L4_Msg_t        msg;
@@ -99,8 +187,10 @@ protected:
 public:
     static const int NUM_CLIENTS = 10;
 
-    SelfHealingSessionServer() {}
-    virtual ~SelfHealingSessionServer() {}
+    static const size_t SHM_PAGES_PER_CLIENT = 16;
+
+    SelfHealingSessionServer() : _pool(0) {}
+    virtual ~SelfHealingSessionServer();
 };
 
 #define ARC_SHS_SERVER(CLASS)                                       \
@@ -128,6 +218,7 @@ public:
         if (err != ERR_NONE) {                                      \
             return static_cast<int>(err);                           \
         }                                                           \
+        SERVER_PROFILE(server);                                     \
         server.Run(state);                                          \
         err = server.Exit();                                        \
         return static_cast<int>(err);                               \
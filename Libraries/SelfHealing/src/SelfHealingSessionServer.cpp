@@ -46,94 +46,200 @@
 #include <Session.h>
 #include <System.h>
 #include <Types.h>
+#include <WorkerPool.h>
 #include <l4/ipc.h>
 
-#define SCB_MAXLEN  20
+// The control blocks are hashed by the shared memory with linear probing.
+// A removed block is marked so that the probing continues over it.
+#define SCB_MAXLEN  32
+#define SCB_EMPTY   0
+#define SCB_DELETED 1
 static SessionControlBlock  __scb[SCB_MAXLEN] IS_PERSISTENT;
 // Initialize with 0
 static Int                  __scb_length IS_PERSISTENT = 0;
 
+static inline Int
+ScbHash(addr_t base)
+{
+    return static_cast<Int>((base >> PAGE_BITS) % SCB_MAXLEN);
+}
+
+SelfHealingSessionServer::~SelfHealingSessionServer()
+{
+    if (_pool != 0) {
+        delete _pool;
+    }
+}
+
+stat_t
+SelfHealingSessionServer::StartWorkers(size_t count)
+{
+    stat_t  err;
+
+    if (_pool != 0) {
+        return ERR_EXIST;
+    }
+
+    _pool = new WorkerPool(this);
+    if (_pool == 0) {
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    err = _pool->Start(count);
+    if (err != ERR_NONE) {
+        delete _pool;
+        _pool = 0;
+    }
+    return err;
+}
+
+Bool
+SelfHealingSessionServer::Defer(const L4_ThreadId_t& tid, L4_Msg_t& msg)
+{
+    if (_pool == 0) {
+        return FALSE;
+    }
+
+    switch (L4_Label(L4_MsgTag(&msg))) {
+        case MSG_SESSION_BEGIN:
+        case MSG_SESSION_END:
+        case MSG_SESSION_GET:
+        case MSG_SESSION_PUT:
+        case MSG_SESSION_MAP:
+        case MSG_SESSION_SUBMIT:
+        case MSG_SESSION_GET_BATCH:
+        case MSG_SESSION_PUT_BATCH:
+            if (L4_UntypedWords(L4_MsgTag(&msg)) > 0) {
+                // The shared memory identifies the session.
+                _pool->Dispatch(tid, msg, L4_Get(&msg, 0));
+                return TRUE;
+            }
+            break;
+        default:
+            break;
+    }
+
+    // Register() and Deregister() change the control blocks, so the workers
+    // must be idle.
+    _pool->Drain();
+    return FALSE;
+}
+
+void
+SelfHealingSessionServer::Propagate(L4_Msg_t* msg)
+{
+    if (_pool != 0) {
+        _pool->Propagate(msg);
+    }
+}
+
 void
 SelfHealingSessionServer::Register(const L4_ThreadId_t& tid, addr_t base,
                                    size_t size)
 {
     L4_ThreadId_t   sid = FindSpace(tid);
-    if (__scb_length < SCB_MAXLEN) {
-        __scb_length++;
-        __scb[__scb_length - 1].tid = sid;
-        __scb[__scb_length - 1].base = base;
-        __scb[__scb_length - 1].size = size;
-        __scb[__scb_length - 1].data = -1;
+    Int             i = ScbHash(base);
+
+    if (__scb_length == SCB_MAXLEN) {
+        return;
+    }
+
+    while (__scb[i].base != SCB_EMPTY && __scb[i].base != SCB_DELETED) {
+        i = (i + 1) % SCB_MAXLEN;
     }
+
+    __scb_length++;
+    __scb[i].tid = sid;
+    __scb[i].thread = tid;
+    __scb[i].base = base;
+    __scb[i].size = size;
+    __scb[i].data = -1;
 }
 
 void
 SelfHealingSessionServer::Deregister(const L4_ThreadId_t& tid, addr_t base)
 {
-    if (__scb_length == 0) { 
-        return;
+    SessionControlBlock* c = Search(tid, base);
+    if (c != 0) {
+        Deregister(c);
     }
-
-    L4_ThreadId_t   sid = FindSpace(tid);
-    // Overwrite the removing target with the last valid element of the array.
-    for (int i = 0; i < __scb_length - 1; i++) {
-        if (L4_IsThreadEqual(__scb[i].tid, sid) &&
-            __scb[i].base == base) {
-            __scb[i] = __scb[__scb_length - 1];
-            break;
-        }
-    }
-    __scb_length--;
 }
 
 void
 SelfHealingSessionServer::Deregister(SessionControlBlock* c)
 {
-    // Overwrite the removing target with the last valid element of the array.
-    if (__scb_length > 1) {
-        *c = __scb[__scb_length - 1];
-    }
+    c->tid = L4_nilthread;
+    c->thread = L4_nilthread;
+    c->base = SCB_DELETED;
     __scb_length--;
 }
 
 SessionControlBlock*
 SelfHealingSessionServer::Search(const L4_ThreadId_t& tid, addr_t base)
 {
-    L4_ThreadId_t   sid = FindSpace(tid);
-    for (int i = 0; i < __scb_length; i++) {
-        if (L4_IsThreadEqual(__scb[i].tid, sid) &&
-            __scb[i].base == base) {
-            return &__scb[i];
+    Int i = ScbHash(base);
+
+    for (Int n = 0; n < SCB_MAXLEN && __scb[i].base != SCB_EMPTY; n++) {
+        if (__scb[i].base == base) {
+            if (L4_IsThreadEqual(__scb[i].thread, tid)) {
+                return &__scb[i];
+            }
+
+            // Another thread, maybe of another space.  Check its space.
+            if (L4_IsThreadEqual(__scb[i].tid, FindSpace(tid))) {
+                __scb[i].thread = tid;
+                return &__scb[i];
+            }
+            return 0;
         }
+        i = (i + 1) % SCB_MAXLEN;
     }
 
     return 0;
 }
 
+size_t
+SelfHealingSessionServer::MaxShmPages()
+{
+    return SHM_PAGES_PER_CLIENT;
+}
+
 stat_t
 SelfHealingSessionServer::HandleConnect(const L4_ThreadId_t& tid, L4_Msg_t& msg)
 {
     ENTER;
     L4_Word_t   reg[2];
-    addr_t      shm = shmalloc(Session::DEFAULT_SHM_PAGES);
+    size_t      pages = Session::RequestedPages(&msg, MaxShmPages());
+    addr_t      shm;
 
-    DOUT("shm allocate @ %.8lX\n", shm);
+    // Grant a smaller window rather than refusing the client.
+    for (;;) {
+        shm = shmalloc(pages);
+        if (shm != 0 || pages <= Session::DEFAULT_SHM_PAGES) {
+            break;
+        }
+        pages >>= 1;
+    }
+
+    DOUT("shm allocate @ %.8lX (%u pages)\n", shm, pages);
 
     if (shm == 0) {
         return ERR_OUT_OF_MEMORY;
     }
 
     //TODO: Hack: Related to a problem in PersistentPageAllocator.cpp
-    for (UInt i = 0; i < Session::DEFAULT_SHM_PAGES; i++) {
+    for (UInt i = 0; i < pages; i++) {
         Pager.Release(shm + i * PAGE_SIZE);
     }
 
-    for (UInt i = 0; i < Session::DEFAULT_SHM_PAGES; i++) {
-        Pager.Reserve(shm + i * PAGE_SIZE, tid, L4_ReadWriteOnly);
+    if (Pager.Reserve(shm, pages, tid, L4_ReadWriteOnly) != ERR_NONE) {
+        for (UInt i = 0; i < pages; i++) {
+            Pager.Reserve(shm + i * PAGE_SIZE, tid, L4_ReadWriteOnly);
+        }
     }
 
     reg[0] = shm;
-    reg[1] = Session::DEFAULT_SHM_PAGES;
+    reg[1] = pages;
     L4_Put(&msg, 0, 2, reg, 0, 0);
     Register(tid, reg[0], reg[1]);
 
@@ -164,6 +270,33 @@ SelfHealingSessionServer::HandleDisconnect(const L4_ThreadId_t& tid,
     return ERR_NONE;
 }
 
+stat_t
+SelfHealingSessionServer::HandleBatch(const L4_ThreadId_t& tid, L4_Msg_t& msg)
+{
+    return RunBatch(tid, msg);
+}
+
+stat_t
+SelfHealingSessionServer::HandleSubmit(const L4_ThreadId_t& tid,
+                                       L4_Msg_t& msg)
+{
+    SessionControlBlock* c;
+
+    c = Search(tid, L4_Get(&msg, 0));
+    if (c == 0) {
+        Ipc::ReturnError(&msg, ERR_NOT_FOUND);
+        return ERR_NONE;
+    }
+    return RunRing(c, c->base, c->size * PAGE_SIZE, msg);
+}
+
+void
+SelfHealingSessionServer::ServeRequest(void* client, const IoRequest& req,
+                                       addr_t buf, IoCompletion& cmp)
+{
+    HandleRequest(static_cast<SessionControlBlock*>(client), req, buf, cmp);
+}
+
 SERVER_HANDLER_BEGIN(SelfHealingSessionServer)
 SERVER_HANDLER_CONNECT(MSG_SESSION_CONNECT, HandleConnect)
 SERVER_HANDLER_CONNECT(MSG_SESSION_DISCONNECT, HandleDisconnect)
@@ -171,5 +304,9 @@ SERVER_HANDLER_CONNECT(MSG_SESSION_BEGIN, HandleBegin)
 SERVER_HANDLER_CONNECT(MSG_SESSION_END, HandleEnd)
 SERVER_HANDLER_CONNECT(MSG_SESSION_PUT, HandlePut)
 SERVER_HANDLER_CONNECT(MSG_SESSION_GET, HandleGet)
+SERVER_HANDLER_CONNECT(MSG_SESSION_MAP, HandleMap)
+SERVER_HANDLER_CONNECT(MSG_SESSION_SUBMIT, HandleSubmit)
+SERVER_HANDLER_CONNECT(MSG_SESSION_GET_BATCH, HandleBatch)
+SERVER_HANDLER_CONNECT(MSG_SESSION_PUT_BATCH, HandleBatch)
 SERVER_HANDLER_END
 
@@ -0,0 +1,90 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @file   Libraries/System/include/CondVar.h
+/// @brief  Condition variable
+/// @since  October 2008
+///
+
+#ifndef ARC_COND_VAR_H
+#define ARC_COND_VAR_H
+
+#include <Mutex.h>
+#include <WaitQueue.h>
+#include <l4/thread.h>
+
+///
+/// A condition variable.  The mutex given to Wait() guards the queue of the
+/// waiters, so Signal() and Broadcast() must be called with the mutex held.
+/// The waiters are woken in the order they started to wait.
+///
+class CondVar
+{
+private:
+    WaitQueue   _queue;
+
+public:
+    CondVar() {}
+
+    void Initialize() { _queue.Initialize(); }
+
+    ///
+    /// Releases the mutex and blocks until signaled.  The mutex is held
+    /// again on return.
+    ///
+    void Wait(Mutex* mutex) {
+        _queue.Sleep(mutex);
+        mutex->Lock();
+    }
+
+    ///
+    /// Wakes one of the waiters if any.
+    ///
+    void Signal() {
+        L4_ThreadId_t   tid = _queue.Dequeue();
+
+        if (!L4_IsNilThread(tid)) {
+            WaitQueue::Wake(tid);
+        }
+    }
+
+    ///
+    /// Wakes all the waiters.
+    ///
+    void Broadcast() {
+        L4_ThreadId_t   tid;
+
+        while (!L4_IsNilThread(tid = _queue.Dequeue())) {
+            WaitQueue::Wake(tid);
+        }
+    }
+};
+
+#endif // ARC_COND_VAR_H
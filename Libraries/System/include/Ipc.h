@@ -44,6 +44,121 @@
 #include <l4/ipc.h>
 #include <l4/types.h>
 
+///
+/// Declares the layout of a message.  BODY is a structure of word-sized
+/// fields, which are carried by the untyped registers in the order of
+/// declaration.  The size of the body is checked at compile time, and the
+/// shape of a received message is checked by one comparison of its tag.
+///
+///     struct MapRequest { addr_t dest; ... };
+///     typedef IpcMessage<MSG_PAGER_MAP, MapRequest> MapMessage;
+///
+/// LABEL is the default label.  Requests with flags in the label and
+/// replies, whose label is the status, give the label explicitly.
+///
+template <L4_Word_t LABEL, typename BODY>
+class IpcMessage
+{
+public:
+    typedef BODY Body;
+
+    static const L4_Word_t LABEL_DEFAULT = LABEL;
+
+    ///
+    /// The number of the untyped registers of the body
+    ///
+    static const size_t WORDS = sizeof(BODY) / sizeof(L4_Word_t);
+
+private:
+    //
+    // Compile-time checks: an error on these lines means that BODY doesn't
+    // fit in the message registers.
+    //
+    typedef char BodyNotInWords[sizeof(BODY) % sizeof(L4_Word_t) == 0 ?
+                                1 : -1];
+    typedef char BodyTooLarge[WORDS < __L4_NUM_MRS ? 1 : -1];
+
+    static L4_MsgTag_t Tag(L4_Word_t label)
+    {
+        L4_MsgTag_t tag;
+        tag.raw = 0;
+        tag.X.label = label;
+        tag.X.u = WORDS;
+        return tag;
+    }
+
+    static L4_Word_t* Words(const BODY& body)
+    {
+        return reinterpret_cast<L4_Word_t*>(const_cast<BODY*>(&body));
+    }
+
+public:
+    ///
+    /// Checks if a message has the shape of the body.
+    ///
+    static Bool Match(L4_MsgTag_t tag)
+    {
+        return (L4_UntypedWords(tag) == WORDS && L4_TypedWords(tag) == 0);
+    }
+
+    ///
+    /// Builds a message in a buffer.
+    ///
+    static void Put(L4_Msg_t* msg, L4_Word_t label, const BODY& body)
+    {
+        L4_Word_t* w = Words(body);
+
+        msg->tag = Tag(label);
+        for (size_t i = 0; i < WORDS; i++) {
+            msg->msg[i + 1] = w[i];
+        }
+    }
+
+    static void Put(L4_Msg_t* msg, const BODY& body)
+    { Put(msg, LABEL, body); }
+
+    ///
+    /// Reads a message in a buffer.  Returns FALSE if the message has
+    /// another shape.
+    ///
+    static Bool Get(const L4_Msg_t* msg, BODY* body)
+    {
+        L4_Word_t* w = Words(*body);
+
+        if (!Match(msg->tag)) {
+            return FALSE;
+        }
+        for (size_t i = 0; i < WORDS; i++) {
+            w[i] = msg->msg[i + 1];
+        }
+        return TRUE;
+    }
+
+    ///
+    /// Writes a message to the message registers directly.
+    ///
+    static void Load(L4_Word_t label, const BODY& body)
+    {
+        L4_LoadMR(0, Tag(label).raw);
+        L4_LoadMRs(1, WORDS, Words(body));
+    }
+
+    static void Load(const BODY& body) { Load(LABEL, body); }
+
+    ///
+    /// Reads a received message from the message registers directly.
+    /// Returns FALSE if the message has another shape.
+    ///
+    static Bool Store(L4_MsgTag_t tag, BODY* body)
+    {
+        if (!Match(tag)) {
+            return FALSE;
+        }
+        L4_StoreMRs(1, WORDS, Words(*body));
+        return TRUE;
+    }
+};
+
 
 class Ipc
 {
@@ -104,6 +219,63 @@ public:
         return static_cast<stat_t>(L4_MsgLabel(in));
     }
 
+    ///
+    /// Makes an IPC call with a typed request.  The message registers are
+    /// written directly.  Returns the label of the reply.
+    ///
+    /// @param dest         the destination thread
+    /// @param label        the label of the request
+    /// @param req          the body of the request
+    ///
+    template <class REQ>
+    static stat_t Call(L4_ThreadId_t dest, L4_Word_t label,
+                       const typename REQ::Body& req)
+    {
+        L4_MsgTag_t tag;
+
+        REQ::Load(label, req);
+        tag = L4_Call(dest);
+        if (L4_IpcFailed(tag)) {
+            return Ipc::ErrorCode();
+        }
+        return static_cast<stat_t>(L4_Label(tag));
+    }
+
+    template <class REQ>
+    static stat_t Call(L4_ThreadId_t dest, const typename REQ::Body& req)
+    {
+        return Call<REQ>(dest, REQ::LABEL_DEFAULT, req);
+    }
+
+    ///
+    /// Makes an IPC call with a typed request and a typed reply.  The body
+    /// of the reply is read only if the reply is successful.  A successful
+    /// reply of another shape results in ERR_UNKNOWN.
+    ///
+    /// @param dest         the destination thread
+    /// @param req          the body of the request
+    /// @param rep          the body of the reply
+    ///
+    template <class REQ, class REP>
+    static stat_t Call(L4_ThreadId_t dest, const typename REQ::Body& req,
+                       typename REP::Body* rep)
+    {
+        L4_MsgTag_t tag;
+
+        REQ::Load(req);
+        tag = L4_Call(dest);
+        if (L4_IpcFailed(tag)) {
+            return Ipc::ErrorCode();
+        }
+        if (L4_Label(tag) != ERR_NONE) {
+            return static_cast<stat_t>(L4_Label(tag));
+        }
+        if (!REP::Store(tag, rep)) {
+            return ERR_UNKNOWN;
+        }
+        return ERR_NONE;
+    }
+
     ///
     /// Makes a one-way IPC.
     ///
@@ -148,5 +320,35 @@ public:
     }
 };
 
+//
+//  Message schemas of the core protocols
+//
+
+///
+/// Maps pages from a space to another: MSG_PAGER_MAP | rwx
+///
+struct PagerMapRequest
+{
+    addr_t          dest;
+    L4_ThreadId_t   did;
+    addr_t          src;
+    L4_ThreadId_t   sid;
+    L4_Word_t       count;
+};
+
+typedef IpcMessage<MSG_PAGER_MAP, PagerMapRequest> PagerMapMessage;
+
+///
+/// Starts a thread at the entry point with the stack
+///
+struct ThreadStartRequest
+{
+    L4_ThreadId_t   tid;
+    addr_t          ip;
+    addr_t          sp;
+};
+
+typedef IpcMessage<MSG_PEL_START_TH, ThreadStartRequest> ThreadStartMessage;
+
 #endif // ARC_IPC_H
 
@@ -0,0 +1,300 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @brief  Per-label statistics of the requests processed by a server
+/// @file   Libraries/System/include/IpcProfile.h
+/// @since  October 2008
+///
+
+#ifndef ARC_IPC_PROFILE_H
+#define ARC_IPC_PROFILE_H
+
+#include <Ipc.h>
+#include <Mutex.h>
+#include <String.h>
+#include <Types.h>
+#include <l4/message.h>
+
+///
+/// Records the number of the requests of each label, the cycles spent for
+/// them and the cycles they waited in a queue.  The service time is also
+/// kept in a histogram of powers of two.
+///
+/// The statistics are obtained by a query message: [op, index].
+///
+///   OP_SUMMARY    [enabled, labels, idle low, idle high, dropped]
+///   OP_ENTRY      [label, count, service low, service high, queue low,
+///                  queue high, max, histogram...]
+///   OP_ENABLE, OP_DISABLE, OP_RESET   []
+///
+class IpcProfile
+{
+public:
+    static const size_t     MAX_LABELS = 32;
+
+    static const size_t     HISTOGRAM_LENGTH = 16;
+
+    ///
+    /// The first bucket of the histogram holds the requests shorter than
+    /// 2^(HISTOGRAM_SHIFT + 1) cycles.
+    ///
+    static const size_t     HISTOGRAM_SHIFT = 8;
+
+    static const L4_Word_t  OP_SUMMARY = 0;
+    static const L4_Word_t  OP_ENTRY = 1;
+    static const L4_Word_t  OP_ENABLE = 2;
+    static const L4_Word_t  OP_DISABLE = 3;
+    static const L4_Word_t  OP_RESET = 4;
+
+    struct Entry
+    {
+        L4_Word_t   label;
+        UInt        count;
+        ULong       service;
+        ULong       queue;
+        UInt        max;
+        UInt        histogram[HISTOGRAM_LENGTH];
+    };
+
+private:
+    Entry           _entries[MAX_LABELS];
+
+    size_t          _length;
+
+    ///
+    /// The cycles the server waited for the requests
+    ///
+    ULong           _idle;
+
+    ///
+    /// The time the last reply was made
+    ///
+    ULong           _last;
+
+    ///
+    /// The requests not recorded because of too many labels
+    ///
+    UInt            _dropped;
+
+    Bool            _enabled;
+
+    Mutex           _lock;
+
+    static size_t Bucket(ULong cycles)
+    {
+        size_t  i = 0;
+
+        cycles >>= HISTOGRAM_SHIFT + 1;
+        while (cycles != 0 && i < HISTOGRAM_LENGTH - 1) {
+            cycles >>= 1;
+            i++;
+        }
+        return i;
+    }
+
+    static L4_Word_t Low(ULong v) { return static_cast<L4_Word_t>(v); }
+
+    static L4_Word_t High(ULong v) { return static_cast<L4_Word_t>(v >> 32); }
+
+public:
+    IpcProfile() : _enabled(FALSE) { Reset(); }
+
+    static ULong Now()
+    {
+        UInt hi, lo;
+        asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+        return (static_cast<ULong>(hi) << 32) | lo;
+    }
+
+    Bool IsEnabled() const { return _enabled; }
+
+    void Enable(Bool on)
+    {
+        _enabled = on;
+        _last = 0;
+    }
+
+    void Reset()
+    {
+        _lock.Lock();
+        _length = 0;
+        _idle = 0;
+        _last = 0;
+        _dropped = 0;
+        _lock.Unlock();
+    }
+
+    ///
+    /// Marks the arrival of a request.  Returns the time to be passed to
+    /// End(), or 0 if disabled.
+    ///
+    ULong Begin()
+    {
+        ULong now;
+
+        if (!_enabled) {
+            return 0;
+        }
+
+        now = Now();
+        if (_last != 0) {
+            _idle += now - _last;
+        }
+        return now;
+    }
+
+    ///
+    /// Marks the receiving thread waiting again after handing a request
+    /// over to another thread.
+    ///
+    void Resume()
+    {
+        if (_enabled) {
+            _last = Now();
+        }
+    }
+
+    ///
+    /// Records a request processed by the receiving thread.
+    ///
+    void End(L4_Word_t label, ULong start)
+    {
+        if (!_enabled || start == 0) {
+            return;
+        }
+
+        _last = Now();
+        Record(label, _last - start, 0);
+    }
+
+    ///
+    /// Records a request.  Called by any thread of the server.
+    ///
+    /// @param label    the label of the request
+    /// @param service  the cycles spent for the request
+    /// @param queue    the cycles the request waited before the service
+    ///
+    void Record(L4_Word_t label, ULong service, ULong queue)
+    {
+        Entry*  e = 0;
+
+        _lock.Lock();
+        for (size_t i = 0; i < _length; i++) {
+            if (_entries[i].label == label) {
+                e = &_entries[i];
+                break;
+            }
+        }
+
+        if (e == 0) {
+            if (_length == MAX_LABELS) {
+                _dropped++;
+                _lock.Unlock();
+                return;
+            }
+            e = &_entries[_length++];
+            memset(e, 0, sizeof(Entry));
+            e->label = label;
+        }
+
+        e->count++;
+        e->service += service;
+        e->queue += queue;
+        if (e->max < service) {
+            e->max = (service >> 32) != 0 ? ~0UL : static_cast<UInt>(service);
+        }
+        e->histogram[Bucket(service)]++;
+        _lock.Unlock();
+    }
+
+    ///
+    /// Processes a query message and puts the reply in it.  Errors are
+    /// returned in the label of the reply.
+    ///
+    void Query(L4_Msg_t* msg)
+    {
+        L4_Word_t   reg[7 + HISTOGRAM_LENGTH];
+        L4_Word_t   op;
+        L4_Word_t   index;
+        Entry*      e;
+
+        op = L4_UntypedWords(L4_MsgTag(msg)) > 0 ? L4_Get(msg, 0) : OP_SUMMARY;
+        index = L4_UntypedWords(L4_MsgTag(msg)) > 1 ? L4_Get(msg, 1) : 0;
+
+        switch (op) {
+            case OP_SUMMARY:
+                reg[0] = _enabled;
+                reg[1] = _length;
+                reg[2] = Low(_idle);
+                reg[3] = High(_idle);
+                reg[4] = _dropped;
+                L4_Put(msg, ERR_NONE, 5, reg, 0, 0);
+                break;
+            case OP_ENTRY:
+                _lock.Lock();
+                if (_length <= index) {
+                    _lock.Unlock();
+                    Ipc::ReturnError(msg, ERR_NOT_FOUND);
+                    break;
+                }
+                e = &_entries[index];
+                reg[0] = e->label;
+                reg[1] = e->count;
+                reg[2] = Low(e->service);
+                reg[3] = High(e->service);
+                reg[4] = Low(e->queue);
+                reg[5] = High(e->queue);
+                reg[6] = e->max;
+                for (size_t i = 0; i < HISTOGRAM_LENGTH; i++) {
+                    reg[7 + i] = e->histogram[i];
+                }
+                _lock.Unlock();
+                L4_Put(msg, ERR_NONE, 7 + HISTOGRAM_LENGTH, reg, 0, 0);
+                break;
+            case OP_ENABLE:
+                Enable(TRUE);
+                L4_Put(msg, ERR_NONE, 0, 0, 0, 0);
+                break;
+            case OP_DISABLE:
+                Enable(FALSE);
+                L4_Put(msg, ERR_NONE, 0, 0, 0, 0);
+                break;
+            case OP_RESET:
+                Reset();
+                L4_Put(msg, ERR_NONE, 0, 0, 0, 0);
+                break;
+            default:
+                Ipc::ReturnError(msg, ERR_INVALID_ARGUMENTS);
+                break;
+        }
+    }
+};
+
+#endif // ARC_IPC_PROFILE_H
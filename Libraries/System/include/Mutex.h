@@ -42,38 +42,121 @@
 #include <l4/types.h>
 #include <l4/thread.h>
 
+///
+/// A mutex that blocks the contended waiters.  The lock word holds the
+/// local ID of the owner.  A waiter spins for a short while, then queues
+/// itself and receives from the thread ahead of it in the queue, or the
+/// owner if it is the first.  The owner sees the contention in the lowest
+/// bit of the lock word and hands the lock directly to the first waiter
+/// with an IPC, so the lock does not go free while threads wait for it.
+///
+/// The lock is for the threads in the same address space.  It must be
+/// released by the owner.  MR0 is preserved across the hand-off IPC.
+///
 class Mutex
 {
+public:
+    ///
+    /// The upper bound of the spins before a waiter blocks
+    ///
+    static const int    MAX_SPIN = 100;
+
 private:
-    L4_Word_t   _mutex_;
+    ///
+    /// A blocked thread.  It lives on the stack of the thread.
+    ///
+    struct Waiter {
+        L4_Word_t   id;
 
-public:
-    Mutex() : _mutex_(0) {}
+        ///
+        /// The thread that hands the lock to this one
+        ///
+        L4_Word_t   pred;
 
-    ~Mutex() {}
+        Waiter*     next;
+    };
 
-    void Initialize() { _mutex_ = 0; }
+    ///
+    /// The flag in the lock word that tells the owner to take the slow
+    /// path.  Local thread IDs are aligned to 64 bytes.
+    ///
+    static const L4_Word_t  CONTENDED = 1;
 
-    int TryLock() {
-        L4_Word_t   id = L4_Myself().raw;
+    volatile L4_Word_t  _mutex_;
+
+    ///
+    /// The spin lock of the wait queue
+    ///
+    volatile L4_Word_t  _guard_;
+
+    Waiter*             _head_;
+
+    Waiter*             _tail_;
+
+    ///
+    /// The running average of the spins that acquired the lock
+    ///
+    int                 _spins_;
+
+    static L4_Word_t CompareAndSwap(volatile L4_Word_t* ptr, L4_Word_t cmp,
+                                    L4_Word_t val)
+    {
         L4_Word_t   ret;
 
         __asm__ __volatile__ ("lock             \n"
-                              "cmpxchgl %1, %2  \n"
-                              : "=a" (ret)
-                              : "r" (id), "m" (_mutex_), "0" (0)
-                              : );
+                              "cmpxchgl %2, %1  \n"
+                              : "=a" (ret), "+m" (*ptr)
+                              : "r" (val), "0" (cmp)
+                              : "memory");
         return ret;
     }
 
-    void Lock() {
-        while (TryLock() != 0) {
+    void Guard() {
+        while (CompareAndSwap(&_guard_, 0, 1) != 0) {
             L4_ThreadSwitch(L4_nilthread);
         }
     }
 
-    void Unlock() {
+    void Unguard() {
+        __asm__ __volatile__ ("" ::: "memory");
+        _guard_ = 0;
+    }
+
+    void LockContended(L4_Word_t id);
+
+    void UnlockContended(L4_Word_t id);
+
+public:
+    Mutex() : _mutex_(0), _guard_(0), _head_(0), _tail_(0), _spins_(0) {}
+
+    ~Mutex() {}
+
+    void Initialize() {
         _mutex_ = 0;
+        _guard_ = 0;
+        _head_ = 0;
+        _tail_ = 0;
+        _spins_ = 0;
+    }
+
+    int TryLock() {
+        return CompareAndSwap(&_mutex_, 0, L4_MyLocalId().raw) != 0;
+    }
+
+    void Lock() {
+        L4_Word_t   id = L4_MyLocalId().raw;
+
+        if (CompareAndSwap(&_mutex_, 0, id) != 0) {
+            LockContended(id);
+        }
+    }
+
+    void Unlock() {
+        L4_Word_t   id = L4_MyLocalId().raw;
+
+        if (CompareAndSwap(&_mutex_, id, 0) != id) {
+            UnlockContended(id);
+        }
     }
 };
 
@@ -0,0 +1,126 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @file   Libraries/System/include/RWLock.h
+/// @brief  Reader-writer lock
+/// @since  October 2008
+///
+
+#ifndef ARC_RW_LOCK_H
+#define ARC_RW_LOCK_H
+
+#include <Mutex.h>
+#include <WaitQueue.h>
+#include <l4/thread.h>
+
+///
+/// A reader-writer lock that favors the readers.  A reader enters as long
+/// as no writer holds the lock, even if writers are waiting.  A writer
+/// leaving the lock wakes all the waiting readers first.  The lock is handed
+/// to the threads woken, so they do not compete for it again.
+///
+class RWLock
+{
+private:
+    Mutex       _lock;
+
+    WaitQueue   _readers;
+
+    WaitQueue   _writers;
+
+    ///
+    /// The number of the readers holding the lock, or -1 if a writer holds
+    /// it
+    ///
+    int         _active;
+
+public:
+    RWLock() : _active(0) {}
+
+    void ReadLock() {
+        _lock.Lock();
+        if (_active < 0) {
+            _readers.Sleep(&_lock);
+            return;
+        }
+        _active++;
+        _lock.Unlock();
+    }
+
+    void ReadUnlock() {
+        L4_ThreadId_t   tid = L4_nilthread;
+
+        _lock.Lock();
+        _active--;
+        if (_active == 0) {
+            tid = _writers.Dequeue();
+            if (!L4_IsNilThread(tid)) {
+                _active = -1;
+            }
+        }
+        _lock.Unlock();
+
+        if (!L4_IsNilThread(tid)) {
+            WaitQueue::Wake(tid);
+        }
+    }
+
+    void WriteLock() {
+        _lock.Lock();
+        if (_active != 0) {
+            _writers.Sleep(&_lock);
+            return;
+        }
+        _active = -1;
+        _lock.Unlock();
+    }
+
+    void WriteUnlock() {
+        L4_ThreadId_t   tid;
+
+        _lock.Lock();
+        if (!_readers.IsEmpty()) {
+            _active = 0;
+            while (!L4_IsNilThread(tid = _readers.Dequeue())) {
+                _active++;
+                WaitQueue::Wake(tid);
+            }
+        }
+        else if (!L4_IsNilThread(tid = _writers.Dequeue())) {
+            WaitQueue::Wake(tid);
+        }
+        else {
+            _active = 0;
+        }
+        _lock.Unlock();
+    }
+};
+
+#endif // ARC_RW_LOCK_H
@@ -0,0 +1,262 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @brief  Two-level radix tree keyed by page addresses
+/// @file   Libraries/System/include/RadixTree.h
+/// @since  October 2008
+///
+
+#ifndef ARC_CONTAINER_RADIX_TREE_H
+#define ARC_CONTAINER_RADIX_TREE_H
+
+#include <Debug.h>
+#include <List.h>
+#include <MapElement.h>
+#include <String.h>
+#include <System.h>
+#include <Types.h>
+#include <sys/Config.h>
+
+///
+/// A map from page-aligned addresses to pointers, laid out like the ia32
+/// page table: a directory of leaves, each of which covers LEAF_LENGTH
+/// pages.  Lookup, insertion and removal take two array accesses.  A leaf
+/// is allocated when the first page in its range is inserted and released
+/// when the last one is removed.
+///
+/// The interface follows BPlusTree so that either can be used as a mapping
+/// database.  A null value means that the key is not present, so V must be
+/// a pointer type.
+///
+template <typename K, typename V>
+class RadixTree
+{
+public:
+    static const UInt   LEAF_BITS = 10;
+    static const UInt   LEAF_LENGTH = 1U << LEAF_BITS;
+    static const UInt   DIR_BITS = sizeof(K) * 8 - PAGE_BITS - LEAF_BITS;
+    static const UInt   DIR_LENGTH = 1U << DIR_BITS;
+
+private:
+    struct Leaf {
+        V       values[LEAF_LENGTH];
+        UInt    count;
+    };
+
+    Leaf*               _dir[DIR_LENGTH];
+
+    ///
+    /// The number of entries
+    ///
+    size_t              _count;
+
+    static UInt DirIndex(K key)
+    { return static_cast<UInt>(key >> (PAGE_BITS + LEAF_BITS)); }
+
+    static UInt LeafIndex(K key)
+    { return static_cast<UInt>(key >> PAGE_BITS) & (LEAF_LENGTH - 1); }
+
+    static K Key(UInt dir, UInt leaf)
+    {
+        return (static_cast<K>(dir) << (PAGE_BITS + LEAF_BITS)) |
+               (static_cast<K>(leaf) << PAGE_BITS);
+    }
+
+public:
+    RadixTree() : _count(0)
+    {
+        for (UInt i = 0; i < DIR_LENGTH; i++) {
+            _dir[i] = 0;
+        }
+    }
+
+    virtual ~RadixTree() { Clear(); }
+
+    ///
+    /// Inserts the entry.  An existing entry of the key is overwritten.
+    ///
+    void Insert(K key, V value);
+
+    ///
+    /// Removes the entry
+    ///
+    Bool Remove(K key, V& value);
+
+    ///
+    /// Searches for the entry referenced by the key.
+    ///
+    /// @param key      the key for the search
+    /// @param value    the value to be filled
+    /// @return         true if the key is found, false otherwise
+    ///
+    Bool Search(K key, V& value)
+    {
+        Leaf* leaf = _dir[DirIndex(key)];
+        if (leaf == 0 || leaf->values[LeafIndex(key)] == 0) {
+            return FALSE;
+        }
+        value = leaf->values[LeafIndex(key)];
+        return TRUE;
+    }
+
+    ///
+    /// Replaces the entry reference by the key if the entry exists
+    ///
+    Bool Update(K key, V& value, V& save);
+
+    ///
+    /// Obtains the number of elements.
+    ///
+    size_t Length() { return _count; }
+
+    ///
+    /// Obtains the list that contains all elements in the order of the keys.
+    /// Only the allocated leaves are visited.
+    ///
+    List<MapElement<K, V>*> *ToList();
+
+    void Clear();
+
+    void Print();
+};
+
+template <typename K, typename V>
+void
+RadixTree<K, V>::Insert(K key, V value)
+{
+    Leaf*   leaf = _dir[DirIndex(key)];
+    V*      slot;
+
+    if (value == 0) {
+        return;
+    }
+
+    if (leaf == 0) {
+        leaf = new Leaf;
+        memset(leaf, 0, sizeof(Leaf));
+        _dir[DirIndex(key)] = leaf;
+    }
+
+    slot = &leaf->values[LeafIndex(key)];
+    if (*slot == 0) {
+        leaf->count++;
+        _count++;
+    }
+    *slot = value;
+}
+
+template <typename K, typename V>
+Bool
+RadixTree<K, V>::Remove(K key, V& value)
+{
+    Leaf*   leaf = _dir[DirIndex(key)];
+    V*      slot;
+
+    if (leaf == 0) {
+        return FALSE;
+    }
+
+    slot = &leaf->values[LeafIndex(key)];
+    if (*slot == 0) {
+        return FALSE;
+    }
+
+    value = *slot;
+    *slot = 0;
+    _count--;
+    if (--leaf->count == 0) {
+        _dir[DirIndex(key)] = 0;
+        delete leaf;
+    }
+    return TRUE;
+}
+
+template <typename K, typename V>
+Bool
+RadixTree<K, V>::Update(K key, V& value, V& save)
+{
+    Leaf*   leaf = _dir[DirIndex(key)];
+
+    if (leaf == 0 || leaf->values[LeafIndex(key)] == 0 || value == 0) {
+        return FALSE;
+    }
+
+    save = leaf->values[LeafIndex(key)];
+    leaf->values[LeafIndex(key)] = value;
+    return TRUE;
+}
+
+template <typename K, typename V>
+List<MapElement<K, V>*>*
+RadixTree<K, V>::ToList()
+{
+    List<MapElement<K, V>*>*    list = new List<MapElement<K, V>*>;
+
+    for (UInt i = 0; i < DIR_LENGTH; i++) {
+        Leaf* leaf = _dir[i];
+        if (leaf == 0) {
+            continue;
+        }
+        for (UInt j = 0; j < LEAF_LENGTH; j++) {
+            if (leaf->values[j] != 0) {
+                list->Append(new MapElement<K, V>(Key(i, j), leaf->values[j]));
+            }
+        }
+    }
+
+    return list;
+}
+
+template <typename K, typename V>
+void
+RadixTree<K, V>::Clear()
+{
+    for (UInt i = 0; i < DIR_LENGTH; i++) {
+        if (_dir[i] != 0) {
+            delete _dir[i];
+            _dir[i] = 0;
+        }
+    }
+    _count = 0;
+}
+
+template <typename K, typename V>
+void
+RadixTree<K, V>::Print()
+{
+    for (UInt i = 0; i < DIR_LENGTH; i++) {
+        if (_dir[i] != 0) {
+            System.Print("%.8lX: %u entries\n",
+                         static_cast<L4_Word_t>(Key(i, 0)), _dir[i]->count);
+        }
+    }
+}
+
+#endif // ARC_CONTAINER_RADIX_TREE_H
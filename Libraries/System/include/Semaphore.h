@@ -42,54 +42,94 @@
 #include <l4/thread.h>
 #include <Mutex.h>
 #include <Types.h>
+#include <WaitQueue.h>
 
+///
+/// A counting semaphore.  Down() blocks while the count is zero, and Up()
+/// blocks while the count is at the maximum unless the maximum is zero.
+/// A unit is handed directly to a thread blocked on the other side.
+///
 class Semaphore
 {
 private:
     Mutex           _mutex;
-    volatile int    _sem;
+
+    ///
+    /// The threads blocked in Down()
+    ///
+    WaitQueue       _takers;
+
+    ///
+    /// The threads blocked in Up()
+    ///
+    WaitQueue       _givers;
+
+    int             _sem;
     int             _max;
 
 public:
-    Semaphore(size_t n) : _max(n) {};
+    Semaphore(size_t n, size_t count = 0) : _sem(count), _max(n) {};
 
     void Up();
     void Down();
+
+    ///
+    /// Sets the count.  No thread may be blocked on the semaphore.
+    ///
+    void Reset(size_t count = 0);
 };
 
 inline void
 Semaphore::Up()
 {
-begin:
-    while (_max != 0 && _sem == _max) {
-        L4_ThreadSwitch(L4_nilthread);
-    }
+    L4_ThreadId_t   tid;
+
     _mutex.Lock();
-    if (_max == 0 || _sem < _max) {
-        _sem++;
-    }
-    else {
+    tid = _takers.Dequeue();
+    if (!L4_IsNilThread(tid)) {
         _mutex.Unlock();
-        goto begin;
+        WaitQueue::Wake(tid);
+        return;
     }
+
+    if (_max != 0 && _sem == _max) {
+        // The taker that wakes this thread counts the unit.
+        _givers.Sleep(&_mutex);
+        return;
+    }
+    _sem++;
     _mutex.Unlock();
 }
 
 inline void
 Semaphore::Down()
 {
-begin:
-    while (_sem == 0) {
-        L4_ThreadSwitch(L4_nilthread);
-    }
+    L4_ThreadId_t   tid;
+
     _mutex.Lock();
-    if (_sem > 0) {
-        _sem--;
+    if (_sem == 0) {
+        // The giver that wakes this thread hands the unit.
+        _takers.Sleep(&_mutex);
+        return;
     }
-    else {
-        _mutex.Unlock();
-        goto begin;
+
+    _sem--;
+    tid = _givers.Dequeue();
+    if (!L4_IsNilThread(tid)) {
+        _sem++;
+    }
+    _mutex.Unlock();
+
+    if (!L4_IsNilThread(tid)) {
+        WaitQueue::Wake(tid);
     }
+}
+
+inline void
+Semaphore::Reset(size_t count)
+{
+    _mutex.Lock();
+    _sem = count;
     _mutex.Unlock();
 }
 
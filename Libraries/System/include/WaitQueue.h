@@ -0,0 +1,117 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @file   Libraries/System/include/WaitQueue.h
+/// @brief  The queue of the threads blocked on a synchronization object
+/// @since  October 2008
+///
+
+#ifndef ARC_WAIT_QUEUE_H
+#define ARC_WAIT_QUEUE_H
+
+#include <Mutex.h>
+#include <Types.h>
+#include <l4/thread.h>
+#include <l4/types.h>
+
+///
+/// A FIFO queue of blocked threads.  The queue has no lock of its own; it is
+/// guarded by the mutex of the object that uses it.  A thread sleeps until
+/// another thread of the same address space dequeues it and sends it a wake
+/// message.  The waker may send before the sleeper reaches the receive; the
+/// send just blocks until then, so no wake-up is lost.
+///
+/// A sleeping thread receives from any local thread.  It must not be the
+/// target of other IPC within the address space while it sleeps.
+///
+class WaitQueue
+{
+public:
+    ///
+    /// The label of the wake message
+    ///
+    static const L4_Word_t  WAKE_LABEL = 0xFFF0;
+
+private:
+    ///
+    /// A sleeping thread.  It lives on the stack of the thread.
+    ///
+    struct Waiter {
+        L4_ThreadId_t   tid;
+        Waiter*         next;
+    };
+
+    Waiter*     _head;
+
+    Waiter*     _tail;
+
+public:
+    WaitQueue() : _head(0), _tail(0) {}
+
+    void Initialize() {
+        _head = 0;
+        _tail = 0;
+    }
+
+    Bool IsEmpty() const { return _head == 0; }
+
+    ///
+    /// Queues the calling thread, releases the guard and blocks until the
+    /// thread is woken.  The guard is not taken again.
+    ///
+    /// @param guard        the mutex held by the caller
+    ///
+    void Sleep(Mutex* guard);
+
+    ///
+    /// Removes the first thread from the queue.  The guard must be held.
+    ///
+    /// @return             the thread to wake, or nil if none
+    ///
+    L4_ThreadId_t Dequeue() {
+        Waiter* w = _head;
+
+        if (w == 0) {
+            return L4_nilthread;
+        }
+        _head = w->next;
+        if (_head == 0) {
+            _tail = 0;
+        }
+        return w->tid;
+    }
+
+    ///
+    /// Wakes the thread dequeued.  MR0 is preserved.
+    ///
+    static void Wake(L4_ThreadId_t tid);
+};
+
+#endif // ARC_WAIT_QUEUE_H
@@ -0,0 +1,146 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @file   Libraries/System/src/Mutex.cpp
+/// @brief  The contended paths of the mutex
+/// @since  October 2008
+///
+
+#include <Mutex.h>
+#include <l4/ipc.h>
+#include <l4/message.h>
+#include <l4/types.h>
+
+static inline L4_ThreadId_t
+ThreadId(L4_Word_t raw)
+{
+    L4_ThreadId_t   tid;
+
+    tid.raw = raw;
+    return tid;
+}
+
+void
+Mutex::LockContended(L4_Word_t id)
+{
+    Waiter      self;
+    L4_Word_t   mr0;
+    L4_MsgTag_t tag;
+    int         limit;
+
+    // Spin while the owner is likely to release the lock soon.  The limit
+    // follows the spins that were enough before.
+    limit = _spins_ * 2 + 10;
+    if (limit > MAX_SPIN) {
+        limit = MAX_SPIN;
+    }
+    for (int i = 0; i < limit; i++) {
+        __asm__ __volatile__ ("pause" ::: "memory");
+        if (_mutex_ == 0 && CompareAndSwap(&_mutex_, 0, id) == 0) {
+            _spins_ += (i - _spins_) / 8;
+            return;
+        }
+    }
+    _spins_ += (limit - _spins_) / 8;
+
+    self.id = id;
+    self.next = 0;
+
+    Guard();
+    for (;;) {
+        L4_Word_t   owner = _mutex_;
+
+        if (owner == 0) {
+            if (CompareAndSwap(&_mutex_, 0, id) == 0) {
+                Unguard();
+                return;
+            }
+            continue;
+        }
+
+        // Once the flag is set, the owner cannot release the lock without
+        // the guard.
+        if ((owner & CONTENDED) != 0 ||
+            CompareAndSwap(&_mutex_, owner, owner | CONTENDED) == owner) {
+            self.pred = _tail_ != 0 ? _tail_->id : (owner & ~CONTENDED);
+            break;
+        }
+    }
+
+    if (_tail_ != 0) {
+        _tail_->next = &self;
+    }
+    else {
+        _head_ = &self;
+    }
+    _tail_ = &self;
+    Unguard();
+
+    // The lock word already names this thread when the message arrives.
+    L4_StoreMR(0, &mr0);
+    do {
+        tag = L4_Receive(ThreadId(self.pred));
+    } while (L4_IpcFailed(tag));
+    L4_LoadMR(0, mr0);
+}
+
+void
+Mutex::UnlockContended(L4_Word_t id)
+{
+    Waiter*     next;
+    L4_Word_t   to;
+    L4_Word_t   mr0;
+
+    Guard();
+    next = _head_;
+    if (next == 0) {
+        _mutex_ = 0;
+        Unguard();
+        return;
+    }
+
+    _head_ = next->next;
+    if (_head_ == 0) {
+        _tail_ = 0;
+        _mutex_ = next->id;
+    }
+    else {
+        _mutex_ = next->id | CONTENDED;
+    }
+
+    // The waiter may return and drop its stack once the guard is released.
+    to = next->id;
+    Unguard();
+
+    L4_StoreMR(0, &mr0);
+    L4_LoadMR(0, 0);
+    L4_Send(ThreadId(to));
+    L4_LoadMR(0, mr0);
+}
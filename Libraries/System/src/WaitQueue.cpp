@@ -0,0 +1,85 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @file   Libraries/System/src/WaitQueue.cpp
+/// @brief  The queue of the threads blocked on a synchronization object
+/// @since  October 2008
+///
+
+#include <Mutex.h>
+#include <WaitQueue.h>
+#include <l4/ipc.h>
+#include <l4/message.h>
+#include <l4/types.h>
+
+void
+WaitQueue::Sleep(Mutex* guard)
+{
+    Waiter      self;
+    L4_Word_t   mr0;
+    L4_MsgTag_t tag;
+
+    self.tid = L4_MyLocalId();
+    self.next = 0;
+    if (_tail != 0) {
+        _tail->next = &self;
+    }
+    else {
+        _head = &self;
+    }
+    _tail = &self;
+    guard->Unlock();
+
+    // The waker sends exactly one message.  A canceled receive is tried
+    // again.
+    L4_StoreMR(0, &mr0);
+    for (;;) {
+        tag = L4_Receive(L4_anylocalthread);
+        if (L4_IpcSucceeded(tag) && L4_Label(tag) == WAKE_LABEL) {
+            break;
+        }
+    }
+    L4_LoadMR(0, mr0);
+}
+
+void
+WaitQueue::Wake(L4_ThreadId_t tid)
+{
+    L4_MsgTag_t tag;
+    L4_Word_t   mr0;
+
+    tag.raw = 0;
+    tag.X.label = WAKE_LABEL;
+
+    L4_StoreMR(0, &mr0);
+    L4_LoadMR(0, tag.raw);
+    L4_Send(tid);
+    L4_LoadMR(0, mr0);
+}
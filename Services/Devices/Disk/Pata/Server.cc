@@ -57,8 +57,13 @@ class PataServer : public SelfHealingSessionServer
 protected:
     Port*       _port;
 
+    UByte Transfer(UInt device, UInt pos, UInt sectors, addr_t buf,
+                   Bool write);
+
     virtual stat_t HandleGet(const L4_ThreadId_t& tid, L4_Msg_t& msg);
     virtual stat_t HandlePut(const L4_ThreadId_t& tid, L4_Msg_t& msg);
+    virtual void HandleRequest(SessionControlBlock* c, const IoRequest& req,
+                               addr_t buf, IoCompletion& cmp);
 public:
     virtual const char* const Name() { return "pata"; }
 
@@ -78,10 +83,37 @@ public:
 };
 
 
+UByte
+PataServer::Transfer(UInt device, UInt pos, UInt sectors, addr_t buf,
+                     Bool write)
+{
+    AtaCommandBlock cb;
+
+    // Setup ATA command block
+    cb.Initialize();
+    cb.count = sectors;
+    cb.SetLba(pos);
+    cb.command = write ? ATA_CMD_WRITE_MULTI : ATA_CMD_READ_MULTI;
+    //cb.command = ATA_CMD_READ_DMA;
+    //cb.command = ATA_CMD_IDENTIFY_DMA;
+
+    if (device % 2 == 0) {
+        cb.Device0();
+    }
+    else {
+        cb.Device1();
+    }
+
+    if (write) {
+        return _port->DataOut(&cb, reinterpret_cast<const void*>(buf));
+    }
+    return _port->DataIn(&cb, buf);
+    //return _port->DMATransfer(&cb, buf);
+}
+
 stat_t
 PataServer::HandleGet(const L4_ThreadId_t& tid, L4_Msg_t& msg)
 {
-    AtaCommandBlock cb;
     UInt            device;
     UInt            sectors;
     UInt            pos;
@@ -106,23 +138,7 @@ PataServer::HandleGet(const L4_ThreadId_t& tid, L4_Msg_t& msg)
     pos = L4_Get(&msg, 2);
     sectors = L4_Get(&msg, 3);
 
-    // Setup ATA command block
-    cb.Initialize();
-    cb.count = sectors;
-    cb.SetLba(pos);
-    cb.command = ATA_CMD_READ_MULTI;
-    //cb.command = ATA_CMD_READ_DMA;
-    //cb.command = ATA_CMD_IDENTIFY_DMA;
-
-    if (device % 2 == 0) {
-        cb.Device0();
-    }
-    else {
-        cb.Device1();
-    }
-
-    UByte err = _port->DataIn(&cb, base);
-    //UByte err = _port->DMATransfer(&cb, base);
+    UByte err = Transfer(device, pos, sectors, base, FALSE);
     if (err != ERR_NONE) {
         DOUT("ERROR (0x%.2X)\n", err);
         //return ERR_NONE;
@@ -142,7 +158,6 @@ PataServer::HandleGet(const L4_ThreadId_t& tid, L4_Msg_t& msg)
 stat_t
 PataServer::HandlePut(const L4_ThreadId_t& tid, L4_Msg_t& msg)
 {
-    AtaCommandBlock cb;
     UInt            device;
     UInt            sectors;
     UInt            loc;
@@ -168,22 +183,52 @@ PataServer::HandlePut(const L4_ThreadId_t& tid, L4_Msg_t& msg)
     loc = L4_Get(&msg, 2);
     sectors = L4_Get(&msg, 3);
 
-    cb.Initialize();
-    cb.count = sectors;
-    cb.SetLba(loc);
-    cb.command = ATA_CMD_WRITE_MULTI;
+    Transfer(device, loc, sectors, base, TRUE);
 
-    if (device % 2 == 0) {
-        cb.Device0();
+    EXIT;
+    return Ipc::ReturnError(&msg, ERR_NONE);
+}
+
+///
+/// Processes a request from the ring.  The argument of the request is the
+/// device number; the offset and the length are in sectors and bytes.
+///
+void
+PataServer::HandleRequest(SessionControlBlock* c, const IoRequest& req,
+                          addr_t buf, IoCompletion& cmp)
+{
+    UInt    device = req.arg & 0xFFFF;
+    UInt    sectors = req.length / ATA_SECTOR_SIZE;
+
+    cmp.result = 0;
+    if (!(0 <= device && device < 4)) {
+        cmp.status = ERR_NOT_FOUND;
+        return;
     }
-    else {
-        cb.Device1();
+
+    // A count of 0 means 256 sectors to the controller.
+    if (req.length % ATA_SECTOR_SIZE != 0 || sectors < 1 || 256 < sectors) {
+        cmp.status = ERR_INVALID_ARGUMENTS;
+        return;
     }
 
-    _port->DataOut(&cb, reinterpret_cast<const void*>(base));
+    switch (req.op) {
+        case SessionRing::OP_READ:
+            cmp.status = Transfer(device, req.offset, sectors, buf, FALSE) ==
+                         ERR_NONE ? ERR_NONE : ERR_UNKNOWN;
+            break;
+        case SessionRing::OP_WRITE:
+            cmp.status = Transfer(device, req.offset, sectors, buf, TRUE) ==
+                         ERR_NONE ? ERR_NONE : ERR_UNKNOWN;
+            break;
+        default:
+            cmp.status = ERR_INVALID_ARGUMENTS;
+            return;
+    }
 
-    EXIT;
-    return Ipc::ReturnError(&msg, ERR_NONE);
+    if (cmp.status == ERR_NONE) {
+        cmp.result = sectors * ATA_SECTOR_SIZE;
+    }
 }
 
 stat_t
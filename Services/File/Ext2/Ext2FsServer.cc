@@ -38,7 +38,10 @@
 #include <arc/server.h>
 #include <Disk.h>
 #include <Ipc.h>
+#include <MemoryManager.h>
 #include <Mutex.h>
+#include <PageAllocator.h>
+#include <Protocol.h>
 #include <SelfHealingServer.h>
 #include <String.h>
 #include <l4/types.h>
@@ -78,6 +81,18 @@ static Byte         __index[SelfHealingSessionServer::NUM_CLIENTS] IS_PERSISTENT
 static Ext2File     __file_container[SelfHealingSessionServer::NUM_CLIENTS] IS_PERSISTENT;
 static Ext2Inode    __inode_container[SelfHealingSessionServer::NUM_CLIENTS] IS_PERSISTENT;
 
+///
+/// Pages lent to a client by HandleMap.  They are released at the next
+/// request of the client, when the client has taken them.
+///
+struct Loan
+{
+    addr_t  base;
+    size_t  count;
+};
+
+static Loan         __loan[SelfHealingSessionServer::NUM_CLIENTS] IS_PERSISTENT;
+
 Int
 Ext2FsServer::AllocateFileContainer()
 {
@@ -96,11 +111,46 @@ Ext2FsServer::ReleaseFileContainer(Int i)
     __index[i] = 0;
 }
 
+void
+Ext2FsServer::ReleaseLoan(Int i)
+{
+    if (__loan[i].count > 0) {
+        // The moved pages are no longer ours.  This only returns the
+        // virtual region.
+        pfree(__loan[i].base, __loan[i].count);
+        __loan[i].base = 0;
+        __loan[i].count = 0;
+    }
+}
+
+///
+/// Obtains the optional offset of the data in the shared memory, which
+/// follows the length and the file offset of Get and Put.  The length is
+/// limited to the rest of the shared memory.
+///
+addr_t
+Ext2FsServer::ShmOffset(SessionControlBlock* c, L4_Msg_t& msg, size_t* length)
+{
+    size_t  size = c->size * PAGE_SIZE;
+    addr_t  shm = 0;
+
+    if (L4_UntypedWords(L4_MsgTag(&msg)) > 3) {
+        shm = L4_Get(&msg, 3);
+    }
+    if (size < shm) {
+        shm = size;
+    }
+    if (size - shm < *length) {
+        *length = size - shm;
+    }
+    return shm;
+}
+
 stat_t
 Ext2FsServer::HandleBegin(const L4_ThreadId_t& tid, L4_Msg_t& msg)
 {
     L4_Word_t   mode;
-    L4_Word_t   reg[3];
+    L4_Word_t   reg[4];
     addr_t      base;
     size_t      len;
     char*       path;
@@ -138,7 +188,8 @@ Ext2FsServer::HandleBegin(const L4_ThreadId_t& tid, L4_Msg_t& msg)
     reg[0] = 0;
     reg[1] = file->Ino();
     reg[2] = file->Size();
-    L4_Put(&msg, 0, 3, reg, 0, 0);
+    reg[3] = file->Inode()->mtime;
+    L4_Put(&msg, 0, 4, reg, 0, 0);
 
     index = AllocateFileContainer();
     // Deep copy
@@ -167,6 +218,7 @@ Ext2FsServer::HandleEnd(const L4_ThreadId_t& tid, L4_Msg_t& msg)
         DOUT("persistent file object released: slot %d @ %p\n",
              c->data, &__file_container[c->data]);
         __file_container[c->data].Flush();
+        ReleaseLoan(c->data);
         ReleaseFileContainer(c->data);
         c->data = -1UL;
     }
@@ -187,6 +239,7 @@ Ext2FsServer::HandleGet(const L4_ThreadId_t& tid, L4_Msg_t& msg)
     L4_Word_t               offset;
     L4_Word_t               base;
     L4_Word_t               reg[2];
+    addr_t                  shm;
     SessionControlBlock*    c;
     Ext2File*               file;
 
@@ -202,9 +255,10 @@ Ext2FsServer::HandleGet(const L4_ThreadId_t& tid, L4_Msg_t& msg)
 
     length = static_cast<size_t>(L4_Get(&msg, 1));
     offset = L4_Get(&msg, 2);
+    shm = ShmOffset(c, msg, &length);
 
     file = &__file_container[c->data];
-    file->Read(reinterpret_cast<void*>(c->base), length, offset, &read);
+    file->Read(reinterpret_cast<void*>(c->base + shm), length, offset, &read);
     DOUT("len %lu offset %lu read %lu\n", length, offset, read);
 
     /*
@@ -233,6 +287,7 @@ Ext2FsServer::HandlePut(const L4_ThreadId_t& tid, L4_Msg_t& msg)
     L4_Word_t               offset;
     L4_Word_t               base;
     L4_Word_t               reg[2];
+    addr_t                  shm;
     SessionControlBlock*    c;
     Ext2File*               file;
 
@@ -246,11 +301,12 @@ Ext2FsServer::HandlePut(const L4_ThreadId_t& tid, L4_Msg_t& msg)
         return ERR_NONE;
     }
 
-    length = (size_t)L4_Get(&msg, 2);
-    offset = L4_Get(&msg, 3);
+    length = (size_t)L4_Get(&msg, 1);
+    offset = L4_Get(&msg, 2);
+    shm = ShmOffset(c, msg, &length);
 
     file = &__file_container[c->data];
-    file->Write(reinterpret_cast<const void*>(c->base), length, offset,
+    file->Write(reinterpret_cast<const void*>(c->base + shm), length, offset,
                 &written);
 
     reg[1] = written;
@@ -260,6 +316,104 @@ Ext2FsServer::HandlePut(const L4_ThreadId_t& tid, L4_Msg_t& msg)
     return ERR_NONE;
 }
 
+///
+/// Reads the file into fresh pages reserved for the client.  The client
+/// moves them into its buffer, so the data is not copied out of the shared
+/// memory.
+///
+stat_t
+Ext2FsServer::HandleMap(const L4_ThreadId_t& tid, L4_Msg_t& msg)
+{
+    size_t                  read;
+    size_t                  length;
+    size_t                  count;
+    L4_Word_t               offset;
+    L4_Word_t               base;
+    L4_Word_t               reg[3];
+    addr_t                  pages;
+    SessionControlBlock*    c;
+    Ext2File*               file;
+
+    ENTER;
+
+    if (Ipc::CheckPayload(&msg, 0, 3)) {
+        L4_Clear(&msg);
+        L4_Set_Label(&msg, ERR_INVALID_ARGUMENTS);
+        return ERR_NONE;
+    }
+
+    base = L4_Get(&msg, 0);
+    c = Search(tid, base);
+    if (c == 0 || c->data == static_cast<word_t>(-1)) {
+        L4_Clear(&msg);
+        L4_Set_Label(&msg, ERR_NOT_FOUND);
+        return ERR_NONE;
+    }
+
+    // The pages lent at the last request have been taken by now.
+    ReleaseLoan(c->data);
+
+    length = static_cast<size_t>(L4_Get(&msg, 1));
+    offset = L4_Get(&msg, 2);
+    if (MemoryManager::MAX_MAP_PAGES * PAGE_SIZE < length) {
+        length = MemoryManager::MAX_MAP_PAGES * PAGE_SIZE;
+    }
+
+    count = PAGE_ALIGN(length) >> PAGE_BITS;
+    // The client takes the pages with Pager.Move().
+    pages = palloc_shm(count, tid, L4_ReadWriteOnly | MSG_PAGER_MAP_MOVE);
+    if (pages == 0) {
+        L4_Clear(&msg);
+        L4_Set_Label(&msg, ERR_OUT_OF_MEMORY);
+        return ERR_NONE;
+    }
+
+    file = &__file_container[c->data];
+    file->Read(reinterpret_cast<void*>(pages), length, offset, &read);
+    DOUT("map len %lu offset %lu read %lu\n", length, offset, read);
+
+    __loan[c->data].base = pages;
+    __loan[c->data].count = count;
+
+    reg[0] = pages;
+    reg[1] = PAGE_ALIGN(read) >> PAGE_BITS;
+    reg[2] = read;
+    L4_Put(&msg, 0, 3, reg, 0, 0);
+
+    EXIT;
+    return ERR_NONE;
+}
+
+void
+Ext2FsServer::HandleRequest(SessionControlBlock* c, const IoRequest& req,
+                            addr_t buf, IoCompletion& cmp)
+{
+    Ext2File*   file;
+    size_t      len = 0;
+
+    if (c->data == static_cast<word_t>(-1)) {
+        cmp.status = ERR_NOT_FOUND;
+        cmp.result = 0;
+        return;
+    }
+
+    file = &__file_container[c->data];
+    switch (req.op) {
+        case SessionRing::OP_READ:
+            cmp.status = file->Read(reinterpret_cast<void*>(buf), req.length,
+                                    req.offset, &len);
+            break;
+        case SessionRing::OP_WRITE:
+            cmp.status = file->Write(reinterpret_cast<const void*>(buf),
+                                     req.length, req.offset, &len);
+            break;
+        default:
+            cmp.status = ERR_INVALID_ARGUMENTS;
+            break;
+    }
+    cmp.result = len;
+}
+
 const char* Ext2FsServer::DEFAULT_DISK_SERVER = "pata";
 
 //SECTION(SEC_INIT)
@@ -65,9 +65,14 @@ protected:
     virtual stat_t HandleEnd(const L4_ThreadId_t& tid, L4_Msg_t& msg);
     virtual stat_t HandleGet(const L4_ThreadId_t& tid, L4_Msg_t& msg);
     virtual stat_t HandlePut(const L4_ThreadId_t& tid, L4_Msg_t& msg);
+    virtual stat_t HandleMap(const L4_ThreadId_t& tid, L4_Msg_t& msg);
+    virtual void HandleRequest(SessionControlBlock* c, const IoRequest& req,
+                               addr_t buf, IoCompletion& cmp);
 
     Int AllocateFileContainer();
     void ReleaseFileContainer(Int i);
+    void ReleaseLoan(Int i);
+    addr_t ShmOffset(SessionControlBlock* c, L4_Msg_t& msg, size_t* length);
     stat_t Initialize0(Int argc, char* argv[]);
 
 public:
@@ -46,9 +46,23 @@
 #include <l4/bootinfo.h>
 #include <l4/kip.h>
 
+///
+/// Serves the files in the RAM disk.  The files never change, so the
+/// sessions are served by worker threads in parallel.
+///
 class RamFsServer : public SessionServer
 {
 protected:
+    ///
+    /// The number of the worker threads
+    ///
+    static const size_t WORKERS = 2;
+
+    ///
+    /// The longest file name including the terminator
+    ///
+    static const size_t MAX_NAME_LENGTH = 256;
+
     addr_t  _ramfs_start;
     addr_t  _ramfs_end;
     size_t  _ramfs_size;
@@ -138,12 +152,12 @@ struct RamClient : public SessionClient
 void
 RamFsServer::Register(const L4_ThreadId_t& tid, addr_t base, size_t size)
 {
-    RamClient* c = new RamClient(tid, base, size);
+    RamClient* c = new RamClient(FindSpace(tid), base, size);
     if (c == 0) {
         FATAL("out of memory");
         return;
     }
-    _clients.Append(c);
+    Insert(c, tid);
 }
 
 
@@ -152,18 +166,29 @@ RamFsServer::HandleBegin(const L4_ThreadId_t& tid, L4_Msg_t& msg)
 {
     addr_t      base;
     RamClient*  client;
-    size_t      name_len;
-    char*       name;
-    L4_Word_t   reg[3];
+    char        name[MAX_NAME_LENGTH];
+    size_t      len;
+    L4_Word_t   reg[4];
 
     ENTER;
 
     base = L4_Get(&msg, 0);
     client = static_cast<RamClient*>(Search(tid, base));
+    if (client == 0) {
+        L4_Clear(&msg);
+        L4_Set_Label(&msg, ERR_NOT_FOUND);
+        return ERR_NONE;
+    }
 
-    name_len = strlen(reinterpret_cast<char*>(client->base)) + 1;
-    name = reinterpret_cast<char*>(malloc(name_len));
-    memcpy(name, reinterpret_cast<char*>(client->base), name_len);
+    // The client may rewrite the shared memory at any time.  Take a
+    // terminated copy of the name on the stack; the heap allocator is not
+    // safe to call from the workers.
+    len = client->size * PAGE_SIZE;
+    if (MAX_NAME_LENGTH - 1 < len) {
+        len = MAX_NAME_LENGTH - 1;
+    }
+    memcpy(name, reinterpret_cast<const void*>(client->base), len);
+    name[len] = '\0';
 
     if ((client->file = SearchFile(name)) == 0) {
         L4_Clear(&msg);
@@ -173,12 +198,12 @@ RamFsServer::HandleBegin(const L4_ThreadId_t& tid, L4_Msg_t& msg)
 
     DOUT("open '%s' size %d\n", name, GetFileSize(client->file));
 
-    mfree(name);
-
     reg[0] = 0;
     reg[1] = 0;
     reg[2] = GetFileSize(client->file);
-    L4_Put(&msg, 0, 3, reg, 0, 0);
+    // The files in the RAM never change.
+    reg[3] = 0;
+    L4_Put(&msg, 0, 4, reg, 0, 0);
 
     EXIT;
     return ERR_NONE;
@@ -275,7 +300,7 @@ RamFsServer::Initialize(Int argc, char* argv[])
 
     Dump();
 
-    return ERR_NONE;
+    return StartWorkers(WORKERS);
 }
 
 ARC_SERVER(RamFsServer)
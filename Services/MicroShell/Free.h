@@ -6,11 +6,27 @@
 #include <System.h>
 #include <Ipc.h>
 
+///
+/// Shows the memory statistics of the root task.
+///
+///   free [-o] [-s]
+///
+///   -o    free blocks of each order in the buddy allocator
+///   -s    resident pages of each address space
+///
 class FreeCommand : public Command
 {
 private:
     static const char* NAME;
 
+    stat_t Query(L4_Word_t first, L4_Msg_t* msg)
+    {
+        L4_Put(msg, MSG_ROOT_MEM_STAT, 1, &first, 0, 0);
+        return Ipc::Call(L4_Pager(), msg, msg);
+    }
+
+    stat_t PrintSpaces(L4_Msg_t* msg, L4_Word_t base);
+
 public:
     virtual Bool Match(const char* str, size_t len)
     {
@@ -21,18 +37,74 @@ public:
     {
         stat_t      err;
         L4_Msg_t    msg;
+        L4_Word_t   orders;
+        Bool        show_orders = FALSE;
+        Bool        show_spaces = FALSE;
+
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "-o") == 0) {
+                show_orders = TRUE;
+            }
+            else if (strcmp(argv[i], "-s") == 0) {
+                show_spaces = TRUE;
+            }
+        }
 
-        L4_Put(&msg, MSG_ROOT_FREE_COUNT, 0, 0, 0, 0);
-        err = Ipc::Call(L4_Pager(), &msg, &msg);
+        err = Query(0, &msg);
         if (err != ERR_NONE) {
             return err;
         }
 
-        System.Print("Total     Free\n");
-        System.Print("%8ld  %8ld\n", L4_Get(&msg, 1), L4_Get(&msg, 0));
+        System.Print("Total     Free      Used      Cached\n");
+        System.Print("%8lu  %8lu  %8lu  %8lu\n",
+                     L4_Get(&msg, 0), L4_Get(&msg, 1), L4_Get(&msg, 2),
+                     L4_Get(&msg, 3));
+        System.Print("Shared    COW       Snapshot\n");
+        System.Print("%8lu  %8lu  %8lu\n",
+                     L4_Get(&msg, 4), L4_Get(&msg, 5), L4_Get(&msg, 6));
+
+        orders = L4_Get(&msg, 7);
+        if (show_orders) {
+            System.Print("Order     Blocks\n");
+            for (L4_Word_t i = 0; i < orders; i++) {
+                System.Print("%8lu  %8lu\n", i, L4_Get(&msg, 8 + i));
+            }
+        }
 
+        if (show_spaces) {
+            return PrintSpaces(&msg, 8 + orders);
+        }
         return ERR_NONE;
     }
 };
 
+inline stat_t
+FreeCommand::PrintSpaces(L4_Msg_t* msg, L4_Word_t base)
+{
+    L4_Word_t   first = 0;
+    L4_Word_t   count;
+    stat_t      err;
+
+    System.Print("Space     Resident\n");
+    for (;;) {
+        count = L4_Get(msg, base);
+        for (L4_Word_t i = 0; i < count; i++) {
+            System.Print("%.8lX  %8lu\n",
+                         L4_Get(msg, base + 1 + i * 2),
+                         L4_Get(msg, base + 2 + i * 2));
+        }
+        if (base + 1 + count * 2 < __L4_NUM_MRS - 2) {
+            break;
+        }
+
+        // The reply is full.  Ask for the rest.
+        first += count;
+        err = Query(first, msg);
+        if (err != ERR_NONE) {
+            return err;
+        }
+    }
+    return ERR_NONE;
+}
+
 #endif // ARC_MICRO_SHELL_FREE_COMMAND_H
@@ -0,0 +1,132 @@
+#ifndef ARC_MICRO_SHELL_PROF_COMMAND_H
+#define ARC_MICRO_SHELL_PROF_COMMAND_H
+
+#include "Command.h"
+#include <Ipc.h>
+#include <IpcProfile.h>
+#include <NameService.h>
+#include <String.h>
+#include <System.h>
+#include <Types.h>
+
+///
+/// Shows the request statistics of the pager or a server.
+///
+///   prof [pager|<server>] [on|off|reset]
+///
+class ProfCommand : public Command
+{
+private:
+    static ULong Join(L4_Msg_t* msg, UInt i)
+    {
+        return (static_cast<ULong>(L4_Get(msg, i + 1)) << 32) |
+               L4_Get(msg, i);
+    }
+
+    static stat_t Query(L4_ThreadId_t tid, L4_Word_t label, L4_Word_t op,
+                        L4_Word_t index, L4_Msg_t* msg)
+    {
+        L4_Word_t   reg[2];
+
+        reg[0] = op;
+        reg[1] = index;
+        L4_Put(msg, label, 2, reg, 0, 0);
+        return Ipc::Call(tid, msg, msg);
+    }
+
+    stat_t Dump(L4_ThreadId_t tid, L4_Word_t label);
+
+public:
+    virtual Bool Match(const char* str, size_t len)
+    {
+        const char* NAME = "prof";
+        return (strncmp(str, NAME, strlen(NAME)) == 0);
+    }
+
+    virtual stat_t Execute(int argc, char* argv[]);
+};
+
+inline stat_t
+ProfCommand::Dump(L4_ThreadId_t tid, L4_Word_t label)
+{
+    L4_Msg_t    msg;
+    L4_Word_t   labels;
+    stat_t      err;
+
+    err = Query(tid, label, IpcProfile::OP_SUMMARY, 0, &msg);
+    if (err != ERR_NONE) {
+        System.Print("profiling is not enabled\n");
+        return ERR_NONE;
+    }
+
+    labels = L4_Get(&msg, 1);
+    System.Print("%s, idle %llu cycles, %lu dropped\n",
+                 L4_Get(&msg, 0) ? "enabled" : "disabled",
+                 Join(&msg, 2), L4_Get(&msg, 4));
+    System.Print("LABEL   COUNT     AVERAGE   MAX       QUEUE\n");
+
+    for (L4_Word_t i = 0; i < labels; i++) {
+        L4_Word_t   count;
+
+        err = Query(tid, label, IpcProfile::OP_ENTRY, i, &msg);
+        if (err != ERR_NONE) {
+            break;
+        }
+
+        count = L4_Get(&msg, 1);
+        if (count == 0) {
+            continue;
+        }
+
+        System.Print("%.4lX    %-8lu  %-8llu  %-8lu  %-8llu\n",
+                     L4_Get(&msg, 0), count, Join(&msg, 2) / count,
+                     L4_Get(&msg, 6), Join(&msg, 4) / count);
+        System.Print("       ");
+        for (UInt j = 0; j < IpcProfile::HISTOGRAM_LENGTH; j++) {
+            System.Print(" %lu", L4_Get(&msg, 7 + j));
+        }
+        System.Print("\n");
+    }
+
+    return ERR_NONE;
+}
+
+inline stat_t
+ProfCommand::Execute(int argc, char* argv[])
+{
+    L4_ThreadId_t   tid = L4_Pager();
+    L4_Word_t       label = MSG_PAGER_PROFILE;
+    L4_Msg_t        msg;
+    L4_Word_t       op;
+    stat_t          err;
+
+    if (argc > 1 && strcmp(argv[1], "pager") != 0) {
+        err = NameService::Get(argv[1], &tid);
+        if (err != ERR_NONE) {
+            System.Print("%s not found\n", argv[1]);
+            return ERR_NONE;
+        }
+        label = MSG_SERVER_PROFILE;
+    }
+
+    if (argc < 3) {
+        return Dump(tid, label);
+    }
+
+    if (strcmp(argv[2], "on") == 0) {
+        op = IpcProfile::OP_ENABLE;
+    }
+    else if (strcmp(argv[2], "off") == 0) {
+        op = IpcProfile::OP_DISABLE;
+    }
+    else if (strcmp(argv[2], "reset") == 0) {
+        op = IpcProfile::OP_RESET;
+    }
+    else {
+        return ERR_INVALID_ARGUMENTS;
+    }
+
+    return Query(tid, label, op, 0, &msg);
+}
+
+#endif // ARC_MICRO_SHELL_PROF_COMMAND_H
@@ -49,6 +49,7 @@
 #include "Exec.h"
 #include "List.h"
 #include "Free.h"
+#include "Prof.h"
 
 #define DEFAULT_FS  "ram"
 
@@ -68,6 +69,7 @@ main()
     static ExecCommand      exec;
     static ListCommand      list;
     static FreeCommand      freemem;
+    static ProfCommand      prof;
 
     Parser parser;
 
@@ -78,6 +80,7 @@ main()
     parser.Register(&ps);
     parser.Register(&kill);
     parser.Register(&freemem);
+    parser.Register(&prof);
 
     parser.Register(&fexec);
     parser.Register(&exec);
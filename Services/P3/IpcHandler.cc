@@ -128,6 +128,7 @@ begin:
                 break;
             case MSG_PAGER_UNMAP:
             case MSG_PAGER_PHYS:
+            case MSG_PAGER_PROFILE:
                 err = Ipc::Call(L4_Pager(), &msg, &msg);
                 if (err == ERR_NOT_FOUND) {
                     err = ERR_NONE;
@@ -152,6 +153,13 @@ begin:
             case MSG_ROOT_INJECT:
             case MSG_ROOT_FIND_AS:
             case MSG_ROOT_FREE_COUNT:
+            case MSG_ROOT_FAULT_AROUND:
+            case MSG_ROOT_MEM_STAT:
+            case MSG_ROOT_CLEAN_POOL:
+            case MSG_ROOT_SWAP:
+            case MSG_ROOT_MERGE:
+            case MSG_ROOT_SNAPSHOT_DEPTH:
+            case MSG_ROOT_SNAPSHOT_MODE:
                 err = Ipc::Call(Pel::RootTask(), &msg, &msg);
                 break;
             case MSG_ROOT_NS:
@@ -182,16 +190,21 @@ exit:
 stat_t
 IpcHandler::HandleStartThread(L4_Msg_t *msg)
 {
-    L4_ThreadId_t   tid;
-    L4_Word_t       reg[2];
-    L4_Msg_t        start_msg;
-    stat_t          err = ERR_UNKNOWN;
+    ThreadStartRequest  req;
+    L4_ThreadId_t       tid;
+    L4_Word_t           reg[2];
+    L4_Msg_t            start_msg;
+    stat_t              err = ERR_UNKNOWN;
 
     ENTER;
 
-    tid.raw = L4_MsgWord(msg, 0);
-    reg[0] = L4_MsgWord(msg, 1);
-    reg[1] = L4_MsgWord(msg, 2);
+    if (!ThreadStartMessage::Get(msg, &req)) {
+        return Ipc::ReturnError(msg, ERR_INVALID_ARGUMENTS);
+    }
+
+    tid = req.tid;
+    reg[0] = req.ip;
+    reg[1] = req.sp;
     //err = StartThread(tid, ip, sp);
 
     L4_Put(&start_msg, 0, 2, reg, 0, 0);
@@ -456,27 +469,30 @@ IpcHandler::HandleMap(L4_Msg_t *msg)
 {
     L4_Word_t       dest, count, rwx;
     L4_Word_t       src;
-    L4_Word_t       reg[5];
     L4_ThreadId_t   did;
     L4_ThreadId_t   sid;
+    PagerMapRequest req;
 
     ENTER;
 
-    if (Ipc::CheckPayload(msg, 0, 5)) {
+    if (!PagerMapMessage::Get(msg, &req)) {
         return Ipc::ReturnError(msg, ERR_INVALID_ARGUMENTS);
     }
 
-    L4_MsgGet(msg, reg, (void *)0);
-    dest = reg[0];
-    did.raw = reg[1];
-    src = reg[2];
-    sid.raw = reg[3];
-    count = reg[4];
+    dest = req.dest;
+    did = req.did;
+    src = req.src;
+    sid = req.sid;
+    count = req.count;
     rwx = L4_MsgLabel(msg) & 0x7;
 
     DOUT("dst:%.8lX@%.8X, src:%.8lX@%.8lX, %lu pages, %lu\n",
          dest, did.raw, src, sid.raw, count, rwx);
 
+    if (MemoryManager::MAX_MAP_PAGES < count) {
+        return Ipc::ReturnError(msg, ERR_OUT_OF_RANGE);
+    }
+
     //XXX
     if (dest < 0x80000000UL) {
         if (!_task->heap.Hit(dest)) {
@@ -493,7 +509,12 @@ IpcHandler::HandleMap(L4_Msg_t *msg)
     //
     // Map the source to the destination
     //
-    Pager.Map(dest, rwx, src, sid);
+    if ((L4_MsgLabel(msg) & MSG_PAGER_MAP_MOVE) != 0) {
+        Pager.Move(dest, rwx, src, sid, count);
+    }
+    else {
+        Pager.Map(dest, rwx, src, sid, count);
+    }
 
     //
     // Map the pages to the task's AS
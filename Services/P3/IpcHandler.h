@@ -49,7 +49,7 @@ class IpcHandler
 protected:
     Task            *_task;
     Int             _exit_code;
-    L4_MapItem_t    _mapregs[(__L4_NUM_MRS - 1) / 3];
+    L4_MapItem_t    _mapregs[(__L4_NUM_MRS - 1) / 2];
     L4_Word_t       _physregs[(__L4_NUM_MRS - 1) / 3];
 
     stat_t HandleStartThread(L4_Msg_t *msg);
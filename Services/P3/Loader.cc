@@ -205,16 +205,15 @@ TaskLoader::Load0(Task* t, addr_t module, size_t length)
 stat_t
 TaskLoader::MapImage(const TaskMap *tm)
 {
-    L4_Msg_t        msg;
-    L4_Word_t       reg[5];
+    PagerMapRequest req;
     ENTER;
 
     L4_Accept(L4_MapGrantItems(L4_CompleteAddressSpace));
 
-    reg[1] = L4_Myself().raw;
-    reg[2] = 0;
-    reg[3] = L4_Myself().raw;
-    reg[4] = 1;
+    req.did = L4_Myself();
+    req.src = 0;
+    req.sid = L4_Myself();
+    req.count = 1;
 
     //
     // Map the text section
@@ -223,10 +222,11 @@ TaskLoader::MapImage(const TaskMap *tm)
          addr < tm->text_start + tm->text_size;
          addr += PAGE_SIZE) {
 
-        reg[0] = addr & PAGE_MASK;
+        req.dest = addr & PAGE_MASK;
 
-        L4_Put(&msg, MSG_PAGER_MAP | L4_ReadeXecOnly, 5, reg, 0, 0);
-        if (Ipc::Call(L4_Pager(), &msg, &msg) != ERR_NONE) {
+        if (Ipc::Call<PagerMapMessage>(L4_Pager(),
+                                       MSG_PAGER_MAP | L4_ReadeXecOnly,
+                                       req) != ERR_NONE) {
             return ERR_UNKNOWN;
         }
     }
@@ -238,10 +238,11 @@ TaskLoader::MapImage(const TaskMap *tm)
          addr < tm->data_start + tm->data_size;
          addr += PAGE_SIZE) {
 
-        reg[0] = addr & PAGE_MASK;
+        req.dest = addr & PAGE_MASK;
 
-        L4_Put(&msg, MSG_PAGER_MAP | L4_ReadWriteOnly, 5, reg, 0, (void *)0);
-        if (Ipc::Call(L4_Pager(), &msg, &msg) != ERR_NONE) {
+        if (Ipc::Call<PagerMapMessage>(L4_Pager(),
+                                       MSG_PAGER_MAP | L4_ReadWriteOnly,
+                                       req) != ERR_NONE) {
             return ERR_UNKNOWN;
         }
     }
@@ -252,10 +253,12 @@ TaskLoader::MapImage(const TaskMap *tm)
     for (L4_Word_t addr = tm->pm_start;
          addr < tm->pm_start + tm->pm_size;
          addr += PAGE_SIZE) {
-        reg[0] = addr & PAGE_MASK;
+        req.dest = addr & PAGE_MASK;
 
-        L4_Put(&msg, MSG_PAGER_MAP | L4_ReadWriteOnly, 5, reg, 0, 0);
-        stat_t err = Ipc::Call(L4_Pager(), &msg, &msg);
+        stat_t err = Ipc::Call<PagerMapMessage>(L4_Pager(),
+                                                MSG_PAGER_MAP |
+                                                L4_ReadWriteOnly,
+                                                req);
         if (err != ERR_NONE) {
             return err;
         }
@@ -318,25 +321,39 @@ TaskLoader::LoadFile(L4_ThreadId_t fs, const char *path, TaskMap& tm)
     addr_t          program;
     size_t          len;
     size_t          plen;
+    L4_Word_t       mtime;
     stat_t          err;
 
     ENTER;
 
+    tm = TaskMap();
+
     if ((err = file.Connect(fs)) != ERR_NONE) {
         return err;
     }
 
-    if ((err = file.Open(path, FileStream::READ)) != ERR_NONE) {
+    if ((err = file.Open(path, FileStream::READ | FileStream::MAP)) !=
+            ERR_NONE) {
         return err;
     }
 
+    len = file.Size();
+    mtime = file.ModifiedTime();
+    DOUT("file size: %u\n", len);
+
+    //
+    // Another instance of the same file may have been loaded.
+    //
+    if (MapCachedImage(fs, path, mtime, len, tm) == ERR_NONE) {
+        file.Close();
+        file.Disconnect();
+        return ERR_NONE;
+    }
+
     //
     // Place the ELF file to a temporary area, then extract it to the
     // pre-defined area.
     //
-
-    len = file.Size();
-    DOUT("file size: %u\n", len);
     image = AllocateTemporaryPages(PAGE_ALIGN(len) >> PAGE_BITS);
     file.Read((void *)image, len, 0);
 
@@ -348,14 +365,119 @@ TaskLoader::LoadFile(L4_ThreadId_t fs, const char *path, TaskMap& tm)
         return err;
     }
 
+    _segment_count = 0;
     err = Extract(program, plen, tm);
 
     ReleaseTemporaryPages(image, PAGE_ALIGN(len) >> PAGE_BITS);
 
+    if (err == ERR_NONE) {
+        CacheImage(fs, path, mtime, len, tm);
+    }
+
     EXIT;
     return err;
 }
 
+///
+/// Packs the key of the image cache: [fs, mtime, size, ..., path]
+///
+static L4_Word_t
+PutImagePath(L4_Word_t* reg, L4_Word_t index, const char* path)
+{
+    size_t len = strlen(path) + 1;
+
+    memcpy(&reg[index], path, len);
+    return index + (len + sizeof(L4_Word_t) - 1) / sizeof(L4_Word_t);
+}
+
+stat_t
+TaskLoader::MapCachedImage(L4_ThreadId_t fs, const char* path,
+                           L4_Word_t mtime, L4_Word_t size, TaskMap& tm)
+{
+    L4_Msg_t    msg;
+    L4_Word_t   reg[3 + MAX_PATH_LENGTH / sizeof(L4_Word_t)];
+    L4_Word_t   count;
+    stat_t      err;
+
+    ENTER;
+
+    // A file system without modification times cannot tell a rewritten
+    // file from the cached one.
+    if (mtime == 0) {
+        return ERR_NOT_FOUND;
+    }
+
+    if (MAX_PATH_LENGTH <= strlen(path)) {
+        return ERR_OUT_OF_RANGE;
+    }
+
+    reg[0] = fs.raw;
+    reg[1] = mtime;
+    reg[2] = size;
+    count = PutImagePath(reg, 3, path);
+
+    L4_Put(&msg, MSG_ROOT_IMAGE_MAP, count, reg, 0, 0);
+    err = Ipc::Call(Pel::RootTask(), &msg, &msg);
+    if (err != ERR_NONE) {
+        return err;
+    }
+
+    tm.entry = L4_Get(&msg, 0);
+    tm.text_start = L4_Get(&msg, 1);
+    tm.text_size = L4_Get(&msg, 2);
+    tm.data_start = L4_Get(&msg, 3);
+    tm.data_size = L4_Get(&msg, 4);
+    tm.pm_start = L4_Get(&msg, 5);
+    tm.pm_size = L4_Get(&msg, 6);
+
+    // The task maps the text from this space; fault it in.  The data is
+    // mapped on demand and copied on the first write.
+    for (addr_t addr = tm.text_start & PAGE_MASK;
+         addr < tm.text_start + tm.text_size; addr += PAGE_SIZE) {
+        (void)*reinterpret_cast<volatile const char*>(addr);
+    }
+
+    DOUT("'%s' is mapped from the cache\n", path);
+    EXIT;
+    return ERR_NONE;
+}
+
+void
+TaskLoader::CacheImage(L4_ThreadId_t fs, const char* path, L4_Word_t mtime,
+                       L4_Word_t size, const TaskMap& tm)
+{
+    L4_Msg_t    msg;
+    L4_Word_t   reg[11 + MAX_SEGMENTS * 2 +
+                    MAX_PATH_LENGTH / sizeof(L4_Word_t)];
+    L4_Word_t   count;
+
+    if (mtime == 0 || _segment_count == 0 || MAX_SEGMENTS < _segment_count ||
+        MAX_PATH_LENGTH <= strlen(path)) {
+        return;
+    }
+
+    reg[0] = fs.raw;
+    reg[1] = mtime;
+    reg[2] = size;
+    reg[3] = tm.entry;
+    reg[4] = tm.text_start;
+    reg[5] = tm.text_size;
+    reg[6] = tm.data_start;
+    reg[7] = tm.data_size;
+    reg[8] = tm.pm_start;
+    reg[9] = tm.pm_size;
+    reg[10] = _segment_count;
+    count = 11;
+    for (size_t i = 0; i < _segment_count * 2; i++) {
+        reg[count++] = _segments[i];
+    }
+    count = PutImagePath(reg, count, path);
+
+    // The program still runs if the image is not cached.
+    L4_Put(&msg, MSG_ROOT_IMAGE_ADD, count, reg, 0, 0);
+    Ipc::Call(Pel::RootTask(), &msg, &msg);
+}
+
 //XXX:  Currently, it uses the user stack area for the temporary area.  I'm not
 //      sure if it's alright.
 addr_t 
@@ -407,6 +529,13 @@ TaskLoader::LoadSegment(const Elf_Ehdr *ehdr, const Elf_Phdr *phdr)
     memset((void *)phdr->p_vaddr, 0, phdr->p_memsz);
     memcpy((void *)phdr->p_vaddr, (void *)segment, phdr->p_filesz);
 
+    // Remember the segment for the image cache.
+    if (_segment_count < MAX_SEGMENTS) {
+        _segments[_segment_count * 2] = phdr->p_vaddr;
+        _segments[_segment_count * 2 + 1] = phdr->p_memsz;
+    }
+    _segment_count++;
+
     EXIT;
     return ERR_NONE;
 }
@@ -48,6 +48,31 @@
 class TaskLoader
 {
 protected:
+    static const size_t MAX_SEGMENTS = 4;
+
+    static const size_t MAX_PATH_LENGTH = 64;
+
+    ///
+    /// The segments loaded from the last file: the start address and the
+    /// size of each
+    ///
+    L4_Word_t   _segments[MAX_SEGMENTS * 2];
+
+    size_t      _segment_count;
+
+    ///
+    /// Maps the image of the file cached by the root task.
+    ///
+    stat_t MapCachedImage(L4_ThreadId_t fs, const char* path,
+                          L4_Word_t mtime, L4_Word_t size, TaskMap& tm);
+
+    ///
+    /// Asks the root task to keep the image just loaded for the next
+    /// instances.
+    ///
+    void CacheImage(L4_ThreadId_t fs, const char* path, L4_Word_t mtime,
+                    L4_Word_t size, const TaskMap& tm);
+
     stat_t MapImage(const TaskMap *tm);
 
     stat_t LoadFile(L4_ThreadId_t fs, const char *path, TaskMap& tm);
@@ -91,6 +116,8 @@ protected:
     stat_t Load0(Task *t, const TaskMap *tm);
 
 public:
+    TaskLoader() : _segment_count(0) {}
+
     stat_t Load(Task *t, const char* fs, const char* path,
                 UInt type, UInt freq);
 };
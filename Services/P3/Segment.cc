@@ -131,7 +131,14 @@ DataSegment::HandlePf(L4_ThreadId_t tid, L4_Word_t faddr, L4_Word_t fip,
     }
     */
 
-    *rwx = L4_ReadWriteOnly;
+    // A read maps the page read-only, so that a page shared with the other
+    // instances of the program is copied only when it is written.
+    if ((*rwx & L4_Writable) == 0) {
+        *rwx = L4_Readable;
+    }
+    else {
+        *rwx = L4_ReadWriteOnly;
+    }
 
     // Data section is already loaded by P3, so it doesn't obtains a page
     // from the root task.
@@ -276,13 +276,20 @@ BuddyAllocator::Release(PageFrame *frame)
     return err;
 }
 
-void
-BuddyAllocator::PrintMemoryUsage()
+size_t
+BuddyAllocator::FreeCount()
 {
-    Int free_count = 0;
+    size_t free_count = 0;
     for (size_t i = 0; i < MAX_ORDER; i++) {
         free_count += (1 << i) * _bins[i].count;
     }
+    return free_count;
+}
+
+void
+BuddyAllocator::PrintMemoryUsage()
+{
+    Int free_count = FreeCount();
     System.Print("BA: InUse     Free      Reserved\n");
     System.Print("    %8ld  %8ld  %8ld\n", _allocated, free_count, _reserved);
 }
@@ -150,6 +150,27 @@ public:
     ///
     void Initialize(PageFrameTable *table);
 
+    ///
+    /// Obtains the number of free blocks of the order.
+    ///
+    size_t FreeBlocks(unsigned int order)
+    { return order < MAX_ORDER ? _bins[order].count : 0; }
+
+    ///
+    /// Obtains the number of free pages in all the bins.
+    ///
+    size_t FreeCount();
+
+    ///
+    /// Obtains the number of allocated pages.
+    ///
+    size_t AllocatedCount() { return _allocated; }
+
+    ///
+    /// Obtains the number of pages that are never allocated.
+    ///
+    size_t ReservedCount() { return _reserved; }
+
     void PrintMemoryUsage();
 };
 
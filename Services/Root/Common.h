@@ -80,13 +80,10 @@ mfree(void* p)
     MemPool.Release(p);
 }
 
-INLINE void
-NotifyReady(void)
-{
-    L4_Msg_t        msg;
-    L4_MsgPut(&msg, 0, 0, (L4_Word_t *)0, 0, (void *)0);
-    Ipc::Send(RootId, &msg);
-}
+///
+/// Tells the main thread that the calling thread is ready.
+///
+void NotifyReady(void);
 
 INLINE void
 WaitReady(L4_ThreadId_t tid)
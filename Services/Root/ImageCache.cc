@@ -0,0 +1,264 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @brief  Cache of the program images loaded by P3
+/// @file   Services/Root/ImageCache.cc
+/// @since  October 2008
+///
+
+//#define SYS_DEBUG
+//#define SYS_DEBUG_CALL
+
+#include <Debug.h>
+#include <String.h>
+#include <System.h>
+#include <Types.h>
+#include <sys/Config.h>
+
+#include "Common.h"
+#include "ImageCache.h"
+#include "PageAllocator.h"
+#include "PageFrame.h"
+#include "Pager.h"
+#include "Space.h"
+
+#include <l4/types.h>
+
+extern Pager    Pg;
+
+ImageCache      MainImages;
+
+void
+ImageCache::Initialize()
+{
+    memset(_images, 0, sizeof(_images));
+    _clock = 0;
+}
+
+ImageCache::Image*
+ImageCache::Find(L4_ThreadId_t fs, const char* path, L4_Word_t mtime,
+                 L4_Word_t size)
+{
+    // Without the modification time, a rewritten file looks the same.
+    if (mtime == 0) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < MAX_IMAGES; i++) {
+        Image* image = &_images[i];
+        if (image->stamp != 0 &&
+            L4_IsThreadEqual(image->fs, fs) &&
+            image->mtime == mtime && image->size == size &&
+            strncmp(image->path, path, PATH_LENGTH) == 0) {
+            return image;
+        }
+    }
+    return 0;
+}
+
+void
+ImageCache::Drop(Image* image)
+{
+    DOUT("drop '%s'\n", image->path);
+    for (size_t i = 0; i < image->segments; i++) {
+        Segment* seg = &image->segment[i];
+        for (size_t j = 0; j < seg->pages; j++) {
+            MainPa.Release(seg->frames[j]);
+        }
+        delete[] seg->frames;
+    }
+    image->segments = 0;
+    image->stamp = 0;
+}
+
+stat_t
+ImageCache::Collect(Space* space, Segment* seg)
+{
+    seg->frames = new PageFrame*[seg->pages];
+    if (seg->frames == 0) {
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    for (size_t i = 0; i < seg->pages; i++) {
+        PageFrame*  frame;
+
+        if (space->SearchMap(seg->start + PAGE_SIZE * i, &frame)
+            != ERR_NONE) {
+            return ERR_NOT_FOUND;
+        }
+
+        // Only the private pages, or the pages shared in the same way
+        if (frame->GetPageGroup() != 1 || frame->IsShared() ||
+            frame->IsSuper() ||
+            (frame->GetAttribute() != PAGE_ATTR_ANON && !frame->IsMerged())) {
+            return ERR_INVALID_ARGUMENTS;
+        }
+        seg->frames[i] = frame;
+    }
+    return ERR_NONE;
+}
+
+stat_t
+ImageCache::Add(Space* space, L4_ThreadId_t fs, const char* path,
+                L4_Word_t mtime, L4_Word_t size, const L4_Word_t* map,
+                size_t count, const L4_Word_t* ranges)
+{
+    Image*  image;
+    stat_t  err = ERR_NONE;
+
+    ENTER;
+
+    if (mtime == 0 || count == 0 || MAX_SEGMENTS < count ||
+        PATH_LENGTH <= strlen(path)) {
+        return ERR_INVALID_ARGUMENTS;
+    }
+
+    // The snapshots of the space keep their own references to the frames.
+    if (space->HasSnapshots()) {
+        return ERR_BUSY;
+    }
+
+    image = Find(fs, path, mtime, size);
+    if (image == 0) {
+        // Replace the least recently used one.
+        image = &_images[0];
+        for (size_t i = 1; i < MAX_IMAGES && image->stamp != 0; i++) {
+            if (_images[i].stamp < image->stamp) {
+                image = &_images[i];
+            }
+        }
+    }
+    if (image->stamp != 0) {
+        Drop(image);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        Segment* seg = &image->segment[i];
+        addr_t   start = ranges[i * 2];
+        addr_t   end = start + ranges[i * 2 + 1];
+
+        seg->start = start & PAGE_MASK;
+        seg->pages = (PAGE_ALIGN(end) - seg->start) >> PAGE_BITS;
+        image->segments = i + 1;
+        if ((err = Collect(space, seg)) != ERR_NONE) {
+            seg->pages = 0;
+            break;
+        }
+    }
+    if (err != ERR_NONE) {
+        // No reference is taken yet.
+        for (size_t i = 0; i < image->segments; i++) {
+            delete[] image->segment[i].frames;
+        }
+        image->segments = 0;
+        return err;
+    }
+
+    // Share the frames between the space and the cache.  The loader wrote
+    // them; revoke the write access so that the next write copies them.
+    for (size_t i = 0; i < image->segments; i++) {
+        Segment* seg = &image->segment[i];
+        for (size_t j = 0; j < seg->pages; j++) {
+            PageFrame* frame = seg->frames[j];
+            if (!frame->IsMerged()) {
+                frame->SetOwner(L4_nilthread);
+                frame->SetAttribute(PAGE_ATTR_COW | PAGE_ATTR_MERGED);
+                frame->SetAccessState(PAGE_STATE_READ);
+                Pg.Unmap(frame, PAGE_PERM_WRITE);
+            }
+            frame->RefCnt++;
+        }
+    }
+
+    image->fs = fs;
+    image->mtime = mtime;
+    image->size = size;
+    strncpy(image->path, path, PATH_LENGTH - 1);
+    image->path[PATH_LENGTH - 1] = '\0';
+    memcpy(image->map, map, sizeof(image->map));
+    image->stamp = ++_clock;
+
+    DOUT("cache '%s' (%lu segments)\n", path, count);
+    EXIT;
+    return ERR_NONE;
+}
+
+stat_t
+ImageCache::Map(Space* space, L4_ThreadId_t fs, const char* path,
+                L4_Word_t mtime, L4_Word_t size, L4_Word_t* map)
+{
+    Image*      image;
+    PageFrame*  frame;
+
+    ENTER;
+
+    image = Find(fs, path, mtime, size);
+    if (image == 0) {
+        return ERR_NOT_FOUND;
+    }
+
+    // The space must be fresh.
+    for (size_t i = 0; i < image->segments; i++) {
+        Segment* seg = &image->segment[i];
+        for (size_t j = 0; j < seg->pages; j++) {
+            if (space->SearchMap(seg->start + PAGE_SIZE * j, &frame)
+                == ERR_NONE) {
+                return ERR_EXIST;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < image->segments; i++) {
+        Segment* seg = &image->segment[i];
+        for (size_t j = 0; j < seg->pages; j++) {
+            seg->frames[j]->RefCnt++;
+            space->InsertMap(seg->start + PAGE_SIZE * j, seg->frames[j]);
+        }
+    }
+
+    memcpy(map, image->map, sizeof(image->map));
+    image->stamp = ++_clock;
+
+    DOUT("map '%s' to %.8lX\n", path, space->GetRootThread()->Id.raw);
+    EXIT;
+    return ERR_NONE;
+}
+
+size_t
+ImageCache::Count()
+{
+    size_t count = 0;
+    for (size_t i = 0; i < MAX_IMAGES; i++) {
+        if (_images[i].stamp != 0) {
+            count++;
+        }
+    }
+    return count;
+}
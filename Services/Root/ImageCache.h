@@ -0,0 +1,145 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @brief  Cache of the program images loaded by P3
+/// @file   Services/Root/ImageCache.h
+/// @since  October 2008
+///
+
+#ifndef ARC_ROOT_IMAGE_CACHE_H
+#define ARC_ROOT_IMAGE_CACHE_H
+
+#include <Types.h>
+#include <l4/types.h>
+
+class PageFrame;
+class Space;
+
+///
+/// Keeps the pages of the programs loaded by P3, so that the next instance
+/// of the same program maps them instead of loading the file again.  An
+/// image is identified by the file system, the path, the modification time
+/// and the size of the file.
+///
+/// The pages of an image are merged frames (PAGE_ATTR_MERGED) which the
+/// cache holds one reference to.  Each instance shares the frames; a write
+/// to a data page copies it through the copy-on-write fault, so the cached
+/// pages stay pristine.
+///
+class ImageCache
+{
+public:
+    static const size_t MAX_IMAGES = 16;
+
+    static const size_t MAX_SEGMENTS = 4;
+
+    static const size_t PATH_LENGTH = 64;
+
+    ///
+    /// The number of the words of the task map: entry, text start, text
+    /// size, data start, data size, pm start and pm size
+    ///
+    static const size_t MAP_WORDS = 7;
+
+private:
+    struct Segment {
+        addr_t          start;
+        size_t          pages;
+        PageFrame**     frames;
+    };
+
+    struct Image {
+        L4_ThreadId_t   fs;
+        L4_Word_t       mtime;
+        L4_Word_t       size;
+        char            path[PATH_LENGTH];
+        L4_Word_t       map[MAP_WORDS];
+        size_t          segments;
+        Segment         segment[MAX_SEGMENTS];
+
+        ///
+        /// The time the image was used last.  Zero if the entry is empty.
+        ///
+        L4_Word_t       stamp;
+    };
+
+    Image           _images[MAX_IMAGES];
+
+    L4_Word_t       _clock;
+
+    Image* Find(L4_ThreadId_t fs, const char* path, L4_Word_t mtime,
+                L4_Word_t size);
+
+    ///
+    /// Drops the references of the image to its frames.
+    ///
+    void Drop(Image* image);
+
+    ///
+    /// Collects the frames of the segment in the space.
+    ///
+    stat_t Collect(Space* space, Segment* segment);
+
+public:
+    void Initialize();
+
+    ///
+    /// Records the pages of the program just loaded in the space.  The
+    /// pages become shared and copied on write.
+    ///
+    /// @param space    the space of P3
+    /// @param fs       the file system
+    /// @param path     the path of the file
+    /// @param mtime    the modification time of the file.  0, which a file
+    ///                 system without the time reports, is not cached.
+    /// @param size     the size of the file
+    /// @param map      the task map
+    /// @param count    the number of the segments
+    /// @param ranges   the start address and the size of each segment
+    ///
+    stat_t Add(Space* space, L4_ThreadId_t fs, const char* path,
+               L4_Word_t mtime, L4_Word_t size, const L4_Word_t* map,
+               size_t count, const L4_Word_t* ranges);
+
+    ///
+    /// Registers the pages of the image to the space.
+    ///
+    /// @param map      the task map of the image
+    /// @return         ERR_NOT_FOUND if no image matches
+    ///
+    stat_t Map(Space* space, L4_ThreadId_t fs, const char* path,
+               L4_Word_t mtime, L4_Word_t size, L4_Word_t* map);
+
+    size_t Count();
+};
+
+extern ImageCache   MainImages;
+
+#endif // ARC_ROOT_IMAGE_CACHE_H
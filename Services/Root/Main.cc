@@ -49,6 +49,7 @@
 #include "Common.h"
 #include "NameService.h"
 #include "Pager.h"
+#include "Swap.h"
 #include "Task.h"
 #include "Thread.h"
 
@@ -62,6 +63,7 @@
 
 
 #define USER_PAGER      "p3"
+#define SWAP_SERVER     "swap"
 
 ///
 /// Initialize routine for the server 0.
@@ -83,6 +85,16 @@ extern Pager *InitRootPager();
 ///
 extern void RootPagerMain();
 
+///
+/// Entry point of the page zeroing thread.
+///
+extern void PageZeroerMain();
+
+///
+/// Entry point of the same-page merging thread.
+///
+extern void PageMergerMain();
+
 ///
 /// Stack for the server 0
 ///
@@ -93,6 +105,16 @@ static char _initStack[PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
 ///
 static char _pagerStack[PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
 
+///
+/// Stack for the page zeroing thread
+///
+static char _zeroStack[PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+
+///
+/// Stack for the page merging thread
+///
+static char _mergeStack[PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+
 ///
 /// Stack for the root name server
 ///
@@ -114,6 +136,11 @@ L4_ThreadId_t           ProcManId;
 ///
 L4_ThreadId_t           RootPagerId;
 
+///
+/// Thread id of the page merger
+///
+L4_ThreadId_t           MergerId;
+
 ///
 /// Thread id of the root name server
 ///
@@ -197,6 +224,14 @@ DumpSimpleExec(L4_BootRec_t *rec)
 }
 #endif // SYS_DEBUG
 
+void
+NotifyReady(void)
+{
+    L4_Msg_t        msg;
+    L4_MsgPut(&msg, 0, 0, (L4_Word_t *)0, 0, (void *)0);
+    Ipc::Send(RootId, &msg);
+}
+
 ///
 /// Runs the Root Service as a separate thread.
 ///
@@ -204,10 +239,11 @@ DumpSimpleExec(L4_BootRec_t *rec)
 /// @param stack        The base of the stack area
 /// @param stackSize    The size of the stack area
 /// @param ip           The entry point
+/// @param prio         The priority
 ///
 static L4_ThreadId_t
 CreateRootThread(L4_Word_t gidOffset, addr_t stack, size_t stackSize,
-                 addr_t ip)
+                 addr_t ip, L4_Word_t prio = 0xFF)
 {
     L4_KernelInterfacePage_t    *kip;
     L4_ThreadId_t               tid, self;
@@ -230,8 +266,8 @@ CreateRootThread(L4_Word_t gidOffset, addr_t stack, size_t stackSize,
         FATAL("Art_CreateRootThread");
     }
 
-    // Give the highest priority
-    L4_Set_Priority(tid, 0xFF);
+    // The servers run at the highest priority
+    L4_Set_Priority(tid, prio);
 
     // Immediatly start the thread
     L4_Start_SpIp(tid, stack + stackSize, ip);
@@ -285,6 +321,29 @@ FindBootRecord(const char *query, L4_Word_t type, L4_BootRec_t **record)
     return ERR_NOT_FOUND;
 }
 
+///
+/// Checks if the command line of the boot record starts the swap server.
+/// The swap server is the only task allowed to register for swapping.
+///
+/// @param cmdline      the command line of the module
+///
+static Bool
+IsSwapServer(const char *cmdline)
+{
+    const char  *name = cmdline;
+    size_t      len = strlen(SWAP_SERVER);
+
+    // Skip the path to the program
+    for (const char *p = cmdline; *p != '\0' && *p != ' '; p++) {
+        if (*p == '/') {
+            name = p + 1;
+        }
+    }
+
+    return strncmp(name, SWAP_SERVER, len) == 0 &&
+           (name[len] == '\0' || name[len] == ' ');
+}
+
 ///
 /// Launches the initial services
 ///
@@ -295,6 +354,7 @@ CreateInitialServices(void)
     L4_BootRec_t    *rec = 0;
     L4_Word_t       entries;
     L4_Word_t       cur;
+    Space           *space;
 
     info = (L4_BootInfo_t *)L4_BootInfo(L4_GetKernelInterface());
     if (!L4_BootInfo_Valid(info)) {
@@ -333,16 +393,22 @@ CreateInitialServices(void)
 #ifdef SYS_DEBUG
             DumpSimpleExec(rec);
 #endif // SYS_DEBUG
-            if (ExecInitialTask(rec) != ERR_NONE) {
+            if (ExecInitialTask(rec, &space) != ERR_NONE) {
                 FATAL("Failed to create an initial process");
             }
+            if (IsSwapServer(L4_SimpleExec_Cmdline(rec))) {
+                MainSwap.SetServerTask(space);
+            }
         }
         else if (L4_BootRec_Type(rec) == L4_BootInfo_Module) {
             char* ptr = reinterpret_cast<char*>(L4_Module_Start(rec));
             if (strncmp(ptr, "!<arch>\n", 8) == 0) {
-                if (ExecInitialTaskPm(rec) != ERR_NONE) {
+                if (ExecInitialTaskPm(rec, &space) != ERR_NONE) {
                     FATAL("Failed to create an initial process");
                 }
+                if (IsSwapServer(L4_Module_Cmdline(rec))) {
+                    MainSwap.SetServerTask(space);
+                }
                 continue;
             }
 
@@ -380,6 +446,25 @@ main()
                                    PAGE_SIZE,
                                    reinterpret_cast<addr_t>(RootPagerMain));
 
+    //
+    // Spawn the page zeroing thread at the lowest priority
+    //
+    CreateRootThread(Thread::TID_ZERO_OFFSET,
+                     reinterpret_cast<addr_t>(_zeroStack),
+                     PAGE_SIZE,
+                     reinterpret_cast<addr_t>(PageZeroerMain),
+                     1);
+
+    //
+    // Spawn the page merging thread at the lowest priority.  It stays idle
+    // until merging is enabled.
+    //
+    MergerId = CreateRootThread(Thread::TID_MERGE_OFFSET,
+                                reinterpret_cast<addr_t>(_mergeStack),
+                                PAGE_SIZE,
+                                reinterpret_cast<addr_t>(PageMergerMain),
+                                1);
+
     InitProcMan();
 
     //
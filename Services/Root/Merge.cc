@@ -0,0 +1,296 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @brief  Same-page merging
+/// @file   Services/Root/Merge.cc
+/// @since  October 2008
+///
+
+//#define SYS_DEBUG
+//#define SYS_DEBUG_CALL
+
+#include <Debug.h>
+#include <String.h>
+#include <System.h>
+#include <Types.h>
+#include <sys/Config.h>
+
+#include "Common.h"
+#include "Merge.h"
+#include "PageAllocator.h"
+#include "PageFrame.h"
+#include "PageFrameTable.h"
+#include "Pager.h"
+#include "Space.h"
+#include "Thread.h"
+
+#include <l4/types.h>
+
+extern Pager    Pg;
+
+PageMerger      MainMerger;
+
+void
+PageMerger::Initialize()
+{
+    memset(_stable, 0, sizeof(_stable));
+    memset(_unstable, 0, sizeof(_unstable));
+    _enabled = FALSE;
+    _rate = DEFAULT_SCAN_RATE;
+    _period = DEFAULT_SCAN_PERIOD;
+    _hand = 0;
+    _merges = 0;
+}
+
+void
+PageMerger::Configure(Bool enable, size_t rate, L4_Word_t period)
+{
+    if (rate != 0) {
+        _rate = rate;
+    }
+    if (period != 0) {
+        _period = period;
+    }
+    _enabled = enable;
+}
+
+L4_Word_t
+PageMerger::Checksum(PageFrame* frame)
+{
+    const L4_Word_t*    p;
+    L4_Word_t           sum = 0;
+
+    p = reinterpret_cast<const L4_Word_t*>(MainPft.GetAddress(frame));
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(L4_Word_t); i++) {
+        sum += p[i];
+        sum += (sum << 10);
+        sum ^= (sum >> 6);
+    }
+    return sum;
+}
+
+Bool
+PageMerger::IsSame(PageFrame* a, PageFrame* b)
+{
+    return memcmp(reinterpret_cast<const void*>(MainPft.GetAddress(a)),
+                  reinterpret_cast<const void*>(MainPft.GetAddress(b)),
+                  PAGE_SIZE) == 0;
+}
+
+Space*
+PageMerger::Owner(PageFrame* frame)
+{
+    Space*      space;
+    PageFrame*  mapped;
+
+    // The pages revoked by the scanner are in the unmapped state until they
+    // fault in again.
+    if ((frame->GetState() != PAGE_STATE_MAP &&
+         frame->GetState() != PAGE_STATE_UNMAP) ||
+        frame->GetAttribute() != PAGE_ATTR_ANON ||
+        frame->GetPageGroup() != 1 ||
+        frame->IsShared()) {
+        return 0;
+    }
+
+    // The pinned spaces must not fault on a write while the pager waits for
+    // them, and the snapshots keep their own references to the frames.
+    space = Space::Lookup(frame->GetOwner());
+    if (space == 0 || !space->IsSwappable()) {
+        return 0;
+    }
+
+    if (space->SearchMap(frame->GetDestination(), &mapped) != ERR_NONE ||
+        mapped != frame) {
+        return 0;
+    }
+    return space;
+}
+
+///
+/// The caller holds a reference to the merged frame for the space.  It is
+/// dropped if the pages cannot be merged.
+///
+stat_t
+PageMerger::Merge(Space* space, PageFrame* frame, PageFrame* merged)
+{
+    L4_Word_t   address = frame->GetDestination();
+    PageFrame*  cur;
+
+    // Revoke the write access first so that the page stays unchanged while
+    // it is compared.  The scan runs in the pager thread, so a write fault
+    // is not handled until the mapping DB points to the merged frame.
+    Pg.Unmap(frame, PAGE_PERM_WRITE);
+    if (!IsSame(frame, merged) ||
+        space->SearchMap(address, &cur) != ERR_NONE || cur != frame ||
+        !space->SetMap(address, merged)) {
+        MainPa.Release(merged);
+        return ERR_NOT_FOUND;
+    }
+    Pg.Unmap(frame, PAGE_PERM_FULL);
+
+    DOUT("merge %.8lX (%.8lX -> %.8lX)\n",
+         address, Pg.PhysicalAddress(frame), Pg.PhysicalAddress(merged));
+    MainPa.Release(frame);
+    _merges++;
+    return ERR_NONE;
+}
+
+///
+/// The other page is merged if it is still the same.  The frame stays
+/// merged even if the other page is not.
+///
+stat_t
+PageMerger::Promote(PageFrame* frame, Space* space, PageFrame* other)
+{
+    Space*      owner = Owner(frame);
+
+    if (owner == 0) {
+        return ERR_NOT_FOUND;
+    }
+
+    // From here a write to the frame copies it.  Hold a reference so that
+    // the frame survives if the sharing is broken right away.
+    frame->SetOwner(L4_nilthread);
+    frame->SetAttribute(PAGE_ATTR_COW | PAGE_ATTR_MERGED);
+    frame->SetAccessState(PAGE_STATE_READ);
+    frame->RefCnt++;
+    Pg.Unmap(frame, PAGE_PERM_WRITE);
+
+    if (!IsSame(frame, other)) {
+        PageFrame*  cur;
+
+        if (owner->SearchMap(frame->GetDestination(), &cur) == ERR_NONE &&
+            cur == frame) {
+            // Not shared yet.  Back to a private page.
+            frame->RefCnt--;
+            frame->SetAttribute(PAGE_ATTR_ANON);
+            frame->SetOwner(owner->GetRootThread()->Id);
+            frame->SetAccessState(PAGE_STATE_READ | PAGE_STATE_WRITE);
+        }
+        else {
+            MainPa.Release(frame);
+        }
+        return ERR_NOT_FOUND;
+    }
+
+    // The reference held above goes to the space of the other page.
+    Merge(space, other, frame);
+    return ERR_NONE;
+}
+
+Bool
+PageMerger::Visit(PageFrame* frame)
+{
+    Space*      space = Owner(frame);
+    L4_Word_t   sum;
+    Entry*      stable;
+    Entry*      unstable;
+
+    if (space == 0) {
+        return FALSE;
+    }
+
+    sum = Checksum(frame);
+    stable = &_stable[sum % TABLE_SIZE];
+    unstable = &_unstable[sum % TABLE_SIZE];
+
+    // (1) A merged frame of the same content
+    if (stable->frame != 0 && stable->sum == sum &&
+        stable->frame->IsMerged()) {
+        stable->frame->RefCnt++;
+        if (Merge(space, frame, stable->frame) == ERR_NONE) {
+            return TRUE;
+        }
+    }
+
+    // (2) A page of the same content seen in this pass
+    if (unstable->frame != 0 && unstable->frame != frame &&
+        unstable->sum == sum) {
+        PageFrame* other = unstable->frame;
+
+        unstable->frame = 0;
+        if (Promote(other, space, frame) == ERR_NONE) {
+            stable->frame = other;
+            stable->sum = sum;
+            return TRUE;
+        }
+    }
+
+    unstable->frame = frame;
+    unstable->sum = sum;
+    return TRUE;
+}
+
+void
+PageMerger::Scan()
+{
+    PageFrame*  table = MainPft.Table();
+    size_t      length = MainPft.Length();
+    size_t      hashed = 0;
+
+    if (!_enabled) {
+        return;
+    }
+
+    ENTER;
+    for (size_t i = 0; i < length && hashed < _rate; i++) {
+        PageFrame*  frame = &table[_hand];
+
+        _hand++;
+        if (_hand == length) {
+            // The pages of the last pass may have changed since.
+            _hand = 0;
+            memset(_unstable, 0, sizeof(_unstable));
+        }
+
+        if (Visit(frame)) {
+            hashed++;
+        }
+    }
+    EXIT;
+}
+
+void
+PageMerger::Unshare(Space* space, L4_Word_t address, PageFrame* frame,
+                    PageFrame* copy)
+{
+    if (!frame->IsMerged()) {
+        return;
+    }
+
+    copy->SetAttribute(PAGE_ATTR_ANON);
+    copy->SetDestination(address);
+
+    // The snapshots of the space still refer to the merged frame.
+    if (!space->HasSnapshots()) {
+        MainPa.Release(frame);
+    }
+}
@@ -0,0 +1,169 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @brief  Same-page merging
+/// @file   Services/Root/Merge.h
+/// @since  October 2008
+///
+
+#ifndef ARC_ROOT_MERGE_H
+#define ARC_ROOT_MERGE_H
+
+#include <Types.h>
+#include <l4/types.h>
+
+class PageFrame;
+class Space;
+
+///
+/// Merges the private anonymous pages of the same content into a single
+/// copy-on-write frame.  The scanner hashes the pages in the page frame
+/// table little by little.  A page is first compared against the merged
+/// frames of the same hash (the stable table), then against the page seen
+/// with the same hash in the current pass (the unstable table).  A write to
+/// a merged frame breaks the sharing through the usual copy-on-write fault.
+///
+/// The tables are direct-mapped and hold hints only; every entry is checked
+/// and the contents are compared before pages are merged.
+///
+class PageMerger
+{
+public:
+    ///
+    /// The number of the entries in each table
+    ///
+    static const size_t     TABLE_SIZE = 1024;
+
+    ///
+    /// The number of pages hashed in each period
+    ///
+    static const size_t     DEFAULT_SCAN_RATE = 32;
+
+    ///
+    /// The interval of the scans in microseconds
+    ///
+    static const L4_Word_t  DEFAULT_SCAN_PERIOD = 100000;
+
+private:
+    struct Entry {
+        PageFrame*  frame;
+        L4_Word_t   sum;
+    };
+
+    Entry           _stable[TABLE_SIZE];
+
+    Entry           _unstable[TABLE_SIZE];
+
+    Bool            _enabled;
+
+    size_t          _rate;
+
+    L4_Word_t       _period;
+
+    ///
+    /// The clock hand.  The index of the page frame to visit next.
+    ///
+    L4_Word_t       _hand;
+
+    ///
+    /// The number of pages released by merging so far
+    ///
+    L4_Word_t       _merges;
+
+    static L4_Word_t Checksum(PageFrame* frame);
+
+    static Bool IsSame(PageFrame* a, PageFrame* b);
+
+    ///
+    /// Checks if the frame is a private anonymous page of a space that may
+    /// share its pages.
+    ///
+    static Space* Owner(PageFrame* frame);
+
+    ///
+    /// Replaces the frame at the address of the space with the merged one.
+    ///
+    stat_t Merge(Space* space, PageFrame* frame, PageFrame* merged);
+
+    ///
+    /// Turns the frame into a merged frame if it has the same content as
+    /// the other one, then merges the other one into it.
+    ///
+    stat_t Promote(PageFrame* frame, Space* space, PageFrame* other);
+
+    ///
+    /// Hashes the frame and merges it if a page of the same content is
+    /// known.
+    ///
+    /// @return         FALSE if the frame is not a candidate
+    ///
+    Bool Visit(PageFrame* frame);
+
+public:
+    void Initialize();
+
+    ///
+    /// Sets the parameters of the scanner.  Zero leaves the rate or the
+    /// period unchanged.
+    ///
+    void Configure(Bool enable, size_t rate, L4_Word_t period);
+
+    ///
+    /// Hashes the next pages of the page frame table and merges the pages
+    /// of the same content.  It changes the mapping DBs and the page frames,
+    /// so only the pager thread calls it.
+    ///
+    void Scan();
+
+    ///
+    /// Breaks the sharing of a merged frame after the copy-on-write fault
+    /// copied it for the space.  The space drops its reference to the
+    /// merged frame and the copy becomes a private anonymous page.
+    ///
+    /// @param space    the faulting space
+    /// @param address  the address of the page
+    /// @param frame    the frame copied
+    /// @param copy     the new frame
+    ///
+    void Unshare(Space* space, L4_Word_t address, PageFrame* frame,
+                 PageFrame* copy);
+
+    Bool IsEnabled() { return _enabled; }
+
+    size_t ScanRate() { return _rate; }
+
+    L4_Word_t ScanPeriod() { return _period; }
+
+    L4_Word_t Merges() { return _merges; }
+};
+
+extern PageMerger   MainMerger;
+
+#endif // ARC_ROOT_MERGE_H
@@ -59,18 +59,19 @@ NameService::Insert(const char *str, L4_ThreadId_t tid)
 
     entry->tid = tid;
 
-    _mutex.Lock();
+    _lock.WriteLock();
     _list.Append(entry);
-    _mutex.Unlock();
+    _lock.WriteUnlock();
 }
 
 L4_ThreadId_t
 NameService::Search(const char *str)
 {
     L4_ThreadId_t           tid = L4_nilthread;
-    Iterator<NameEntry*>&   it = _list.GetIterator();
 
-    _mutex.Lock();
+    // The readers walk their own copies of the iterator.
+    _lock.ReadLock();
+    Iterator<NameEntry*>    it = _list.GetIterator();
     while (it.HasNext()) {
         NameEntry* e = it.Next();
         if (strcmp(e->name, str) == 0) {
@@ -78,16 +79,15 @@ NameService::Search(const char *str)
             break;
         }
     }
-    _mutex.Unlock();
+    _lock.ReadUnlock();
     return tid;
 }
 
 void
 NameService::Remove(const char *str)
 {
+    _lock.WriteLock();
     Iterator<NameEntry*>&   it = _list.GetIterator();
-
-    _mutex.Lock();
     while (it.HasNext()) {
         NameEntry* e = it.Next();
         if (strcmp(e->name, str) == 0) {
@@ -97,7 +97,7 @@ NameService::Remove(const char *str)
             break;
         }
     }
-    _mutex.Unlock();
+    _lock.WriteUnlock();
 }
 
 Iterator<NameEntry*>&
@@ -39,7 +39,7 @@
 #define ARC_ROOT_NAME_SERVICE_H
 
 #include <List.h>
-#include <Mutex.h>
+#include <RWLock.h>
 #include <l4/types.h>
 
 struct NameEntry
@@ -52,7 +52,11 @@ class NameService
 {
 private:
     List<NameEntry*>    _list;
-    Mutex               _mutex;
+
+    ///
+    /// Lookups far outnumber the registrations.
+    ///
+    RWLock              _lock;
 
 public:
     NameService() {};
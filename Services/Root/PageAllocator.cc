@@ -57,19 +57,52 @@ PageAllocator::Allocate(L4_Word_t count, PageFrame **frame)
 
     for (exp = 0; (1UL << exp) < count; exp++) ;
 
-    if (_ba.Allocate(exp, &obj) != ERR_NONE) {
-        return ERR_OUT_OF_MEMORY;
+    if (exp == 0 && (obj = PopCached()) != 0) {
+        obj->SetPageGroup(1);
     }
+    else {
+        if (_ba.Allocate(exp, &obj) != ERR_NONE &&
+            (Reclaim() == 0 || _ba.Allocate(exp, &obj) != ERR_NONE)) {
+            return ERR_OUT_OF_MEMORY;
+        }
 
-    obj->SetPageGroup(1 << exp);
+        obj->SetPageGroup(1 << exp);
+    }
 #endif // BUDDY_ALLOCATOR
 
-    for (L4_Word_t i = 0; i < obj->GetPageGroup(); i++) {
-        obj[i].Initialize();
-        obj[i].RefCnt++;
-        obj[i].SetState(PAGE_STATE_ALLOC);
-        obj[i].SetOwner(L4_Myself());
+    Assign(obj);
+    *frame = obj;
+
+    EXIT;
+    return ERR_NONE;
+}
+
+stat_t
+PageAllocator::AllocateZeroed(PageFrame **frame)
+{
+    PageFrame   *obj = 0;
+    ENTER;
+
+#ifdef BUDDY_ALLOCATOR
+    _clean_lock.Lock();
+    if (_clean_count > 0) {
+        obj = _clean[--_clean_count];
+    }
+    _clean_lock.Unlock();
+
+    if (obj != 0) {
+        obj->SetPageGroup(1);
+        Assign(obj);
+        *frame = obj;
+        EXIT;
+        return ERR_NONE;
+    }
+#endif // BUDDY_ALLOCATOR
+
+    if (Allocate(1, &obj) != ERR_NONE) {
+        return ERR_OUT_OF_MEMORY;
     }
+    Clear(obj);
     *frame = obj;
 
     EXIT;
@@ -95,20 +128,214 @@ stat_t
 PageAllocator::Release(PageFrame *frame)
 {
     ENTER;
+    // A merged page stays until the last space drops it.
+    if (frame->IsMerged() && frame->RefCnt > 1) {
+        frame->RefCnt--;
+        return ERR_NONE;
+    }
+
     for (PageFrame *ptr = frame; ptr < frame + frame->GetPageGroup(); ptr++) {
         assert(_pft->IsValidFrame(ptr));
         ptr->RefCnt--;
         ptr->SetOwner(L4_nilthread);
+        ptr->SetSharerRights(PAGE_PERM_NONE);
+        ptr->SetAttribute(0);
         ptr->SetState(PAGE_STATE_FREE);
     }
 
 #ifdef BUDDY_ALLOCATOR
-    _ba.Release(frame);
+    if (frame->GetPageGroup() != 1 || !PushCached(frame)) {
+        _ba.Release(frame);
+    }
 #endif // BUDDY_ALLOCATOR
     EXIT;
     return ERR_NONE;
 }
 
+void
+PageAllocator::Divide(PageFrame *frame, L4_Word_t count)
+{
+    L4_Word_t   group = frame->GetPageGroup();
+
+    for (L4_Word_t i = 0; i < group; i++) {
+        frame[i].SetPageGroup(1);
+    }
+
+    // The buddy bins merge the released pages again.
+    for (L4_Word_t i = count; i < group; i++) {
+        Release(frame + i);
+    }
+}
+
+#ifdef BUDDY_ALLOCATOR
+
+PageAllocator::Magazine *
+PageAllocator::GetMagazine()
+{
+    L4_ThreadId_t   me = L4_Myself();
+    Magazine        *mag = 0;
+
+    for (size_t i = 0; i < MAX_MAGAZINES; i++) {
+        if (L4_IsThreadEqual(_magazines[i].owner, me)) {
+            return &_magazines[i];
+        }
+    }
+
+    _magazine_lock.Lock();
+    for (size_t i = 0; i < MAX_MAGAZINES; i++) {
+        if (L4_IsNilThread(_magazines[i].owner)) {
+            mag = &_magazines[i];
+            mag->count = 0;
+            mag->owner = me;
+            break;
+        }
+    }
+    _magazine_lock.Unlock();
+    return mag;
+}
+
+PageFrame *
+PageAllocator::PopCached()
+{
+    Magazine    *mag = GetMagazine();
+    PageFrame   *frame;
+
+    if (mag == 0) {
+        return 0;
+    }
+
+    if (mag->count == 0) {
+        while (mag->count < MAGAZINE_BATCH) {
+            if (_ba.Allocate(0, &frame) != ERR_NONE) {
+                break;
+            }
+            frame->SetState(PAGE_STATE_CACHED);
+            mag->frames[mag->count++] = frame;
+        }
+        if (mag->count == 0) {
+            return 0;
+        }
+    }
+
+    return mag->frames[--mag->count];
+}
+
+Bool
+PageAllocator::PushCached(PageFrame *frame)
+{
+    Magazine    *mag = GetMagazine();
+
+    if (mag == 0) {
+        return FALSE;
+    }
+
+    if (mag->count == MAGAZINE_SIZE) {
+        for (size_t i = 0; i < MAGAZINE_BATCH; i++) {
+            PageFrame *f = mag->frames[--mag->count];
+            f->SetState(PAGE_STATE_FREE);
+            _ba.Release(f);
+        }
+    }
+
+    frame->SetState(PAGE_STATE_CACHED);
+    mag->frames[mag->count++] = frame;
+    return TRUE;
+}
+
+size_t
+PageAllocator::Reclaim()
+{
+    size_t  count = 0;
+
+    _magazine_lock.Lock();
+    for (size_t i = 0; i < MAX_MAGAZINES; i++) {
+        Magazine *mag = &_magazines[i];
+        while (mag->count > 0) {
+            PageFrame *f = mag->frames[--mag->count];
+            f->SetState(PAGE_STATE_FREE);
+            _ba.Release(f);
+            count++;
+        }
+    }
+    _magazine_lock.Unlock();
+
+    _clean_lock.Lock();
+    while (_clean_count > 0) {
+        PageFrame *f = _clean[--_clean_count];
+        f->SetState(PAGE_STATE_FREE);
+        _ba.Release(f);
+        count++;
+    }
+    _clean_lock.Unlock();
+
+    return count;
+}
+
+size_t
+PageAllocator::RefillClean()
+{
+    PageFrame   *frame;
+    size_t      count;
+
+    for (count = 0; count < _zero_rate; count++) {
+        if (_clean_high <= _clean_count) {
+            break;
+        }
+        if (_ba.Allocate(0, &frame) != ERR_NONE) {
+            break;
+        }
+        frame->SetState(PAGE_STATE_CACHED);
+
+        // Zero the page outside the lock.
+        Clear(frame);
+
+        _clean_lock.Lock();
+        if (_clean_count < _clean_high) {
+            _clean[_clean_count++] = frame;
+            frame = 0;
+        }
+        _clean_lock.Unlock();
+
+        if (frame != 0) {
+            frame->SetState(PAGE_STATE_FREE);
+            _ba.Release(frame);
+            break;
+        }
+    }
+    return count;
+}
+
+void
+PageAllocator::SetCleanPool(size_t low, size_t high, size_t rate,
+                            L4_Word_t period)
+{
+    _clean_lock.Lock();
+    if (high != 0) {
+        _clean_high = high < CLEAN_POOL_CAPACITY ? high : CLEAN_POOL_CAPACITY;
+    }
+    if (low != 0) {
+        _clean_low = low;
+    }
+    if (_clean_high < _clean_low) {
+        _clean_low = _clean_high;
+    }
+    if (rate != 0) {
+        _zero_rate = rate;
+    }
+    if (period != 0) {
+        _zero_period = period;
+    }
+
+    while (_clean_high < _clean_count) {
+        PageFrame *f = _clean[--_clean_count];
+        f->SetState(PAGE_STATE_FREE);
+        _ba.Release(f);
+    }
+    _clean_lock.Unlock();
+}
+
+#endif // BUDDY_ALLOCATOR
+
 
 stat_t
 PageAllocator::GetFrameForAddress(addr_t phys, PageFrame **frame)
@@ -39,9 +39,12 @@
 #define ARC_PAGE_ALLOC_H
 
 #include <Debug.h>
+#include <Mutex.h>
 #include <String.h>
+#include <System.h>
 #include <Types.h>
 #include "PageFrameTable.h"
+#include <l4/thread.h>
 
 #ifdef BUDDY_ALLOCATOR
 #include "BuddyAllocator.h"
@@ -52,12 +55,135 @@ class PageFrameTable;
 
 class PageAllocator
 {
+public:
+    ///
+    /// The capacity of a magazine
+    ///
+    static const size_t MAGAZINE_SIZE = 32;
+
+    ///
+    /// The number of frames moved between a magazine and the buddy bins at
+    /// once
+    ///
+    static const size_t MAGAZINE_BATCH = 16;
+
+    ///
+    /// The number of threads that can own a magazine
+    ///
+    static const size_t MAX_MAGAZINES = 4;
+
+    ///
+    /// The upper bound of the pre-zeroed page pool
+    ///
+    static const size_t CLEAN_POOL_CAPACITY = 1024;
+
+    ///
+    /// The default watermarks of the pre-zeroed page pool.  The zeroing
+    /// thread starts refilling when the pool falls below the low mark and
+    /// stops at the high mark.
+    ///
+    static const size_t DEFAULT_CLEAN_LOW = 64;
+    static const size_t DEFAULT_CLEAN_HIGH = 256;
+
+    ///
+    /// The default number of pages zeroed per period
+    ///
+    static const size_t DEFAULT_ZERO_RATE = 16;
+
+    ///
+    /// The default zeroing period, in microseconds
+    ///
+    static const L4_Word_t DEFAULT_ZERO_PERIOD = 10000;
+
 private:
     PageFrameTable  *_pft;
 #ifdef BUDDY_ALLOCATOR
     BuddyAllocator  _ba;
+
+    ///
+    /// A stack of free single frames in front of the buddy allocator.  Each
+    /// magazine belongs to a pager thread and only the owner touches it, so
+    /// the common case of Allocate(1) and Release() takes no lock.  Frames
+    /// in a magazine are in PAGE_STATE_CACHED, which keeps the buddy
+    /// allocator from merging them.
+    ///
+    struct Magazine {
+        L4_ThreadId_t   owner;
+        size_t          count;
+        PageFrame       *frames[MAGAZINE_SIZE];
+    };
+
+    Magazine        _magazines[MAX_MAGAZINES];
+
+    ///
+    /// Serializes the assignment of magazines to threads
+    ///
+    Mutex           _magazine_lock;
+
+    ///
+    /// Obtains the magazine of the current thread.  A free magazine is
+    /// assigned at the first call.
+    ///
+    /// @return     the magazine, or 0 if all magazines are taken
+    ///
+    Magazine *GetMagazine();
+
+    ///
+    /// Takes a frame from the magazine of the current thread.  The magazine
+    /// is refilled from the buddy bins if it is empty.
+    ///
+    PageFrame *PopCached();
+
+    ///
+    /// Puts a frame to the magazine of the current thread.  The magazine is
+    /// drained to the buddy bins if it is full.
+    ///
+    Bool PushCached(PageFrame *frame);
+
+    ///
+    /// Returns the frames in all the magazines and the pre-zeroed pool to
+    /// the buddy bins, so that they merge into larger blocks.  Called when
+    /// the buddy bins cannot satisfy a request.
+    ///
+    /// @return     the number of frames returned
+    ///
+    size_t Reclaim();
+
+    ///
+    /// A stack of zeroed free frames filled by the zeroing thread in the
+    /// background.  The frames are in PAGE_STATE_CACHED.
+    ///
+    PageFrame       *_clean[CLEAN_POOL_CAPACITY];
+
+    size_t          _clean_count;
+
+    size_t          _clean_low;
+
+    size_t          _clean_high;
+
+    size_t          _zero_rate;
+
+    L4_Word_t       _zero_period;
+
+    ///
+    /// Serializes the pool between the pager and the zeroing thread
+    ///
+    Mutex           _clean_lock;
 #endif // BUDDY_ALLOCATOR
 
+    ///
+    /// Makes the frames allocated to the current thread.
+    ///
+    void Assign(PageFrame *obj)
+    {
+        for (L4_Word_t i = 0; i < obj->GetPageGroup(); i++) {
+            obj[i].Initialize();
+            obj[i].RefCnt++;
+            obj[i].SetState(PAGE_STATE_ALLOC);
+            obj[i].SetOwner(L4_Myself());
+        }
+    }
+
     ///
     /// Sets the whole physical page to 0.
     ///
@@ -85,6 +211,19 @@ public:
         // See CreateMainPft().
         //_ba = (BuddyAllocator *)(pft->Table() + pft->Length());
         _ba.Initialize(pft);
+
+        for (size_t i = 0; i < MAX_MAGAZINES; i++) {
+            _magazines[i].owner = L4_nilthread;
+            _magazines[i].count = 0;
+        }
+        _magazine_lock.Initialize();
+
+        _clean_count = 0;
+        _clean_low = DEFAULT_CLEAN_LOW;
+        _clean_high = DEFAULT_CLEAN_HIGH;
+        _zero_rate = DEFAULT_ZERO_RATE;
+        _zero_period = DEFAULT_ZERO_PERIOD;
+        _clean_lock.Initialize();
 #endif // BUDDY_ALLOCATOR
         EXIT;
     }
@@ -98,11 +237,27 @@ public:
 
     virtual stat_t Allocate(L4_Word_t count, addr_t *phys);
 
+    ///
+    /// Allocates a zeroed page.  A page in the pre-zeroed pool is taken if
+    /// any; otherwise a page is zeroed synchronously.
+    ///
+    stat_t AllocateZeroed(PageFrame **frame);
+
     virtual stat_t Release(PageFrame *frame);
 
     virtual stat_t Release(addr_t phys)
     { return this->Release(_pft->GetFrame(phys)); }
 
+    ///
+    /// Divides an allocated block into single pages, so that each page is
+    /// released on its own.  The pages past count, which the allocator added
+    /// to round the block up, are released here.
+    ///
+    /// @param frame    the first page frame of the block
+    /// @param count    the number of pages kept
+    ///
+    void Divide(PageFrame *frame, L4_Word_t count);
+
     /// 
     /// Get the PageFrame corresponding to the physical address given in
     /// parameter.
@@ -119,10 +274,82 @@ public:
     ///
     //virtual size_t Used();
 
+#ifdef BUDDY_ALLOCATOR
+    ///
+    /// Obtains the number of free pages, including the cached ones.
+    ///
+    size_t FreeCount() { return _ba.FreeCount() + CachedCount(); }
+
+    ///
+    /// Obtains the number of pages in use.
+    ///
+    size_t AllocatedCount() { return _ba.AllocatedCount() - CachedCount(); }
+
+    ///
+    /// Obtains the number of free pages kept in the magazines and the
+    /// pre-zeroed pool.
+    ///
+    size_t CachedCount()
+    {
+        size_t cached = 0;
+        for (size_t i = 0; i < MAX_MAGAZINES; i++) {
+            cached += _magazines[i].count;
+        }
+        return cached + _clean_count;
+    }
+
+    ///
+    /// Obtains the number of free blocks of the order in the buddy bins.
+    ///
+    size_t FreeBlocks(unsigned int order) { return _ba.FreeBlocks(order); }
+
+    ///
+    /// Obtains the number of pages in the pre-zeroed pool.
+    ///
+    size_t CleanCount() { return _clean_count; }
+
+    ///
+    /// Checks if the pre-zeroed pool is below the low watermark.
+    ///
+    Bool IsCleanPoolLow() { return _clean_count < _clean_low; }
+
+    ///
+    /// Zeroes free pages into the pre-zeroed pool, up to the zeroing rate
+    /// or the high watermark.  Called by the zeroing thread.
+    ///
+    /// @return     the number of pages added to the pool
+    ///
+    size_t RefillClean();
+
+    ///
+    /// Configures the pre-zeroed pool.  The high watermark is bounded by
+    /// CLEAN_POOL_CAPACITY and the low one by the high one.  Pages above the
+    /// new high watermark are returned to the buddy bins.  Zero leaves a
+    /// parameter unchanged.
+    ///
+    /// @param low      the low watermark
+    /// @param high     the high watermark
+    /// @param rate     the number of pages zeroed per period
+    /// @param period   the zeroing period in microseconds
+    ///
+    void SetCleanPool(size_t low, size_t high, size_t rate, L4_Word_t period);
+
+    size_t CleanLow() { return _clean_low; }
+
+    size_t CleanHigh() { return _clean_high; }
+
+    size_t ZeroRate() { return _zero_rate; }
+
+    L4_Word_t ZeroPeriod() { return _zero_period; }
+#endif // BUDDY_ALLOCATOR
+
     virtual void PrintMemoryUsage()
     {
 #ifdef BUDDY_ALLOCATOR
         _ba.PrintMemoryUsage();
+        System.Print("    %8lu cached in magazines\n",
+                     CachedCount() - CleanCount());
+        System.Print("    %8lu pre-zeroed\n", CleanCount());
 #endif
     }
 };
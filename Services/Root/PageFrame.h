@@ -58,6 +58,7 @@ enum PageType {
 #define PAGE_STATE_UNMAP        0x20
 #define PAGE_STATE_ALLOC        0x30
 #define PAGE_STATE_MAP          0x40
+#define PAGE_STATE_CACHED       0x50        // Free, kept in a magazine
 #define PAGE_STATE_READ         0x01
 #define PAGE_STATE_WRITE        0x02
 #define PAGE_STATE_EXEC         0x04
@@ -68,6 +69,9 @@ enum PageType {
 #define PAGE_ATTR_CONST         0x002
 #define PAGE_ATTR_COW           0x004       // Copy on write page
 #define PAGE_ATTR_SNAPSHOT      0x008
+#define PAGE_ATTR_SUPER         0x010       // Head of a superpage mapping
+#define PAGE_ATTR_ANON          0x020       // Private anonymous page
+#define PAGE_ATTR_MERGED        0x040       // Shared by identical pages
 
 #define PAGE_PERM_MASK          0x7
 #define PAGE_PERM_READ          L4_Readable
@@ -77,12 +81,25 @@ enum PageType {
 #define PAGE_PERM_READ_WRITE    L4_ReadWriteOnly
 #define PAGE_PERM_READ_EXEC     L4_ReadeXecOnly
 #define PAGE_PERM_NONE          L4_NoAccess
+#define PAGE_PERM_MOVE          0x8         // The sharer may take the page
+#define PAGE_SHARE_MASK         (PAGE_PERM_MASK | PAGE_PERM_MOVE)
 
 #define IS_READABLE(rwx)        (((rwx) & PAGE_PERM_READ) == PAGE_PERM_READ)
 #define IS_WRITABLE(rwx)        (((rwx) & PAGE_PERM_WRITE) == PAGE_PERM_WRITE)
 #define IS_EXECUTABLE(rwx)      (((rwx) & PAGE_PERM_EXEC) == PAGE_PERM_EXEC)
 
 
+///
+/// Counts of the page frames by attribute.  They are kept up to date by the
+/// setters of PageFrame, so that statistics do not walk the table.
+///
+struct PageFrameCounters {
+    L4_Word_t           shared;
+    L4_Word_t           cow;
+    L4_Word_t           snapshot;
+    L4_Word_t           merged;
+};
+
 ///
 /// Keep various information about a memory page. Main component of low-level
 /// memory management along with PageFrameTable.
@@ -91,11 +108,20 @@ class PageFrame {
 public:
     static const UInt   MAX_GENERATION = 10;
 
+    ///
+    /// The counts over all page frames
+    ///
+    static PageFrameCounters    Counters;
+
     ///
     /// Used by free-page management
     ///
     PageFrame           *next;
 
+    ///
+    /// The number of references.  A merged page is referenced once by each
+    /// of the spaces sharing it.
+    ///
     UShort              RefCnt;
 
 private:
@@ -139,6 +165,11 @@ private:
     ///
     UByte               _attribute;
 
+    ///
+    /// The number of reclaimer sweeps the page has stayed unreferenced
+    ///
+    UByte               _age;
+
     ///
     /// Length of the frame (by PAGE_SIZE units)
     /// A length of x means that this page is part of a block 
@@ -151,6 +182,11 @@ private:
     ///
     UByte               _type;
 
+    ///
+    /// Adds the page to the counters, or removes it if delta is negative.
+    ///
+    void Account(Int delta);
+
 public:
     void Initialize();
 
@@ -191,6 +227,16 @@ public:
     void IncrementGeneration();
     void DecrementGeneration();
 
+    UByte GetAge() const { return _age; }
+
+    void ResetAge() { _age = 0; }
+
+    void IncrementAge() {
+        if (_age < 0xFF) {
+            _age++;
+        }
+    }
+
     Bool IsShared() const { return _sharer_rights > 0; }
 
     Bool IsCOW() const {
@@ -201,12 +247,21 @@ public:
         return ((_attribute & PAGE_ATTR_SNAPSHOT) != 0);
     }
 
+    Bool IsSuper() const {
+        return ((_attribute & PAGE_ATTR_SUPER) != 0);
+    }
+
+    Bool IsMerged() const {
+        return ((_attribute & PAGE_ATTR_MERGED) != 0);
+    }
+
     PageFrame &operator=(const PageFrame &frame);
 };
 
 inline void
 PageFrame::Initialize()
 {
+    Account(-1);
     _destination = 0;
     _owner = L4_nilthread;
     _sharer = L4_nilthread;
@@ -215,6 +270,7 @@ PageFrame::Initialize()
     _state = PAGE_STATE_FREE;
     _generation = 0;
     _attribute = 0;
+    _age = 0;
 }
 
 inline addr_t
@@ -274,7 +330,9 @@ PageFrame::GetSharerRights() const
 inline void
 PageFrame::SetSharerRights(L4_Word_t rwx)
 {
-    _sharer_rights = rwx & PAGE_PERM_MASK;
+    Account(-1);
+    _sharer_rights = rwx & PAGE_SHARE_MASK;
+    Account(1);
 }
 
 inline UByte
@@ -316,7 +374,9 @@ PageFrame::GetAttribute() const
 inline void
 PageFrame::SetAttribute(UByte attr)
 {
+    Account(-1);
     _attribute = attr;
+    Account(1);
 }
 
 inline L4_Word_t
@@ -374,12 +434,14 @@ PageFrame::DecrementGeneration()
 inline PageFrame &
 PageFrame::operator=(const PageFrame &frame)
 {
+    Account(-1);
     _destination = frame._destination;
     _owner = frame._owner;
     _owner_rights = frame._owner_rights;
     _sharer = frame._sharer;
     _sharer_rights = frame._sharer_rights;
     _attribute = frame._attribute;
+    Account(1);
 
     return *this;
 }
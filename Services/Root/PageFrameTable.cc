@@ -48,6 +48,37 @@
 #include "PageFrame.h"
 #include "PageFrameTable.h"
 
+PageFrameCounters   PageFrame::Counters;
+
+void
+PageFrame::Account(Int delta)
+{
+    L4_Word_t*  counters[4];
+    Int         n = 0;
+
+    if (_sharer_rights > 0) {
+        counters[n++] = &Counters.shared;
+    }
+    if ((_attribute & PAGE_ATTR_COW) != 0) {
+        counters[n++] = &Counters.cow;
+    }
+    if ((_attribute & PAGE_ATTR_SNAPSHOT) != 0) {
+        counters[n++] = &Counters.snapshot;
+    }
+    if ((_attribute & PAGE_ATTR_MERGED) != 0) {
+        counters[n++] = &Counters.merged;
+    }
+
+    // The pager threads run on one CPU, so a single add to memory is not
+    // torn by a preemption and needs no lock prefix.
+    for (Int i = 0; i < n; i++) {
+        __asm__ __volatile__ ("addl %1, %0      \n"
+                              : "+m" (*counters[i])
+                              : "r" (delta)
+                              : "memory");
+    }
+}
+
 
 static void
 PrintEntry(L4_Word_t low, L4_Word_t high, L4_Word_t type, L4_Word_t state,
@@ -98,6 +129,9 @@ PrintEntry(L4_Word_t low, L4_Word_t high, L4_Word_t type, L4_Word_t state,
         case PAGE_STATE_UNMAP:
             System.Print("Unmapped   ");
             break;
+        case PAGE_STATE_CACHED:
+            System.Print("Cached     ");
+            break;
         default:
             System.Print("Unknown    ");
             break;
@@ -210,6 +244,7 @@ PageFrameTable::PrintMemoryUsage()
         if (cur->GetType() == PAGE_TYPE_CONVENTIONAL) {
             switch (cur->GetState()) {
                 case PAGE_STATE_FREE:
+                case PAGE_STATE_CACHED:
                     free_counter++;
                     break;
                 case PAGE_STATE_ALLOC:
@@ -153,7 +153,8 @@ public:
         size_t free_counter = 0;
         for (PageFrame* cur = _table; cur < _table + _count; cur++) {
             if (cur->GetType() == PAGE_TYPE_CONVENTIONAL) {
-                if (cur->GetState() == PAGE_STATE_FREE) {
+                if (cur->GetState() == PAGE_STATE_FREE ||
+                    cur->GetState() == PAGE_STATE_CACHED) {
                     free_counter++;
                 }
             }
@@ -131,8 +131,8 @@ Pager::MapSigma0(L4_Fpage_t fpage, L4_Fpage_t backing)
 }
 
 stat_t
-Pager::CreateMap(addr_t address, L4_Word_t rwx, L4_Word_t sndbase,
-                 L4_MapItem_t *map)
+Pager::CreateMap(addr_t address, L4_Word_t bits, L4_Word_t rwx,
+                 L4_Word_t sndbase, L4_MapItem_t *map)
 {
     L4_Fpage_t      fpage;
     stat_t          err;
@@ -140,7 +140,7 @@ Pager::CreateMap(addr_t address, L4_Word_t rwx, L4_Word_t sndbase,
     ENTER;
     DOUT("%.8lX -> %.8lX\n", address, sndbase);
 
-    fpage = L4_FpageLog2(address, PAGE_BITS);
+    fpage = L4_FpageLog2(address, bits);
     L4_Set_Rights(&fpage, rwx);
 
     // Get the pager's page backed by S0's page (at the same address)
@@ -153,7 +153,7 @@ Pager::CreateMap(addr_t address, L4_Word_t rwx, L4_Word_t sndbase,
     // Map the backed page to the requested address
     // NOTE: Assuming that the destination accepts the entire address space.
     // i.e. L4_Accept(L4_Fpage(L4_CompleteAddressSpace)).
-    *map = L4_MapItem(fpage, sndbase & PAGE_MASK);
+    *map = L4_MapItem(fpage, sndbase & ~((1UL << bits) - 1));
 #ifdef SYS_DEBUG
     System.Print(System.INFO, "Map %.8lX sndbase: %.8lX\n",
                  map->raw[1], map->raw[0]);
@@ -195,12 +195,13 @@ Pager::CreateMapItem(addr_t dest, PageFrame *frame, L4_Word_t rwx,
 
         //FIXME: this is also implicit behavior!
         if (frame->IsCOW()) {
-            CreateMap(_pft->GetAddress(&frame[i]), rwx, dest, &items[i]);
+            CreateMap(_pft->GetAddress(&frame[i]), PAGE_BITS, rwx, dest,
+                      &items[i]);
         }
         else {
             frame[i].SetOwnerRights(frame[i].GetOwnerRights() | rwx);
-            CreateMap(_pft->GetAddress(&frame[i]), frame[i].GetOwnerRights(),
-                      dest, &items[i]);
+            CreateMap(_pft->GetAddress(&frame[i]), PAGE_BITS,
+                      frame[i].GetOwnerRights(), dest, &items[i]);
         }
 
         dest += PAGE_SIZE;
@@ -217,6 +218,40 @@ Pager::CreateMapItem(addr_t dest, PageFrame *frame, L4_Word_t rwx,
     return this->CreateMapItem(dest, frame, rwx, 1, item);
 }
 
+Bool
+Pager::IsSuperAligned(addr_t dest, PageFrame *frame)
+{
+    return (dest & ~SUPERPAGE_MASK) == 0 &&
+           (_pft->GetAddress(frame) & ~SUPERPAGE_MASK) == 0;
+}
+
+stat_t
+Pager::CreateSuperMapItem(addr_t dest, PageFrame *frame, L4_Word_t rwx,
+                          L4_MapItem_t *item)
+{
+    L4_Word_t   rights;
+    ENTER;
+
+    if (!IsSuperAligned(dest, frame)) {
+        return ERR_INVALID_ARGUMENTS;
+    }
+
+    // The rights of the whole superpage follow the first frame.
+    rights = frame->GetOwnerRights() | rwx;
+    for (L4_Word_t i = 0; i < SUPERPAGE_PAGES; i++) {
+        if (frame[i].GetState() != PAGE_STATE_MAP) {
+            frame[i].SetDestination(dest + PAGE_SIZE * i);
+        }
+        frame[i].SetState(PAGE_STATE_MAP);
+        frame[i].AddAccessState(rwx);
+        frame[i].SetOwnerRights(rights);
+    }
+
+    EXIT;
+    return CreateMap(_pft->GetAddress(frame), SUPERPAGE_BITS, rights, dest,
+                     item);
+}
+
 stat_t
 Pager::Unmap(PageFrame *frame, L4_Word_t rwx)
 {
@@ -231,6 +266,23 @@ Pager::Unmap(PageFrame *frame, L4_Word_t rwx)
     return ERR_NONE;
 }
 
+stat_t
+Pager::CreateLendItem(addr_t dest, PageFrame *frame, L4_Word_t rwx,
+                      L4_MapItem_t *item)
+{
+    return CreateMap(_pft->GetAddress(frame), PAGE_BITS, rwx, dest, item);
+}
+
+Bool
+Pager::IsReferenced(PageFrame *frame)
+{
+    L4_Fpage_t  fpage;
+
+    fpage = L4_FpageLog2(_pft->GetAddress(frame), PAGE_BITS);
+    fpage = L4_GetStatus(fpage);
+    return L4_WasReferenced(fpage) || L4_WasWritten(fpage);
+}
+
 addr_t
 Pager::PhysicalAddress(PageFrame *frame)
 {
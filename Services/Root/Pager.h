@@ -54,6 +54,7 @@ private:
     stat_t MapSigma0(L4_Fpage_t fpage, L4_Fpage_t backing);
 
     stat_t CreateMap(addr_t         address,
+                     L4_Word_t      bits,
                      L4_Word_t      rwx,
                      addr_t         sndbase,
                      L4_MapItem_t*  map);
@@ -114,6 +115,52 @@ public:
                          L4_Word_t          rwx,
                          L4_MapItem_t*      item);
 
+    ///
+    /// Checks if the pages starting at the frame can be mapped to the
+    /// destination with a single superpage.  Both the destination and the
+    /// physical address of the frame must be aligned to SUPERPAGE_SIZE.
+    ///
+    /// @param dest     the base address of the destination
+    /// @param frame    the first page frame
+    ///
+    Bool IsSuperAligned(addr_t dest, PageFrame* frame);
+
+    ///
+    /// Creates a mapping information object of a superpage, which covers
+    /// SUPERPAGE_PAGES physically contiguous page frames.
+    ///
+    /// @param dest     the base address of the destination
+    /// @param frame    the first page frame of the superpage
+    /// @param rwx      the permission to be given to the destination
+    /// @param item     the mapping information
+    ///
+    stat_t CreateSuperMapItem(addr_t        dest,
+                              PageFrame*    frame,
+                              L4_Word_t     rwx,
+                              L4_MapItem_t* item);
+
+    ///
+    /// Creates a mapping information object that lends the page to a
+    /// server temporarily.  The state of the frame is not changed.
+    ///
+    /// @param dest     the address in the server
+    /// @param frame    the page frame to be lent
+    /// @param rwx      the permission to be given to the server
+    /// @param item     the mapping information
+    ///
+    stat_t CreateLendItem(addr_t        dest,
+                          PageFrame*    frame,
+                          L4_Word_t     rwx,
+                          L4_MapItem_t* item);
+
+    ///
+    /// Checks if the page has been accessed since the last check.  The
+    /// reference bits of the mappings are cleared.
+    ///
+    /// @param frame    the page frame of the backing page
+    ///
+    Bool IsReferenced(PageFrame* frame);
+
     ///
     /// Discards the mapping backed by the specified page.
     ///
@@ -46,9 +46,13 @@
 #include <System.h>
 #include <Types.h>
 #include "Common.h"
+#include "ImageCache.h"
+#include "Merge.h"
 #include "NameService.h"
 #include "PageFrameTable.h"
+#include "SnapshotPool.h"
 #include "Space.h"
+#include "Swap.h"
 #include "Task.h"
 #include "Thread.h"
 
@@ -115,11 +119,28 @@ static stat_t HandleInject(L4_ThreadId_t tid, L4_Msg_t* msg);
 
 static stat_t HandleFreeCount(L4_ThreadId_t tid, L4_Msg_t* msg);
 
+static stat_t HandleFaultAround(L4_ThreadId_t tid, L4_Msg_t* msg);
+
+static stat_t HandleMemStat(L4_ThreadId_t tid, L4_Msg_t* msg);
+
+static stat_t HandleCleanPool(L4_ThreadId_t tid, L4_Msg_t* msg);
+
+static stat_t HandleSwap(L4_ThreadId_t tid, L4_Msg_t* msg);
+static stat_t HandleMerge(L4_ThreadId_t tid, L4_Msg_t* msg);
+
+static stat_t HandleImageMap(L4_ThreadId_t tid, L4_Msg_t* msg);
+static stat_t HandleImageAdd(L4_ThreadId_t tid, L4_Msg_t* msg);
+
+static stat_t HandleSnapshotDepth(L4_ThreadId_t tid, L4_Msg_t* msg);
+static stat_t HandleSnapshotMode(L4_ThreadId_t tid, L4_Msg_t* msg);
+
 
 void
 InitProcMan()
 {
     InitializeTaskManagement();
+    MainImages.Initialize();
+    MainSnapshotPool.Initialize();
 }
 
 void
@@ -219,6 +240,33 @@ begin:
             case MSG_ROOT_FREE_COUNT:
                 HandleFreeCount(peer, &msg);
                 break;
+            case MSG_ROOT_FAULT_AROUND:
+                HandleFaultAround(peer, &msg);
+                break;
+            case MSG_ROOT_MEM_STAT:
+                HandleMemStat(peer, &msg);
+                break;
+            case MSG_ROOT_CLEAN_POOL:
+                HandleCleanPool(peer, &msg);
+                break;
+            case MSG_ROOT_SWAP:
+                HandleSwap(peer, &msg);
+                break;
+            case MSG_ROOT_MERGE:
+                HandleMerge(peer, &msg);
+                break;
+            case MSG_ROOT_IMAGE_MAP:
+                HandleImageMap(peer, &msg);
+                break;
+            case MSG_ROOT_IMAGE_ADD:
+                HandleImageAdd(peer, &msg);
+                break;
+            case MSG_ROOT_SNAPSHOT_DEPTH:
+                HandleSnapshotDepth(peer, &msg);
+                break;
+            case MSG_ROOT_SNAPSHOT_MODE:
+                HandleSnapshotMode(peer, &msg);
+                break;
             default:
                 System.Print(System.WARN,
                              "Server0: Unknown message: %.8lX from %.8lX\n",
@@ -820,9 +868,371 @@ static stat_t
 HandleFreeCount(L4_ThreadId_t tid, L4_Msg_t* msg)
 {
     L4_Word_t reg[2];
-    reg[0] = MainPft.FreeCount();
+    reg[0] = MainPa.FreeCount();
     reg[1] = MainPft.Length();
     L4_Put(msg, ERR_NONE, 2, reg, 0, 0);
     return ERR_NONE;
 }
 
+///
+/// Finds the space of a task the sender controls: the space of the sender
+/// itself or a space paged by the sender, i.e. the task of a PEL.
+///
+/// @param tid      the sender
+/// @param id       a thread of the task, or nil for the sender
+/// @param space    the space of the task
+///
+static stat_t
+FindControlledTask(L4_ThreadId_t tid, L4_ThreadId_t id, Space** space)
+{
+    Space*  sender;
+    Space*  pager;
+
+    if (L4_IsNilThread(id)) {
+        id = tid;
+    }
+    if (FindTask(tid, &sender) != ERR_NONE ||
+        FindTask(id, space) != ERR_NONE) {
+        return ERR_NOT_FOUND;
+    }
+    if (*space == sender) {
+        return ERR_NONE;
+    }
+    if (FindTask((*space)->GetPager(), &pager) == ERR_NONE &&
+        pager == sender) {
+        return ERR_NONE;
+    }
+    return ERR_INVALID_RIGHTS;
+}
+
+///
+/// Sets the number of pages mapped per page fault in an address space.
+/// Request: [tid, pages]  Reply: [pages]
+///
+static stat_t
+HandleFaultAround(L4_ThreadId_t tid, L4_Msg_t* msg)
+{
+    Space*          space;
+    L4_ThreadId_t   id;
+    L4_Word_t       reg;
+    stat_t          err;
+
+    if (L4_UntypedWords(msg->tag) != 2) {
+        return Ipc::ReturnError(msg, ERR_INVALID_ARGUMENTS);
+    }
+
+    // Only the task itself or its PEL sets the window.
+    id.raw = L4_Get(msg, 0);
+    if ((err = FindControlledTask(tid, id, &space)) != ERR_NONE) {
+        return Ipc::ReturnError(msg, err);
+    }
+
+    space->SetFaultAround(L4_Get(msg, 1));
+    reg = space->FaultAround();
+    L4_Put(msg, ERR_NONE, 1, &reg, 0, 0);
+    return ERR_NONE;
+}
+
+///
+/// Reports the memory statistics.  All the numbers are maintained
+/// incrementally, so the query does not walk the page frame table.
+///
+static stat_t
+HandleMemStat(L4_ThreadId_t tid, L4_Msg_t* msg)
+{
+    L4_Word_t   reg[__L4_NUM_MRS - 1];
+    size_t      n = 0;
+    size_t      first = 0;
+    size_t      spaces;
+
+    if (L4_UntypedWords(msg->tag) > 0) {
+        first = L4_Get(msg, 0);
+    }
+
+    reg[n++] = MainPft.Length();
+    reg[n++] = MainPa.FreeCount();
+    reg[n++] = MainPa.AllocatedCount();
+    reg[n++] = MainPa.CachedCount();
+    reg[n++] = PageFrame::Counters.shared;
+    reg[n++] = PageFrame::Counters.cow;
+    reg[n++] = PageFrame::Counters.snapshot;
+    reg[n++] = BuddyAllocator::MAX_ORDER;
+    for (unsigned int i = 0; i < BuddyAllocator::MAX_ORDER; i++) {
+        reg[n++] = MainPa.FreeBlocks(i);
+    }
+
+    spaces = CountResidentPages(first, &reg[n + 1],
+                                (__L4_NUM_MRS - 2 - n) / 2);
+    reg[n] = spaces;
+    n += 1 + spaces * 2;
+
+    L4_Put(msg, ERR_NONE, n, reg, 0, 0);
+    return ERR_NONE;
+}
+
+///
+/// Configures the pre-zeroed page pool and reports the current settings.
+///
+static stat_t
+HandleCleanPool(L4_ThreadId_t tid, L4_Msg_t* msg)
+{
+    L4_Word_t   reg[5];
+
+    if (L4_UntypedWords(msg->tag) != 4) {
+        return Ipc::ReturnError(msg, ERR_INVALID_ARGUMENTS);
+    }
+
+    MainPa.SetCleanPool(L4_Get(msg, 0), L4_Get(msg, 1), L4_Get(msg, 2),
+                        L4_Get(msg, 3));
+
+    reg[0] = MainPa.CleanLow();
+    reg[1] = MainPa.CleanHigh();
+    reg[2] = MainPa.ZeroRate();
+    reg[3] = MainPa.ZeroPeriod();
+    reg[4] = MainPa.CleanCount();
+    L4_Put(msg, ERR_NONE, 5, reg, 0, 0);
+    return ERR_NONE;
+}
+
+///
+/// Registers the swap server.  The spaces of the swap server and the
+/// threads it depends on are pinned before swapping is enabled.
+///
+static stat_t
+HandleSwap(L4_ThreadId_t tid, L4_Msg_t* msg)
+{
+    L4_ThreadId_t   server;
+    L4_ThreadId_t   id;
+    Space*          sender;
+    Space*          space;
+    stat_t          err;
+
+    if (L4_UntypedWords(msg->tag) < 3) {
+        return Ipc::ReturnError(msg, ERR_INVALID_ARGUMENTS);
+    }
+
+    // Only the swap server booted by the root task registers, and only
+    // itself.  The request is forwarded by the pager of the server, so the
+    // sender lives in the same task.
+    server.raw = L4_Get(msg, 0);
+    if (FindTask(tid, &sender) != ERR_NONE ||
+        FindTask(server, &space) != ERR_NONE) {
+        return Ipc::ReturnError(msg, ERR_NOT_FOUND);
+    }
+    if (space != sender || !MainSwap.IsServerTask(space)) {
+        return Ipc::ReturnError(msg, ERR_INVALID_RIGHTS);
+    }
+    space->SetPinned(TRUE);
+
+    for (L4_Word_t i = 3; i < L4_UntypedWords(msg->tag); i++) {
+        id.raw = L4_Get(msg, i);
+        if (FindTask(id, &space) == ERR_NONE) {
+            space->SetPinned(TRUE);
+        }
+    }
+
+    err = MainSwap.Register(server, L4_Get(msg, 1), L4_Get(msg, 2));
+    if (err != ERR_NONE) {
+        return Ipc::ReturnError(msg, err);
+    }
+
+    // The pager sends the requests.  The server accepts no other thread.
+    L4_Put(msg, ERR_NONE, 1, &RootPagerId.raw, 0, 0);
+    return ERR_NONE;
+}
+
+///
+/// Switches the snapshot mode of a task between the full and the
+/// incremental snapshots.
+///
+static stat_t
+HandleSnapshotMode(L4_ThreadId_t tid, L4_Msg_t* msg)
+{
+    Space*          space;
+    L4_ThreadId_t   id;
+    L4_Word_t       reg;
+    stat_t          err;
+
+    if (L4_UntypedWords(msg->tag) != 2) {
+        return Ipc::ReturnError(msg, ERR_INVALID_ARGUMENTS);
+    }
+
+    id.raw = L4_Get(msg, 0);
+    if ((err = FindControlledTask(tid, id, &space)) != ERR_NONE) {
+        return Ipc::ReturnError(msg, err);
+    }
+
+    space->SetIncrementalSnapshot(L4_Get(msg, 1) != 0 ? TRUE : FALSE);
+
+    reg = space->IsIncrementalSnapshot();
+    L4_Put(msg, ERR_NONE, 1, &reg, 0, 0);
+    return ERR_NONE;
+}
+
+///
+/// Configures the same-page merging and reports the current settings.
+///
+static stat_t
+HandleMerge(L4_ThreadId_t tid, L4_Msg_t* msg)
+{
+    L4_Word_t   reg[5];
+
+    if (L4_UntypedWords(msg->tag) != 3) {
+        return Ipc::ReturnError(msg, ERR_INVALID_ARGUMENTS);
+    }
+
+    MainMerger.Configure(L4_Get(msg, 0) != 0, L4_Get(msg, 1),
+                         L4_Get(msg, 2));
+
+    reg[0] = MainMerger.IsEnabled();
+    reg[1] = MainMerger.ScanRate();
+    reg[2] = MainMerger.ScanPeriod();
+    reg[3] = PageFrame::Counters.merged;
+    reg[4] = MainMerger.Merges();
+    L4_Put(msg, ERR_NONE, 5, reg, 0, 0);
+    return ERR_NONE;
+}
+
+///
+/// Copies the path in the message registers from the index.
+///
+static void
+GetImagePath(L4_Msg_t* msg, L4_Word_t index, char* path)
+{
+    L4_Word_t   reg[ImageCache::PATH_LENGTH / sizeof(L4_Word_t)];
+    L4_Word_t   count = 0;
+
+    while (index < L4_UntypedWords(msg->tag) &&
+           count < ImageCache::PATH_LENGTH / sizeof(L4_Word_t)) {
+        reg[count++] = L4_Get(msg, index++);
+    }
+    memcpy(path, reg, count * sizeof(L4_Word_t));
+    path[count * sizeof(L4_Word_t)] = '\0';
+}
+
+///
+/// Finds the space of the PEL sending a request.  The requests to load
+/// programs are refused from the other tasks.
+///
+/// @param tid      the sender
+/// @param space    the space of the PEL
+///
+static stat_t
+FindPel(L4_ThreadId_t tid, Space** space)
+{
+    if (FindTask(tid, space) != ERR_NONE) {
+        return ERR_NOT_FOUND;
+    }
+    if (!(*space)->IsShadow()) {
+        return ERR_INVALID_RIGHTS;
+    }
+    return ERR_NONE;
+}
+
+///
+/// Maps the cached image of a program to the space of P3.
+///
+static stat_t
+HandleImageMap(L4_ThreadId_t tid, L4_Msg_t* msg)
+{
+    L4_ThreadId_t   fs;
+    L4_Word_t       map[ImageCache::MAP_WORDS];
+    char            path[ImageCache::PATH_LENGTH + sizeof(L4_Word_t)];
+    Space*          space;
+    stat_t          err;
+
+    if (L4_UntypedWords(msg->tag) < 4) {
+        return Ipc::ReturnError(msg, ERR_INVALID_ARGUMENTS);
+    }
+    if ((err = FindPel(tid, &space)) != ERR_NONE) {
+        return Ipc::ReturnError(msg, err);
+    }
+
+    fs.raw = L4_Get(msg, 0);
+    GetImagePath(msg, 3, path);
+
+    err = MainImages.Map(space, fs, path, L4_Get(msg, 1), L4_Get(msg, 2),
+                         map);
+    if (err != ERR_NONE) {
+        return Ipc::ReturnError(msg, err);
+    }
+
+    L4_Put(msg, ERR_NONE, ImageCache::MAP_WORDS, map, 0, 0);
+    return ERR_NONE;
+}
+
+///
+/// Records the image of a program P3 has just loaded.
+///
+static stat_t
+HandleImageAdd(L4_ThreadId_t tid, L4_Msg_t* msg)
+{
+    L4_ThreadId_t   fs;
+    L4_Word_t       map[ImageCache::MAP_WORDS];
+    L4_Word_t       ranges[ImageCache::MAX_SEGMENTS * 2];
+    L4_Word_t       count;
+    L4_Word_t       index;
+    char            path[ImageCache::PATH_LENGTH + sizeof(L4_Word_t)];
+    Space*          space;
+    stat_t          err;
+
+    index = 3 + ImageCache::MAP_WORDS;
+    if (L4_UntypedWords(msg->tag) < index + 2) {
+        return Ipc::ReturnError(msg, ERR_INVALID_ARGUMENTS);
+    }
+    count = L4_Get(msg, index++);
+    if (ImageCache::MAX_SEGMENTS < count ||
+        L4_UntypedWords(msg->tag) <= index + count * 2) {
+        return Ipc::ReturnError(msg, ERR_INVALID_ARGUMENTS);
+    }
+    if ((err = FindPel(tid, &space)) != ERR_NONE) {
+        return Ipc::ReturnError(msg, err);
+    }
+
+    fs.raw = L4_Get(msg, 0);
+    for (L4_Word_t i = 0; i < ImageCache::MAP_WORDS; i++) {
+        map[i] = L4_Get(msg, 3 + i);
+    }
+    for (L4_Word_t i = 0; i < count * 2; i++) {
+        ranges[i] = L4_Get(msg, index++);
+    }
+    GetImagePath(msg, index, path);
+
+    return Ipc::ReturnError(msg, MainImages.Add(space, fs, path,
+                                                L4_Get(msg, 1),
+                                                L4_Get(msg, 2), map, count,
+                                                ranges));
+}
+
+///
+/// Sets the snapshot depth of a task and reports the snapshots kept.
+///
+static stat_t
+HandleSnapshotDepth(L4_ThreadId_t tid, L4_Msg_t* msg)
+{
+    Space*          space;
+    L4_ThreadId_t   id;
+    L4_Word_t       reg[5];
+
+    if (L4_UntypedWords(msg->tag) != 3) {
+        return Ipc::ReturnError(msg, ERR_INVALID_ARGUMENTS);
+    }
+
+    id.raw = L4_Get(msg, 0);
+    if (L4_IsNilThread(id)) {
+        id = tid;
+    }
+    if (FindTask(id, &space) != ERR_NONE) {
+        return Ipc::ReturnError(msg, ERR_NOT_FOUND);
+    }
+
+    space->SetSnapshotDepth(L4_Get(msg, 1), L4_Get(msg, 2));
+
+    reg[0] = space->SnapshotDepth();
+    reg[1] = space->UnpackedGenerations();
+    reg[2] = space->Generations();
+    reg[3] = MainSnapshotPool.Packed();
+    reg[4] = MainSnapshotPool.Pages();
+    L4_Put(msg, ERR_NONE, 5, reg, 0, 0);
+    return ERR_NONE;
+}
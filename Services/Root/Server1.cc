@@ -39,17 +39,20 @@
 #include <l4/kdebug.h>
 #include <Debug.h>
 #include <Ipc.h>
+#include <IpcProfile.h>
 #include <MemoryPool.h>
 #include <System.h>
 #include <Types.h>
 #include <sys/Config.h>
 
 #include "Common.h"
+#include "Merge.h"
 #include "PageAllocator.h"
 #include "PageFrame.h"
 #include "PageFrameTable.h"
 #include "Pager.h"
 #include "Space.h"
+#include "Swap.h"
 #include "Task.h"
 #include "Thread.h"
 
@@ -92,19 +95,29 @@ Pager                   IoPg;
 ///
 MemoryPool              MemPool;
 
+///
+/// Request statistics of the pager.  Enabled from the start when built with
+/// IPC_PROFILE, otherwise by MSG_PAGER_PROFILE.
+///
+static IpcProfile       PagerProfile;
+
 static PageFrame        *EmptyPage;
 static PageFrame        *EmptyCowPage;
 
 ///
-/// The lenth of the map registers
+/// The lenth of the map registers.  A map item takes two message registers,
+/// so a reply carries up to 31 items.
 ///
-static const L4_Word_t  MAP_REG_LENGTH = 16;
+static const L4_Word_t  MAP_REG_LENGTH = 31;
 
 ///
 /// A temporal storage to pass the mapping items between methods
 ///
 static L4_MapItem_t     _mapregs[MAP_REG_LENGTH];
 
+extern L4_ThreadId_t    RootPagerId;
+extern L4_ThreadId_t    MergerId;
+
 
 static stat_t HandleStartThread(L4_Msg_t *msg);
 static stat_t HandlePageFault(L4_ThreadId_t tid, L4_Msg_t *msg);
@@ -116,6 +129,7 @@ static stat_t HandleIoMap(L4_ThreadId_t tid, L4_Msg_t *msg);
 static stat_t HandleIoUnmap(L4_ThreadId_t tid, L4_Msg_t *msg);
 static stat_t HandlePhys(L4_ThreadId_t tid, L4_Msg_t *msg);
 static stat_t HandleMapBiosPage(L4_ThreadId_t tid, L4_Msg_t *msg);
+static stat_t HandleMergeScan(L4_ThreadId_t tid, L4_Msg_t *msg);
 //static stat_t HandleMapLFB(L4_ThreadId_t tid, L4_Msg_t *msg);
 
 /// Allocate one reserved, unmapped, zeroed memory page and make
@@ -219,6 +233,9 @@ InitRootPager()
     //
     IoPg.SetPft(pft);
 
+    MainSwap.Initialize();
+    MainMerger.Initialize();
+
     PrepareEmptyPage();
     PrepareEmptyCowPage();
 
@@ -235,11 +252,16 @@ RootPagerMain()
     L4_ThreadId_t   tid;
     L4_MsgTag_t     tag;
     L4_Msg_t        msg;
+    ULong           start;
     stat_t          err = ERR_NONE;
 
     System.Print(System.INFO, "Starting Root Pager (%.8lX) ... \n",
                  L4_Myself().raw);
 
+#ifdef IPC_PROFILE
+    PagerProfile.Enable(TRUE);
+#endif // IPC_PROFILE
+
     NotifyReady();
 
 begin:
@@ -264,6 +286,7 @@ begin:
         }
 
         L4_MsgStore(tag, &msg);
+        start = PagerProfile.Begin();
         switch (L4_Label(tag) & MSG_PAGER_MASK) {
             case MSG_PAGER_TH:
                 if ((err = HandleStartThread(&msg)) != ERR_NONE) {
@@ -324,12 +347,22 @@ begin:
                     System.Print(System.ERROR, "Srv1:Err_MapBios\n");
                 }
                 break;
+            case MSG_PAGER_PROFILE:
+                PagerProfile.Query(&msg);
+                break;
+            case MSG_PAGER_MERGE:
+                if ((err = HandleMergeScan(tid, &msg)) != ERR_NONE) {
+                    System.Print(System.ERROR, "Srv1:ErrMergeScan:%s\n",
+                               stat2msg[err]);
+                }
+                break;
             default:
                 System.Print(System.WARN,
                            "Srv1: Unknown message %lX from %.8lX\n",
                            L4_Label(tag) & MSG_PAGER_MASK, tid.raw);
                 break;
         }
+        PagerProfile.End(L4_Label(tag) & MSG_PAGER_MASK, start);
 
         L4_Load(&msg);
         tag = L4_ReplyWait(tid, &tid);
@@ -338,25 +371,78 @@ exit:
     FATAL("Pager_Main_ErrNeverReached");
 }
 
+///
+/// Entry point of the zeroing thread.  It runs at the idle priority and
+/// zeroes free pages into the pre-zeroed pool of MainPa, so that anonymous
+/// faults do not clear pages in the fault IPC.
+///
+void
+PageZeroerMain()
+{
+    Bool    filling = FALSE;
+
+    System.Print(System.INFO, "Starting Page Zeroer (%.8lX) ... \n",
+                 L4_Myself().raw);
+
+    NotifyReady();
+
+    for (;;) {
+        if (!filling && MainPa.IsCleanPoolLow()) {
+            filling = TRUE;
+        }
+        if (filling && MainPa.RefillClean() == 0) {
+            // Reached the high watermark or out of free pages
+            filling = FALSE;
+        }
+        L4_Sleep(L4_TimePeriod(MainPa.ZeroPeriod()));
+    }
+}
+
+///
+/// Entry point of the same-page merging thread.  It runs at the idle
+/// priority and has the pager scan a few pages in each period while merging
+/// is enabled.  The scan changes the mapping DBs and the page frames, so it
+/// runs in the pager thread between the page faults instead of here.
+///
+void
+PageMergerMain()
+{
+    L4_Msg_t    msg;
+
+    System.Print(System.INFO, "Starting Page Merger (%.8lX) ... \n",
+                 L4_Myself().raw);
+
+    NotifyReady();
+
+    for (;;) {
+        if (MainMerger.IsEnabled()) {
+            L4_Put(&msg, MSG_PAGER_MERGE, 0, 0, 0, 0);
+            Ipc::Call(RootPagerId, &msg, &msg);
+        }
+        L4_Sleep(L4_TimePeriod(MainMerger.ScanPeriod()));
+    }
+}
+
 ///
 /// Send the start signal to a thread, along with its SP and IP.
 ///
 static stat_t
 HandleStartThread(L4_Msg_t *msg)
 {
-    L4_ThreadId_t   to;
-    L4_MsgTag_t     tag;
-    L4_Word_t       reg[2];
+    ThreadStartRequest  req;
+    L4_ThreadId_t       to;
+    L4_MsgTag_t         tag;
+    L4_Word_t           reg[2];
 
     ENTER;
 
-    if (Ipc::CheckPayload(msg, 0, 3)) {
+    if (!ThreadStartMessage::Get(msg, &req)) {
         return Ipc::ReturnError(msg, ERR_INVALID_ARGUMENTS);
     }
 
-    to.raw = L4_Get(msg, 0);
-    reg[0] = L4_Get(msg, 1);    // instruction pointer
-    reg[1] = L4_Get(msg, 2);    // stack pointer
+    to = req.tid;
+    reg[0] = req.ip;
+    reg[1] = req.sp;
 
     L4_Put(msg, 0, 2, reg, 0, (void *)0);
     L4_MsgLoad(msg);
@@ -369,13 +455,151 @@ HandleStartThread(L4_Msg_t *msg)
     return Ipc::ReturnError(msg, ERR_NONE);
 }
 
+///
+/// Maps the pages around the fault address that are already registered in
+/// the mapping database of the space.  Shared pages are left to explicit
+/// mapping requests, and copy-on-write pages are mapped read-only so that a
+/// write still faults.
+///
+/// @param space    the faulting space
+/// @param faddr    the fault address
+/// @param rwx      the access rights of the fault
+/// @param count    the number of map items already in _mapregs
+/// @return         the number of map items in _mapregs
+///
+static size_t
+FaultAroundMapped(Space *space, addr_t faddr, L4_Word_t rwx, size_t count)
+{
+    size_t      window = space->FaultAround();
+    addr_t      base = faddr & ~(window * PAGE_SIZE - 1);
+    PageFrame   *frame;
+    L4_Word_t   rights;
+
+    for (size_t i = 0; i < window && count < MAP_REG_LENGTH; i++) {
+        addr_t addr = base + i * PAGE_SIZE;
+        if (addr == faddr || !Pg.IsValidAddress(addr)) {
+            continue;
+        }
+        if (space->SearchMap(addr, &frame) != ERR_NONE || frame->IsShared()) {
+            continue;
+        }
+
+        rights = frame->GetOwnerRights() & rwx;
+        // Incremental snapshots have to see the first write to each page.
+        if (frame->IsCOW() || space->IsIncrementalSnapshot()) {
+            rights &= ~PAGE_PERM_WRITE;
+        }
+        if (rights == 0) {
+            continue;
+        }
+
+        if (Pg.CreateMapItem(addr, frame, rights, &_mapregs[count])
+            == ERR_NONE) {
+            count++;
+        }
+    }
+    return count;
+}
+
+///
+/// Allocates and maps the anonymous pages following the fault address.  It
+/// stops at the first page that is registered in the mapping database, so
+/// that the window never grows into a text area.
+///
+/// @param space    the faulting space
+/// @param faddr    the fault address
+/// @param count    the number of map items already in _mapregs
+/// @return         the number of map items in _mapregs
+///
+static size_t
+FaultAroundAnonymous(Space *space, addr_t faddr, size_t count)
+{
+    size_t      window = space->FaultAround();
+    addr_t      end = (faddr & ~(window * PAGE_SIZE - 1)) + window * PAGE_SIZE;
+    PageFrame   *frame;
+
+    for (addr_t addr = faddr + PAGE_SIZE;
+         addr < end && count < MAP_REG_LENGTH; addr += PAGE_SIZE) {
+        if (!Pg.IsValidAddress(addr) ||
+            space->SearchMap(addr, &frame) == ERR_NONE ||
+            space->IsSwapped(addr)) {
+            break;
+        }
+        if (MainPa.AllocateZeroed(&frame) != ERR_NONE) {
+            break;
+        }
+
+        frame->SetOwner(space->GetRootThread()->Id);
+        frame->SetOwnerRights(PAGE_PERM_READ_WRITE);
+        frame->SetSharer(L4_nilthread);
+        frame->SetSharerRights(PAGE_PERM_NONE);
+        frame->SetDestination(addr);
+        frame->SetAttribute(PAGE_ATTR_ANON);
+
+        if (Pg.CreateMapItem(addr, frame, PAGE_PERM_READ_WRITE,
+                             &_mapregs[count]) != ERR_NONE) {
+            MainPa.Release(frame);
+            break;
+        }
+        space->InsertMap(addr, frame);
+        count++;
+    }
+    return count;
+}
+
+///
+/// Allocates a zeroed page for an anonymous fault.  Some pages are swapped
+/// out if the memory runs out.
+///
+static stat_t
+AllocateAnonymous(PageFrame **frame)
+{
+    if (MainPa.AllocateZeroed(frame) == ERR_NONE) {
+        return ERR_NONE;
+    }
+    if (MainSwap.Reclaim(SwapManager::RECLAIM_BATCH) == 0) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    return MainPa.AllocateZeroed(frame);
+}
+
+///
+/// Reads the page swapped out back and registers it to the space.
+///
+/// @return         ERR_NOT_FOUND if the page is not swapped out
+///
+static stat_t
+SwapInAnonymous(Space *space, addr_t faddr, PageFrame **frame)
+{
+    stat_t  err;
+
+    err = MainSwap.SwapIn(space, faddr, frame);
+    if (err == ERR_OUT_OF_MEMORY &&
+        MainSwap.Reclaim(SwapManager::RECLAIM_BATCH) > 0) {
+        err = MainSwap.SwapIn(space, faddr, frame);
+    }
+    if (err != ERR_NONE) {
+        return err;
+    }
+
+    (*frame)->SetOwner(space->GetRootThread()->Id);
+    (*frame)->SetOwnerRights(PAGE_PERM_READ_WRITE);
+    (*frame)->SetSharer(L4_nilthread);
+    (*frame)->SetSharerRights(PAGE_PERM_NONE);
+    (*frame)->SetDestination(faddr);
+    (*frame)->SetAttribute(PAGE_ATTR_ANON);
+    space->InsertMap(faddr, *frame);
+    return ERR_NONE;
+}
+
 static stat_t
 HandlePageFault(L4_ThreadId_t tid, L4_Msg_t *msg)
 {
-    L4_Word_t       faddr, fip, rwx;
+    L4_Word_t       faddr, fip, rwx, base;
     PageFrame       *frame;
     Space           *space;
     stat_t        status;
+    size_t          count = 1;
 
     ENTER;
     if (Ipc::CheckPayload(msg, 0, 2)) {
@@ -415,7 +639,15 @@ HandlePageFault(L4_ThreadId_t tid, L4_Msg_t *msg)
     //
     // (1) The fault address is found in the database.
     //
-    if (space->SearchMap(faddr, &frame) == ERR_NONE) {
+    if (space->SearchSuperMap(faddr, &base, &frame) == ERR_NONE) {
+        DOUT("superpage@%.8lX (p:%.8lX)\n",
+             base, Pg.PhysicalAddress(frame));
+        status = Pg.CreateSuperMapItem(base, frame, rwx, &_mapregs[0]);
+        if (status != ERR_NONE) {
+            return status;
+        }
+    }
+    else if (space->SearchMap(faddr, &frame) == ERR_NONE) {
         DOUT("reserved mapping@%.8lX (p:%.8lX)\n",
              faddr, Pg.PhysicalAddress(frame));
         if ((frame->GetOwnerRights() & rwx) == 0) {
@@ -465,13 +697,20 @@ HandlePageFault(L4_ThreadId_t tid, L4_Msg_t *msg)
             if (space->SetMap(faddr, newf) == FALSE) {
                 FATAL("map DB inconsistency");
             }
+            MainMerger.Unshare(space, faddr, frame, newf);
         }
         else {
             status = Pg.CreateMapItem(faddr, frame, rwx, &_mapregs[0]);
             if (status != ERR_NONE) {
                 return status;
             }
+            if (IS_WRITABLE(rwx)) {
+                // Written in place
+                space->MarkDirty(faddr, frame);
+            }
         }
+
+        count = FaultAroundMapped(space, faddr, rwx, count);
     }
     //
     // (2) Map an anonymous page that is supposed to be assigned to a heap or
@@ -485,15 +724,32 @@ anonymous_mapping:
             return ERR_INVALID_RIGHTS;
         }
 
+        // Read the page back if it is swapped out.
+        status = SwapInAnonymous(space, faddr, &frame);
+        if (status == ERR_NONE) {
+            DOUT("swapped in @%.8lX (p:%.8lX)\n",
+                 faddr, Pg.PhysicalAddress(frame));
+            status = Pg.CreateMapItem(faddr, frame, PAGE_PERM_READ_WRITE,
+                                      &_mapregs[0]);
+            if (status != ERR_NONE) {
+                return status;
+            }
+            goto reply;
+        }
+        else if (status != ERR_NOT_FOUND) {
+            return status;
+        }
+
         if (IS_EXECUTABLE(rwx)) {
             BREAK("anon exec access");
             return ERR_INVALID_RIGHTS;
         }
         else if (IS_WRITABLE(rwx)) {
-            // Allocate and map a page
-            if (MainPa.Allocate(1, &frame) != ERR_NONE) {
+            // Allocate and map a zeroed page
+            if (AllocateAnonymous(&frame) != ERR_NONE) {
                 return ERR_OUT_OF_MEMORY;
             }
+            frame->SetAttribute(PAGE_ATTR_ANON);
 
             // Reserve 'read-write' permission, but map 'write' permission only
             frame->SetOwner(space->GetRootThread()->Id);
@@ -514,6 +770,8 @@ anonymous_mapping:
             }
         }
         else if (IS_READABLE(rwx)) {
+            // The empty page is not registered to the database; the next
+            // write faults again and allocates a private page.
             status = Pg.CreateMapItem(faddr, EmptyCowPage, PAGE_PERM_READ,
                                       &_mapregs[0]);
             if (status != ERR_NONE) {
@@ -524,14 +782,22 @@ anonymous_mapping:
             return ERR_NONE;
         }
 
-        DOUT("page state: %X\n", frame->GetState() | frame->GetAccessState());
-        // NOTE: The fault address is referenced in the 1st branch (1) at the
-        // next time as it is registered.
-        space->InsertMap(faddr, frame);
+        if (IS_WRITABLE(rwx)) {
+            DOUT("page state: %X\n",
+                 frame->GetState() | frame->GetAccessState());
+            // NOTE: The fault address is referenced in the 1st branch (1) at
+            // the next time as it is registered.
+            space->InsertMap(faddr, frame);
+
+            // A write to a heap or a stack tends to continue to the next
+            // pages.
+            count = FaultAroundAnonymous(space, faddr, count);
+        }
     }
 
+reply:
     L4_Clear(msg);
-    L4_Put(msg, 0, 0, (L4_Word_t *)0, 2, &_mapregs[0]);
+    L4_Put(msg, 0, 0, (L4_Word_t *)0, 2 * count, &_mapregs[0]);
 
     EXIT;
     return ERR_NONE;
@@ -548,7 +814,7 @@ HandlePageAllocate(L4_ThreadId_t tid, L4_Msg_t *msg)
     PageFrame       *frame;
     Space           *space;
     Space           *to_space;
-    L4_Word_t       dest, count, peerAttr;
+    L4_Word_t       dest, count, peerAttr, rights;
     L4_ThreadId_t   peer;
 
     ENTER;
@@ -564,6 +830,9 @@ HandlePageAllocate(L4_ThreadId_t tid, L4_Msg_t *msg)
     dest = L4_Get(msg, 0);
     count = L4_Get(msg, 1);
     peerAttr = L4_Get(msg, 2);
+    if (count == 0) {
+        return Ipc::ReturnError(msg, ERR_INVALID_ARGUMENTS);
+    }
 
     //
     // 'peer' is the thread that is allowed to share the pages allocated here.
@@ -588,7 +857,7 @@ HandlePageAllocate(L4_ThreadId_t tid, L4_Msg_t *msg)
         // Find the space of the peer
         // XXX: Shouldn't _peer_ be the main thread of the space?
         if (FindTask(peer, &to_space) != ERR_NONE) {
-            Ipc::ReturnError(msg, ERR_INVALID_THREAD);
+            return Ipc::ReturnError(msg, ERR_INVALID_THREAD);
         }
 
 #ifdef PEL_DISABLE
@@ -615,22 +884,50 @@ HandlePageAllocate(L4_ThreadId_t tid, L4_Msg_t *msg)
         return Ipc::ReturnError(msg, ERR_OUT_OF_MEMORY);
     }
 
-    for (L4_Word_t i = 0; i < frame->GetPageGroup(); i++) {
+    //
+    // The task releases the pages one by one.  Only the pages requested are
+    // kept, each as a block of its own.
+    //
+    MainPa.Divide(frame, count);
+
+    // The peer may be allowed to take the pages over by a move.
+    rights = peerAttr & PAGE_PERM_MASK;
+    if ((peerAttr & MSG_PAGER_MAP_MOVE) != 0) {
+        rights |= PAGE_PERM_MOVE;
+    }
+
+    for (L4_Word_t i = 0; i < count; i++) {
         PageFrame   *f = frame + i;
 
         f->SetOwner(space->GetRootThread()->Id);
         f->SetOwnerRights(L4_Label(msg));
         f->SetSharer(peer);
-        f->SetSharerRights(peerAttr);
-        f->SetDestination(dest);
+        f->SetSharerRights(rights);
+        f->SetDestination(dest + PAGE_SIZE * i);
+    }
 
-        space->InsertMap(dest, f);
-        dest += PAGE_SIZE;
+    //
+    // Register an aligned run of private pages as a superpage, so that it is
+    // mapped by a single page fault.
+    //
+    // Writes to superpages are not tracked by incremental snapshots.
+    for (L4_Word_t i = 0; i < count; ) {
+        if (!frame->IsShared() && !space->IsIncrementalSnapshot() &&
+            i + SUPERPAGE_PAGES <= count &&
+            Pg.IsSuperAligned(dest, frame + i)) {
+            space->InsertSuperMap(dest, frame + i);
+            dest += SUPERPAGE_SIZE;
+            i += SUPERPAGE_PAGES;
+        }
+        else {
+            space->InsertMap(dest, frame + i);
+            dest += PAGE_SIZE;
+            i++;
+        }
     }
 
     EXIT;
-    L4_Word_t len = frame->GetPageGroup();
-    L4_Put(msg, ERR_NONE, 1, &len, 0, (void *)0);
+    L4_Put(msg, ERR_NONE, 1, &count, 0, (void *)0);
     return ERR_NONE;
 }
 
@@ -658,14 +955,17 @@ HandlePageRelease(L4_ThreadId_t tid, L4_Msg_t *msg)
     // Unmap the pages
     //
     if (space->SearchMap(address, &frame) != ERR_NONE) {
+        L4_Word_t slot;
+        if (space->RemoveSwap(address, &slot) == ERR_NONE) {
+            MainSwap.Discard(slot);
+            return Ipc::ReturnError(msg, ERR_NONE);
+        }
         return Ipc::ReturnError(msg, ERR_NOT_FOUND);
     }
 
-    for (L4_Word_t i = 0; i < frame->GetPageGroup(); i++) {
-        PageFrame   *f = frame + i;
-        Pg.Unmap(f, L4_FullyAccessible);
-        space->RemoveMap(address + PAGE_SIZE * i);
-    }
+    // Only the page at the address goes; a superpage covering it is split.
+    Pg.Unmap(frame, L4_FullyAccessible);
+    space->RemoveMap(address);
 
     // Release the frame in the PF handler if it is shared.
     if (!frame->IsShared()) {
@@ -675,6 +975,85 @@ HandlePageRelease(L4_ThreadId_t tid, L4_Msg_t *msg)
     return Ipc::ReturnError(msg, ERR_NONE);
 }
 
+///
+/// Creates the map item of a page registered to the space.  A copy-on-write
+/// page mapped writable is copied to a new frame first.
+///
+/// @param space    the address space
+/// @param addr     the address of the page
+/// @param rwx      the permission to be given
+/// @param item     the map item is stored here
+///
+static stat_t
+MapRegistered(Space *space, addr_t addr, L4_Word_t rwx, L4_MapItem_t *item)
+{
+    PageFrame   *frame;
+    PageFrame   *newf;
+    stat_t      err;
+
+    if (space->SearchMap(addr, &frame) != ERR_NONE) {
+        return ERR_NOT_FOUND;
+    }
+
+    if (!frame->IsCOW() || !IS_WRITABLE(rwx)) {
+        return Pg.CreateMapItem(addr, frame, rwx, item);
+    }
+
+    // Copy on write
+    if (MainPa.Allocate(1, &newf) != ERR_NONE) {
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    DOUT("COW %.8lX (%.8lx -> %.8lX)\n",
+         addr, Pg.PhysicalAddress(frame), Pg.PhysicalAddress(newf));
+
+    // Remember it's write-accessed.
+    frame->AddAccessState(PAGE_STATE_WRITE);
+
+    Pg.CopyPage(newf, frame);
+    newf->SetOwner(space->GetRootThread()->Id);
+    newf->SetOwnerRights(newf->GetOwnerRights() | PAGE_PERM_WRITE);
+    newf->SetSharerRights(PAGE_PERM_NONE);
+    newf->SetAttribute(0);
+
+    err = Pg.CreateMapItem(addr, newf, newf->GetOwnerRights(), item);
+    if (err != ERR_NONE) {
+        MainPa.Release(newf);
+        return err;
+    }
+
+    // Update the mapping database
+    if (space->SetMap(addr, newf) == FALSE) {
+        FATAL("map DB inconsistency");
+    }
+    MainMerger.Unshare(space, addr, frame, newf);
+    return ERR_NONE;
+}
+
+///
+/// Releases a frame that another frame has replaced in the mapping database
+/// of the space.  A copy-on-write or merged frame the snapshots of the space
+/// still refer to is left to them.  A merged frame is kept mapped to the
+/// other spaces and only loses the reference of this space.
+///
+/// @param space    the address space
+/// @param frame    the replaced frame
+///
+static void
+ReleaseReplaced(Space *space, PageFrame *frame)
+{
+    if (space->HasSnapshots() && (frame->IsCOW() || frame->IsMerged())) {
+        // Released together with the snapshot, like a copied-on-write page
+        frame->AddAccessState(PAGE_STATE_WRITE);
+        return;
+    }
+
+    if (!frame->IsMerged()) {
+        Pg.Unmap(frame, L4_FullyAccessible);
+    }
+    MainPa.Release(frame);
+}
+
 ///
 /// Handles page mapping protocol. Maps an anonymous page if source page is
 /// not specified.  Maps a read-only page if source page is specified.
@@ -685,30 +1064,31 @@ HandleMapRequest(L4_ThreadId_t tid, L4_Msg_t *msg)
     Space*          from_space;
     Space*          to_space;
     PageFrame*      frame;
+    PageFrame*      old;
     L4_Word_t       from_addr;
     L4_Word_t       to_addr;
     L4_Word_t       count;
     L4_Word_t       rwx;
     L4_ThreadId_t   from_sid;
     L4_ThreadId_t   to_sid;
+    PagerMapRequest req;
     stat_t          err;
 
     ENTER;
 
-    if (Ipc::CheckPayload(msg, 0, 5)) {
+    if (!PagerMapMessage::Get(msg, &req)) {
         return Ipc::ReturnError(msg, ERR_INVALID_ARGUMENTS);
     }
 
-    to_addr = L4_Get(msg, 0);
-    to_addr &= PAGE_MASK;
-    to_sid.raw = L4_Get(msg, 1);
+    to_addr = req.dest & PAGE_MASK;
+    to_sid = req.did;
     if (FindTask(to_sid, &to_space) != ERR_NONE) {
         return Ipc::ReturnError(msg, ERR_INVALID_SPACE);
     }
 
-    from_addr = L4_Get(msg, 2);
-    from_sid.raw = L4_Get(msg, 3);
-    count = L4_Get(msg, 4);
+    from_addr = req.src;
+    from_sid = req.sid;
+    count = req.count;
     rwx = L4_Label(msg) & PAGE_PERM_MASK;
 
 #ifdef SYS_DEBUG
@@ -727,46 +1107,9 @@ HandleMapRequest(L4_ThreadId_t tid, L4_Msg_t *msg)
     //
     if (L4_ThreadNo(from_sid) == L4_ThreadNo(to_sid)) {
         DOUT("Search reserved pages\n");
-        if (to_space->SearchMap(to_addr, &frame) != ERR_NONE) {
-            return Ipc::ReturnError(msg, ERR_NOT_FOUND);
-        }
-
-        // Copy on write
-        if (frame->IsCOW() && IS_WRITABLE(rwx)) {
-            PageFrame   *newf;
-
-            if (MainPa.Allocate(1, &newf) != ERR_NONE) {
-                return Ipc::ReturnError(msg, ERR_OUT_OF_MEMORY);
-            }
-
-            DOUT("COW %.8lX (%.8lx -> %.8lX)\n",
-                 to_addr, Pg.PhysicalAddress(frame),
-                 Pg.PhysicalAddress(newf));
-
-            // Remember it's write-accessed.
-            frame->AddAccessState(PAGE_STATE_WRITE);
-
-            Pg.CopyPage(newf, frame);
-            newf->SetOwner(to_space->GetRootThread()->Id);
-            newf->SetOwnerRights(newf->GetOwnerRights() | PAGE_PERM_WRITE);
-            newf->SetSharerRights(PAGE_PERM_NONE);
-            newf->SetAttribute(0);
-
-            err = Pg.CreateMapItem(to_addr, newf, newf->GetOwnerRights(),
-                                   &_mapregs[0]);
-            if (err != ERR_NONE) {
-                MainPa.Release(newf);
-                return Ipc::ReturnError(msg, err);
-            }
-
-            // Update the mapping database
-            if (to_space->SetMap(to_addr, newf) == FALSE) {
-                FATAL("map DB inconsistency");
-            }
-        }
-        else {
-            // Arrange the map registers
-            err = Pg.CreateMapItem(to_addr, frame, rwx, count, _mapregs);
+        for (L4_Word_t i = 0; i < count; i++) {
+            err = MapRegistered(to_space, to_addr + PAGE_SIZE * i, rwx,
+                                &_mapregs[i]);
             if (err != ERR_NONE) {
                 return Ipc::ReturnError(msg, err);
             }
@@ -779,76 +1122,47 @@ HandleMapRequest(L4_ThreadId_t tid, L4_Msg_t *msg)
              && from_addr == 0UL) {
         DOUT("Get anonymous pages\n");
         if (to_space->SearchMap(to_addr, &frame) == ERR_NONE) {
-            // Copy on write
-            if (frame->IsCOW() && IS_WRITABLE(rwx)) {
-                PageFrame   *newf;
-
-                if (MainPa.Allocate(1, &newf) != ERR_NONE) {
-                    return Ipc::ReturnError(msg, ERR_OUT_OF_MEMORY);
-                }
-
-                DOUT("COW %.8lX (%.8lx -> %.8lX)\n",
-                     to_addr, Pg.PhysicalAddress(frame),
-                     Pg.PhysicalAddress(newf));
-
-                // Remember it's write-accessed.
-                frame->AddAccessState(PAGE_STATE_WRITE);
-
-                Pg.CopyPage(newf, frame);
-                newf->SetOwner(to_space->GetRootThread()->Id);
-                newf->SetOwnerRights(newf->GetOwnerRights() | PAGE_PERM_WRITE);
-                newf->SetSharerRights(PAGE_PERM_NONE);
-                newf->SetAttribute(0);
-
-                DOUT("owner rights: %lX\n", newf->GetOwnerRights());
-                err = Pg.CreateMapItem(to_addr, newf, newf->GetOwnerRights(),
-                                       &_mapregs[0]);
-                if (err != ERR_NONE) {
-                    MainPa.Release(newf);
-                    return Ipc::ReturnError(msg, err);
-                }
-                DOUT("new frame state: %X\n",
-                     newf->GetState() | newf->GetAccessState());
-
-                // Update the mapping database
-                if (to_space->SetMap(to_addr, newf) == FALSE) {
-                    FATAL("map DB inconsistency");
-                }
-            }
-            else {
-                // The page is already allocated.
-                err = Pg.CreateMapItem(to_addr, frame, rwx, count, _mapregs);
+            // The pages are already allocated.
+            for (L4_Word_t i = 0; i < count; i++) {
+                err = MapRegistered(to_space, to_addr + PAGE_SIZE * i, rwx,
+                                    &_mapregs[i]);
                 if (err != ERR_NONE) {
-                    MainPa.Release(frame);
                     return Ipc::ReturnError(msg, err);
                 }
             }
         }
         // No page is mapped to the destination
         else {
-            // Allocate a page
-            err = MainPa.Allocate(count, &frame);
+            // Allocate a page.  A single page comes zeroed.
+            if (count == 1) {
+                err = MainPa.AllocateZeroed(&frame);
+            }
+            else {
+                err = MainPa.Allocate(count, &frame);
+            }
             if (err != ERR_NONE) {
                 return Ipc::ReturnError(msg, err);
             }
 
-            frame->SetOwner(to_sid);
-            frame->SetOwnerRights(rwx);
-            frame->SetDestination(to_addr);
-
             err = Pg.CreateMapItem(to_addr, frame, rwx, count, _mapregs);
             if (err != ERR_NONE) {
                 MainPa.Release(frame);
                 return Ipc::ReturnError(msg, err);
             }
 
+            // Register the pages to the mapping DB.  Each page is released
+            // on its own.
+            MainPa.Divide(frame, count);
             for (L4_Word_t i = 0; i < count; i++) {
-                Pg.ZeroPage(frame + i);
-            }
+                PageFrame   *f = frame + i;
 
-            // Register the page to the mapping DB
-            for (L4_Word_t i = 0; i < count; i++) {
-                to_space->InsertMap(to_addr + PAGE_SIZE * i, frame);
+                if (count != 1) {
+                    Pg.ZeroPage(f);
+                }
+                f->SetOwner(to_sid);
+                f->SetOwnerRights(rwx);
+                f->SetDestination(to_addr + PAGE_SIZE * i);
+                to_space->InsertMap(to_addr + PAGE_SIZE * i, f);
             }
         }
     }
@@ -920,15 +1234,11 @@ HandleMapRequest(L4_ThreadId_t tid, L4_Msg_t *msg)
             }
         }
 #endif
-        for (L4_Word_t i = 0; i < count; i++) {
-            if (to_space->SearchMap(to_addr + PAGE_SIZE * i, &frame) ==
-                    ERR_NONE) {
-                Pg.Unmap(frame, L4_FullyAccessible);
-                to_space->RemoveMap(to_addr + PAGE_SIZE * i);
-                MainPa.Release(frame);
-            }
-        }
 
+        //
+        // The source pages are not necessarily contiguous frames, so each
+        // page is looked up, checked and mapped on its own.
+        //
         for (L4_Word_t i = 0; i < count; i++) {
             if (from_space->SearchMap(from_addr + PAGE_SIZE * i, &frame) !=
                     ERR_NONE) {
@@ -940,7 +1250,7 @@ HandleMapRequest(L4_ThreadId_t tid, L4_Msg_t *msg)
             //
             // The frame to be mapped must be owned by from_sid
             //
-            if (L4_ThreadNo(frame[i].GetOwner()) !=
+            if (L4_ThreadNo(frame->GetOwner()) !=
                     L4_ThreadNo(from_space->GetRootThread()->Id)) {
                 System.Print(System.ERROR, "Invalid owner\n");
                 DOUT("Invalid owner\n");
@@ -950,7 +1260,7 @@ HandleMapRequest(L4_ThreadId_t tid, L4_Msg_t *msg)
             //
             // Check authentication
             //
-            L4_ThreadId_t peer = frame[i].GetSharer();
+            L4_ThreadId_t peer = frame->GetSharer();
             if (L4_ThreadNo(peer) != L4_ThreadNo(L4_anythread) && 
                 L4_ThreadNo(peer) !=
                     L4_ThreadNo(to_space->GetRootThread()->Id)) {
@@ -965,28 +1275,66 @@ HandleMapRequest(L4_ThreadId_t tid, L4_Msg_t *msg)
             //
             // Check permission
             //
-            if (((rwx ^ frame[i].GetSharerRights()) &
-                 ~frame[i].GetSharerRights()) != 0) {
+            if (((rwx ^ frame->GetSharerRights()) &
+                 ~frame->GetSharerRights()) != 0) {
                 System.Print(System.ERROR, "invalid rights: %.8lX %.8lX\n",
-                             rwx, frame[i].GetSharerRights());
+                             rwx, frame->GetSharerRights());
                 DOUT("invalid rights: %.8lX %.8lX\n",
-                     rwx, frame[i].GetSharerRights());
+                     rwx, frame->GetSharerRights());
                 return Ipc::ReturnError(msg, ERR_INVALID_RIGHTS);
             }
-        }
 
-        //
-        // Map
-        //
-        err = Pg.CreateMapItem(to_addr, frame, rwx, count, _mapregs);
-        if (err != ERR_NONE) {
-            MainPa.Release(frame);
-            return Ipc::ReturnError(msg, err);
-        }
+            //
+            // Move the ownership of the frame.  The source loses the page,
+            // so the frame is never written by the source again.  The owner
+            // must have reserved the page with the right to take it.
+            //
+            // A copy-on-write or merged frame is referred to by snapshots
+            // or by other spaces, so it cannot change hands.
+            //
+            if ((L4_Label(msg) & MSG_PAGER_MAP_MOVE) != 0) {
+                if ((frame->GetSharerRights() & PAGE_PERM_MOVE) == 0 ||
+                    frame->IsCOW() || frame->IsMerged()) {
+                    System.Print(System.ERROR, "no right to move: %.8lX\n",
+                                 from_addr + PAGE_SIZE * i);
+                    return Ipc::ReturnError(msg, ERR_INVALID_RIGHTS);
+                }
+                Pg.Unmap(frame, L4_FullyAccessible);
+                from_space->RemoveMap(from_addr + PAGE_SIZE * i);
+                frame->SetOwner(to_space->GetRootThread()->Id);
+                frame->SetOwnerRights(PAGE_PERM_READ_WRITE);
+                frame->SetSharer(L4_nilthread);
+                frame->SetSharerRights(PAGE_PERM_NONE);
+                frame->SetAttribute(0);
+            }
 
-        for (L4_Word_t i = 0; i < count; i++) {
-            to_space->InsertMap(to_addr, &frame[i]);
-            to_addr += PAGE_SIZE;
+            //
+            // Map
+            //
+            err = Pg.CreateMapItem(to_addr + PAGE_SIZE * i, frame, rwx,
+                                   &_mapregs[i]);
+            if (err != ERR_NONE) {
+                return Ipc::ReturnError(msg, err);
+            }
+
+            //
+            // Replace the page registered at the destination, if any.
+            // SetMap splits a superpage covering it and records the change
+            // for the incremental snapshot.
+            //
+            if (to_space->SearchMap(to_addr + PAGE_SIZE * i, &old) ==
+                    ERR_NONE) {
+                if (old != frame) {
+                    if (to_space->SetMap(to_addr + PAGE_SIZE * i, frame) ==
+                            FALSE) {
+                        FATAL("map DB inconsistency");
+                    }
+                    ReleaseReplaced(to_space, old);
+                }
+            }
+            else {
+                to_space->InsertMap(to_addr + PAGE_SIZE * i, frame);
+            }
         }
     }
 
@@ -1025,7 +1373,7 @@ HandleUnmapRequest(L4_ThreadId_t tid, L4_Msg_t *msg)
     }
 
     rwx = L4_Label(msg) & PAGE_PERM_MASK;
-    attr = frame->GetSharerRights();
+    attr = frame->GetSharerRights() & PAGE_PERM_MASK;
     if (((rwx ^ attr) & ~attr) == 0) {
         // Not owner, return.
         return Ipc::ReturnError(msg, ERR_NONE);
@@ -1255,3 +1603,23 @@ HandleMapBiosPage(L4_ThreadId_t tid, L4_Msg_t *msg)
     return ERR_NONE;
 }
 
+///
+/// Scans the next pages to merge for the page merger.  The merger changes
+/// the mapping DBs and the page frames as the page faults do, so it runs
+/// here in the pager thread.
+///
+static stat_t
+HandleMergeScan(L4_ThreadId_t tid, L4_Msg_t *msg)
+{
+    ENTER;
+
+    if (!L4_IsThreadEqual(tid, MergerId)) {
+        return Ipc::ReturnError(msg, ERR_INVALID_RIGHTS);
+    }
+
+    MainMerger.Scan();
+
+    L4_Put(msg, ERR_NONE, 0, 0, 0, 0);
+    EXIT;
+    return ERR_NONE;
+}
@@ -0,0 +1,223 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @brief  Pool of the compressed snapshot pages
+/// @file   Services/Root/SnapshotPool.cc
+/// @since  October 2008
+///
+
+//#define SYS_DEBUG
+//#define SYS_DEBUG_CALL
+
+#include <Debug.h>
+#include <Types.h>
+#include <sys/Config.h>
+
+#include "Common.h"
+#include "PageAllocator.h"
+#include "PageFrame.h"
+#include "PageFrameTable.h"
+#include "SnapshotPool.h"
+
+#include <l4/types.h>
+
+SnapshotPool    MainSnapshotPool;
+
+static const size_t PAGE_WORDS = PAGE_SIZE / sizeof(L4_Word_t);
+
+void
+SnapshotPool::Initialize()
+{
+    _chunks = 0;
+    _pages = 0;
+    _packed = 0;
+}
+
+size_t
+SnapshotPool::Encode(const L4_Word_t* page, const L4_Word_t* base,
+                     L4_Word_t* out)
+{
+    size_t  i = 0;
+    size_t  n = 0;
+
+#define DIFF(i)     (base == 0 ? page[i] : page[i] ^ base[i])
+
+    while (i < PAGE_WORDS) {
+        size_t  zeros = 0;
+        size_t  literals = 0;
+
+        while (i < PAGE_WORDS && DIFF(i) == 0) {
+            zeros++;
+            i++;
+        }
+        while (i + literals < PAGE_WORDS && DIFF(i + literals) != 0) {
+            literals++;
+        }
+
+        if (out != 0) {
+            out[n] = (zeros << 16) | literals;
+            for (size_t j = 0; j < literals; j++) {
+                out[n + 1 + j] = DIFF(i + j);
+            }
+        }
+        n += 1 + literals;
+        i += literals;
+
+        if (out == 0 && n > MAX_PACKED_WORDS) {
+            break;
+        }
+    }
+
+#undef DIFF
+
+    return n;
+}
+
+void*
+SnapshotPool::Allocate(size_t size)
+{
+    Chunk*  chunk = _chunks;
+    void*   ptr;
+
+    size = (size + sizeof(L4_Word_t) - 1) & ~(sizeof(L4_Word_t) - 1);
+
+    if (chunk == 0 || PAGE_SIZE - chunk->used < size) {
+        PageFrame*  frame;
+
+        if (MainPa.Allocate(1, &frame) != ERR_NONE) {
+            return 0;
+        }
+        chunk = reinterpret_cast<Chunk*>(MainPft.GetAddress(frame));
+        chunk->next = _chunks;
+        chunk->used = sizeof(Chunk);
+        chunk->live = 0;
+        _chunks = chunk;
+        _pages++;
+    }
+
+    ptr = reinterpret_cast<UByte*>(chunk) + chunk->used;
+    chunk->used += size;
+    chunk->live++;
+    return ptr;
+}
+
+void
+SnapshotPool::Free(void* ptr)
+{
+    Chunk*  chunk = reinterpret_cast<Chunk*>(
+                        reinterpret_cast<addr_t>(ptr) & ~(PAGE_SIZE - 1));
+
+    chunk->live--;
+    if (chunk->live > 0) {
+        return;
+    }
+
+    for (Chunk** cur = &_chunks; *cur != 0; cur = &(*cur)->next) {
+        if (*cur == chunk) {
+            *cur = chunk->next;
+            break;
+        }
+    }
+    MainPa.Release(MainPft.GetFrame(reinterpret_cast<addr_t>(chunk)));
+    _pages--;
+}
+
+SnapshotPool::PackedPage*
+SnapshotPool::Pack(L4_Word_t address, PageFrame* frame, PageFrame* base)
+{
+    const L4_Word_t*    p;
+    const L4_Word_t*    b = 0;
+    PackedPage*         packed;
+    size_t              length;
+
+    p = reinterpret_cast<const L4_Word_t*>(MainPft.GetAddress(frame));
+    if (base != 0) {
+        b = reinterpret_cast<const L4_Word_t*>(MainPft.GetAddress(base));
+    }
+
+    length = Encode(p, b, 0);
+    if (length > MAX_PACKED_WORDS) {
+        return 0;
+    }
+
+    packed = reinterpret_cast<PackedPage*>(
+                Allocate(sizeof(PackedPage) + length * sizeof(L4_Word_t)));
+    if (packed == 0) {
+        return 0;
+    }
+
+    packed->next = 0;
+    packed->address = address;
+    packed->length = Encode(p, b, packed->Data());
+    _packed++;
+
+    DOUT("pack %.8lX: %lu words\n", address, packed->length);
+    return packed;
+}
+
+void
+SnapshotPool::Unpack(PackedPage* page, PageFrame* base, PageFrame* frame)
+{
+    const L4_Word_t*    data = page->Data();
+    const L4_Word_t*    b = 0;
+    L4_Word_t*          p;
+    size_t              i = 0;
+    size_t              n = 0;
+
+    p = reinterpret_cast<L4_Word_t*>(MainPft.GetAddress(frame));
+    if (base != 0) {
+        b = reinterpret_cast<const L4_Word_t*>(MainPft.GetAddress(base));
+    }
+
+    while (n < page->length) {
+        size_t  zeros = data[n] >> 16;
+        size_t  literals = data[n] & 0xFFFF;
+
+        n++;
+        for (size_t j = 0; j < zeros; j++, i++) {
+            p[i] = (b == 0 ? 0 : b[i]);
+        }
+        for (size_t j = 0; j < literals; j++, i++, n++) {
+            p[i] = (b == 0 ? data[n] : data[n] ^ b[i]);
+        }
+    }
+}
+
+void
+SnapshotPool::Release(PackedPage* page)
+{
+    while (page != 0) {
+        PackedPage* next = page->next;
+
+        Free(page);
+        _packed--;
+        page = next;
+    }
+}
@@ -0,0 +1,171 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @brief  Pool of the compressed snapshot pages
+/// @file   Services/Root/SnapshotPool.h
+/// @since  October 2008
+///
+
+#ifndef ARC_ROOT_SNAPSHOT_POOL_H
+#define ARC_ROOT_SNAPSHOT_POOL_H
+
+#include <Types.h>
+#include <sys/Config.h>
+#include <l4/types.h>
+
+class PageFrame;
+
+///
+/// Keeps the pages of the old snapshot generations in a compressed form.
+/// A page is encoded as the difference from the same page of the next newer
+/// generation: the words are XORed with the newer page and the runs of zero
+/// words are dropped.  A header word holds the length of a zero run in the
+/// upper half and the number of the literal words following it in the lower
+/// half.
+///
+/// The packed pages are carved out of the pool pages allocated from the
+/// page allocator.  A pool page is released when the last packed page in it
+/// is freed.  Since the pages of a generation are packed and freed
+/// together, the pool pages rarely stay fragmented.  The pool is used by
+/// the ProcMan thread only.
+///
+class SnapshotPool
+{
+public:
+    struct PackedPage {
+        ///
+        /// The next packed page of the same generation
+        ///
+        PackedPage*     next;
+
+        ///
+        /// The address of the page in the space
+        ///
+        L4_Word_t       address;
+
+        ///
+        /// The number of the encoded words following the header
+        ///
+        size_t          length;
+
+        L4_Word_t* Data() { return reinterpret_cast<L4_Word_t*>(this + 1); }
+    };
+
+    ///
+    /// A page is packed only if it is encoded in this number of words or
+    /// less.  The others are kept as they are.
+    ///
+    static const size_t     MAX_PACKED_WORDS =
+                                PAGE_SIZE / sizeof(L4_Word_t) / 2;
+
+private:
+    ///
+    /// The header of a pool page
+    ///
+    struct Chunk {
+        Chunk*          next;
+
+        ///
+        /// The number of bytes used including the header
+        ///
+        size_t          used;
+
+        ///
+        /// The number of packed pages in the chunk
+        ///
+        size_t          live;
+    };
+
+    ///
+    /// The pool pages.  The packed pages are allocated from the first one.
+    ///
+    Chunk*          _chunks;
+
+    size_t          _pages;
+
+    size_t          _packed;
+
+    ///
+    /// Encodes the difference of the page from the base.  Only the length
+    /// is counted if out is null.  Counting stops once the length exceeds
+    /// MAX_PACKED_WORDS.
+    ///
+    /// @param page     the page to encode
+    /// @param base     the newer page, or null for a zeroed page
+    /// @param out      the buffer of the encoded words
+    /// @return         the number of the encoded words
+    ///
+    static size_t Encode(const L4_Word_t* page, const L4_Word_t* base,
+                         L4_Word_t* out);
+
+    void* Allocate(size_t size);
+
+    void Free(void* ptr);
+
+public:
+    void Initialize();
+
+    ///
+    /// Encodes the frame against the base frame.
+    ///
+    /// @param address  the address of the page in the space
+    /// @param frame    the frame to pack
+    /// @param base     the frame of the newer generation, or null if the
+    ///                 page did not exist in the newer generation
+    /// @return         the packed page, or null if the frame does not
+    ///                 shrink enough or the pool is out of memory
+    ///
+    PackedPage* Pack(L4_Word_t address, PageFrame* frame, PageFrame* base);
+
+    ///
+    /// Decodes the packed page into the frame.  The base must have the
+    /// same content as the one given to Pack().
+    ///
+    void Unpack(PackedPage* page, PageFrame* base, PageFrame* frame);
+
+    ///
+    /// Frees the packed pages chained from the page.
+    ///
+    void Release(PackedPage* page);
+
+    ///
+    /// Obtains the number of the pages allocated to the pool.
+    ///
+    size_t Pages() { return _pages; }
+
+    ///
+    /// Obtains the number of the pages packed in the pool.
+    ///
+    size_t Packed() { return _packed; }
+};
+
+extern SnapshotPool MainSnapshotPool;
+
+#endif // ARC_ROOT_SNAPSHOT_POOL_H
@@ -39,6 +39,11 @@
 #ifndef ARC_ROOT_SNAPSHOT_STORE
 #define ARC_ROOT_SNAPSHOT_STORE
 
+///
+/// The stack of snapshots.  SIZE is the capacity of the store; the depth,
+/// the number of items kept before the oldest one is pushed out, can be
+/// changed at run time up to SIZE.
+///
 template <typename T, int SIZE>
 class SnapshotStore
 {
@@ -46,6 +51,7 @@ protected:
     T       _container[SIZE];
     int     _count;
     int     _wp;
+    int     _depth;
 
 public:
     SnapshotStore();
@@ -68,16 +74,44 @@ public:
     ///
     T Pop();
 
+    ///
+    /// Removes the oldest item from the bottom of the stack.
+    ///
+    /// @return             the oldest item
+    ///
+    T Shift();
+
+    ///
+    /// Obtains the item at the index.  The latest item is at zero.
+    ///
+    T Get(UInt index) const;
+
+    ///
+    /// Replaces the item at the index.  The latest item is at zero.
+    ///
+    void Set(UInt index, T item);
+
     ///
     /// Obtains the number of elements in the stack.
     ///
     /// @return             the number of elements
     ///
     UInt Length() const;
+
+    UInt Depth() const { return static_cast<UInt>(_depth); }
+
+    ///
+    /// Sets the depth of the stack, which is rounded into 1 to SIZE.  The
+    /// items beyond the new depth stay until the caller shifts them out.
+    ///
+    void SetDepth(UInt depth);
+
+private:
+    int Index(UInt index) const { return (_wp + SIZE - 1 - index) % SIZE; }
 };
 
 template <typename T, int SIZE>
-SnapshotStore<T, SIZE>::SnapshotStore() : _count(0), _wp(0)
+SnapshotStore<T, SIZE>::SnapshotStore() : _count(0), _wp(0), _depth(SIZE)
 {
 }
 
@@ -95,11 +129,8 @@ SnapshotStore<T, SIZE>::Push(T item)
 {
     T old = 0;
 
-    if (_count == SIZE) {
-        old = _container[_wp];
-    }
-    else {
-        _count++;
+    if (_count >= _depth) {
+        old = Shift();
     }
 
     _container[_wp] = item;
@@ -109,6 +140,7 @@ SnapshotStore<T, SIZE>::Push(T item)
     else {
         _wp++;
     }
+    _count++;
 
     return old;
 }
@@ -134,6 +166,39 @@ SnapshotStore<T, SIZE>::Pop()
     return item;
 }
 
+template <typename T, int SIZE>
+T
+SnapshotStore<T, SIZE>::Shift()
+{
+    if (_count == 0) {
+        return 0;
+    }
+
+    T item = _container[Index(_count - 1)];
+    _count--;
+
+    return item;
+}
+
+template <typename T, int SIZE>
+T
+SnapshotStore<T, SIZE>::Get(UInt index) const
+{
+    if (index >= static_cast<UInt>(_count)) {
+        return 0;
+    }
+    return _container[Index(index)];
+}
+
+template <typename T, int SIZE>
+void
+SnapshotStore<T, SIZE>::Set(UInt index, T item)
+{
+    if (index < static_cast<UInt>(_count)) {
+        _container[Index(index)] = item;
+    }
+}
+
 template <typename T, int SIZE>
 UInt
 SnapshotStore<T, SIZE>::Length() const
@@ -141,5 +206,18 @@ SnapshotStore<T, SIZE>::Length() const
     return static_cast<UInt>(_count);
 }
 
+template <typename T, int SIZE>
+void
+SnapshotStore<T, SIZE>::SetDepth(UInt depth)
+{
+    if (depth < 1) {
+        depth = 1;
+    }
+    else if (depth > static_cast<UInt>(SIZE)) {
+        depth = SIZE;
+    }
+    _depth = static_cast<int>(depth);
+}
+
 #endif // ARC_ROOT_SNAPSHOT_REPOSITORY
 
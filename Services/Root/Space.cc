@@ -51,6 +51,7 @@
 #include "Pager.h"
 #include "SnapshotStore.h"
 #include "Space.h"
+#include "Swap.h"
 #include "Task.h"
 #include "Thread.h"
 
@@ -64,6 +65,7 @@ extern Pager    Pg;
 Bitmap*     Space::_tid_map;
 Mutex       Space::_tid_lock;
 L4_Word_t   Space::_tid_base;
+Space*      Space::_tid_index[Config::MAX_GLOBAL_THREADS];
 
 ///
 /// Initializes the thread ID bitmap
@@ -96,19 +98,120 @@ Space::Space(L4_Fpage_t kip, L4_Fpage_t utcb, L4_Word_t usize, Bool shadow)
     _root = root;
     next = 0;
     _pager = L4_nilthread;
+    _fault_around = DEFAULT_FAULT_AROUND;
+    _resident = 0;
 
     _residents.Append(_root);
     _snapshots.Initialize();
     _thread_context.Initialize();
+    _packed.Initialize();
+    _snapshots.SetDepth(DEFAULT_SNAPSHOT_DEPTH);
+    _thread_context.SetDepth(DEFAULT_SNAPSHOT_DEPTH);
+    _packed.SetDepth(DEFAULT_SNAPSHOT_DEPTH);
+    _unpacked = DEFAULT_SNAPSHOT_DEPTH;
+    _packed_generations = 0;
+#ifdef INCREMENTAL_SNAPSHOT
+    _incremental = TRUE;
+#else
+    _incremental = FALSE;
+#endif // INCREMENTAL_SNAPSHOT
+    _dirty = new MapList_t;
+    _swapped = 0;
+    _pinned = FALSE;
+}
+
+
+///
+/// Deletes the list and its elements.  The frames are not touched.
+///
+static void
+DeleteMapList(MapList_t* ls)
+{
+    Iterator<MapListElement_t*>& it = ls->GetIterator();
+    while (it.HasNext()) {
+        delete it.Next();
+    }
+    delete ls;
+}
+
+///
+/// Finds the oldest change of the page at the address in the list.
+///
+static Bool
+FindOldest(MapList_t* ls, L4_Word_t address, PageFrame** frame)
+{
+    Bool                            found = FALSE;
+    Iterator<MapListElement_t*>&    it = ls->GetIterator();
+
+    while (it.HasNext()) {
+        MapListElement_t*   item = it.Next();
+        if (item->GetKey() == address) {
+            *frame = item->GetValue();
+            found = TRUE;
+        }
+    }
+    return found;
 }
 
 
 Space::~Space()
 {
     DeleteAllThreadObj();
+    DeleteMapList(_dirty);
+    while (_packed.Length() > 0) {
+        MainSnapshotPool.Release(_packed.Pop());
+    }
+    if (_swapped != 0) {
+        List<MapElement<addr_t, L4_Word_t>*>* ls = _swapped->ToList();
+        Iterator<MapElement<addr_t, L4_Word_t>*>& it = ls->GetIterator();
+        while (it.HasNext()) {
+            MapElement<addr_t, L4_Word_t>* item = it.Next();
+            MainSwap.Discard(item->GetValue());
+            delete item;
+        }
+        delete ls;
+        delete _swapped;
+    }
     delete _utcb_map;
 }
 
+stat_t
+Space::InsertSwap(L4_Word_t address, L4_Word_t slot)
+{
+    if (_swapped == 0) {
+        _swapped = new SwapDB_t;
+        if (_swapped == 0) {
+            return ERR_OUT_OF_MEMORY;
+        }
+    }
+    _swapped->Insert(address, slot);
+    return ERR_NONE;
+}
+
+stat_t
+Space::RemoveSwap(L4_Word_t address, L4_Word_t* slot)
+{
+    if (_swapped == 0 || !_swapped->Remove(address, *slot)) {
+        return ERR_NOT_FOUND;
+    }
+    return ERR_NONE;
+}
+
+
+void
+Space::SetFaultAround(size_t pages)
+{
+    size_t  n = 1;
+
+    if (pages > MAX_FAULT_AROUND) {
+        pages = MAX_FAULT_AROUND;
+    }
+    while (n * 2 <= pages) {
+        n *= 2;
+    }
+    _fault_around = n;
+}
+
 
 inline L4_Word_t
 Space::AllocateUtcb()
@@ -175,6 +278,8 @@ Space::CreateThread0(Thread** thread)
     th->AddressSpace = this;
     th->Irq = 0;
 
+    _tid_index[L4_ThreadNo(tid) - _tid_base] = this;
+
     *thread = th;
 
     EXIT;
@@ -203,6 +308,7 @@ void
 Space::DeleteThreadObj(Thread *thread)
 {
     if (thread != 0) {
+        _tid_index[L4_ThreadNo(thread->Id) - _tid_base] = 0;
         _residents.Remove(thread);
         ReleaseUtcb(thread->Utcb);
         ReleaseThreadId(thread->Id);
@@ -260,6 +366,8 @@ Space::InsertMap(L4_Word_t address, PageFrame *frame)
 #endif // SYS_DEBUG
 
     _map_db.Insert(address, frame);
+    _resident++;
+    MarkDirty(address, 0);
 
 #if SYS_DEBUG
     if (!_map_db.Search(address, f)) {
@@ -273,8 +381,12 @@ Space::SetMap(L4_Word_t address, PageFrame *frame)
 {
     PageFrame*  dummy;
     Bool        result;
+    Demote(address);
     result = _map_db.Update(address, frame, dummy);
     DOUT("Replace %p with %p @ %.8lX\n", dummy, frame, address);
+    if (result) {
+        MarkDirty(address, dummy);
+    }
 
 #if SYS_DEBUG
     PageFrame*  f;
@@ -296,21 +408,108 @@ Space::SearchMap(L4_Word_t address, PageFrame **frame)
 {
     ENTER;
     PageFrame*  f;
+    L4_Word_t   base;
     if (_map_db.Search(address, f)) {
         *frame = f;
         EXIT;
         return ERR_NONE;
     }
+    else if (SearchSuperMap(address, &base, &f) == ERR_NONE) {
+        *frame = f + ((address - base) >> PAGE_BITS);
+        EXIT;
+        return ERR_NONE;
+    }
     else {
         return ERR_NOT_FOUND;
     }
 }
 
+void
+Space::InsertSuperMap(L4_Word_t address, PageFrame *frame)
+{
+    frame->SetAttribute(frame->GetAttribute() | PAGE_ATTR_SUPER);
+    InsertMap(address & SUPERPAGE_MASK, frame);
+    _resident += SUPERPAGE_PAGES - 1;
+}
+
+stat_t
+Space::SearchSuperMap(L4_Word_t address, L4_Word_t *base, PageFrame **frame)
+{
+    PageFrame*  f;
+    L4_Word_t   b = address & SUPERPAGE_MASK;
+
+    if (_map_db.Search(b, f) && f->IsSuper()) {
+        *base = b;
+        *frame = f;
+        return ERR_NONE;
+    }
+    return ERR_NOT_FOUND;
+}
+
+void
+Space::RemoveSuperMap(L4_Word_t address)
+{
+    PageFrame*  f;
+    L4_Word_t   base;
+
+    if (SearchSuperMap(address, &base, &f) == ERR_NONE) {
+        f->SetAttribute(f->GetAttribute() & ~PAGE_ATTR_SUPER);
+        _map_db.Remove(base, f);
+        _resident -= SUPERPAGE_PAGES;
+    }
+}
+
+void
+Space::Demote(L4_Word_t address)
+{
+    PageFrame*  f;
+    L4_Word_t   base;
+
+    if (SearchSuperMap(address, &base, &f) != ERR_NONE) {
+        return;
+    }
+
+    DOUT("demote superpage @ %.8lX\n", base);
+    f->SetAttribute(f->GetAttribute() & ~PAGE_ATTR_SUPER);
+    for (L4_Word_t i = 1; i < SUPERPAGE_PAGES; i++) {
+        _map_db.Insert(base + PAGE_SIZE * i, f + i);
+    }
+
+    // The pages were tracked as one entry.  Let the next incremental
+    // snapshot protect each of them.
+    for (L4_Word_t i = 0; i < SUPERPAGE_PAGES; i++) {
+        MarkDirty(base + PAGE_SIZE * i, f + i);
+    }
+}
+
+void
+Space::DemoteAll()
+{
+    MapList_t*                      list = _map_db.ToList();
+    Iterator<MapListElement_t*>&    it = list->GetIterator();
+
+    while (it.HasNext()) {
+        MapListElement_t*   item = it.Next();
+        if (item->GetValue()->IsSuper()) {
+            Demote(item->GetKey());
+        }
+    }
+    DeleteMapList(list);
+}
+
 stat_t
 Space::Snapshot(addr_t ip, addr_t sp)
 {
     ENTER;
 
+    // The first snapshot of the incremental mode walks all the pages.
+    if (_incremental && _snapshots.Length() > 0) {
+        return SnapshotIncremental(ip, sp);
+    }
+
+    // Snapshots are taken page by page.  Split the superpages first.
+    DemoteAll();
+
     // Dump the mapping DB to a list
     // Note: the list is released in Restore().
     MapList_t*                      list = _map_db.ToList();
@@ -318,58 +517,461 @@ Space::Snapshot(addr_t ip, addr_t sp)
 
     // Drop writable state of all writable mapped pages and make them
     // copy-on-write to protect them from being overwritten.
+    while (it.HasNext()) {
+        ProtectFrame(it.Next()->GetValue());
+    }
+
+    // The base of incremental snapshots has no changes to revert.
+    if (_incremental) {
+        DeleteMapList(list);
+        list = new MapList_t;
+    }
+
+    ThreadContext *tc = new ThreadContext;
+    tc->ip = ip;
+    tc->sp = sp;
+
+    DOUT("IP: %.8lX SP: %.8lX DB: %p\n", ip, sp, list);
+
+    if (_snapshots.Length() >= _snapshots.Depth()) {
+        DropOldest();
+    }
+    _snapshots.Push(list);
+    _thread_context.Push(tc);
+    _packed.Push(0);
+
+    EXIT;
+    return ERR_NONE;
+}
+
+void
+Space::ReleaseSnapshot(MapList_t* ls)
+{
+    Int                             counter = 0;
+    Iterator<MapListElement_t*>&    it = ls->GetIterator();
+
     while (it.HasNext()) {
         MapListElement_t*   item = it.Next();
         PageFrame*          frame = item->GetValue();
 
-        DOUT("virt:%.8lX phys:%.8lX state: 0x%X attr: 0x%X\n",
-             item->GetKey(), Pg.PhysicalAddress(frame),
-             frame->GetState() | frame->GetAccessState(),
-             frame->GetAttribute());
+        if (frame->IsSnapshot() &&
+            frame->IsAccessed(PAGE_STATE_WRITE) &&
+            frame->GetOwner() == _root->Id) {
+            // A copy of the page exists.  We can release the original.
+            MainPa.Release(frame);
+            counter++;
+        }
+    }
+    DOUT("%ld pages are released\n", counter);
+    delete ls;
+}
+
+void
+Space::DropOldest()
+{
+    MapList_t*      ls = _snapshots.Shift();
+    ThreadContext*  tc = _thread_context.Shift();
 
-        if (frame->IsAccessed(PAGE_STATE_WRITE)) {
-            Pg.Unmap(frame, PAGE_PERM_WRITE);
-            frame->SetAttribute(PAGE_ATTR_COW | PAGE_ATTR_SNAPSHOT);
-            DOUT("Change to COW\n");
+    MainSnapshotPool.Release(_packed.Shift());
+    if (_packed_generations > 0) {
+        _packed_generations--;
+    }
+
+    if (ls != 0) {
+        if (_incremental) {
+            ReleaseChanges(ls);
+        }
+        else {
+            ReleaseSnapshot(ls);
+        }
+    }
+    if (tc != 0) {
+        DOUT("Old snapshot released: IP: %.8lX SP: %.8lX\n", tc->ip, tc->sp);
+        delete tc;
+    }
+}
+
+void
+Space::ProtectFrame(PageFrame* frame)
+{
+    DOUT("phys:%.8lX state: 0x%X attr: 0x%X\n",
+         Pg.PhysicalAddress(frame),
+         frame->GetState() | frame->GetAccessState(),
+         frame->GetAttribute());
+
+    // A merged frame is copied on write already.
+    if (frame->IsAccessed(PAGE_STATE_WRITE) && !frame->IsMerged()) {
+        Pg.Unmap(frame, PAGE_PERM_WRITE);
+        frame->SetAttribute(PAGE_ATTR_COW | PAGE_ATTR_SNAPSHOT);
+        DOUT("Change to COW\n");
+    }
+    frame->IncrementGeneration();
+}
+
+stat_t
+Space::SnapshotIncremental(addr_t ip, addr_t sp)
+{
+    ENTER;
+
+    // Protect only the pages written since the last generation.  The
+    // dirty set may name a page more than once.
+    Iterator<MapListElement_t*>&    it = _dirty->GetIterator();
+    while (it.HasNext()) {
+        PageFrame*  frame;
+        if (_map_db.Search(it.Next()->GetKey(), frame) &&
+            !frame->IsCOW()) {
+            ProtectFrame(frame);
         }
-        frame->IncrementGeneration();
     }
 
     ThreadContext *tc = new ThreadContext;
     tc->ip = ip;
     tc->sp = sp;
 
-    DOUT("IP: %.8lX SP: %.8lX DB: %p\n", ip, sp, list);
+    DOUT("IP: %.8lX SP: %.8lX delta: %p (%lu)\n", ip, sp, _dirty,
+         _dirty->Length());
 
-    MapList_t*      old = _snapshots.Push(list);
-    ThreadContext*  old_tc = _thread_context.Push(tc);
+    // The dirty set becomes the delta of this generation.
+    if (_snapshots.Length() >= _snapshots.Depth()) {
+        DropOldest();
+    }
+    _snapshots.Push(_dirty);
+    _thread_context.Push(tc);
+    _packed.Push(0);
 
-    if (old != 0) {
-        Int counter = 0;
-        it = old->GetIterator();
-        while (it.HasNext()) {
-            MapListElement_t*   item = it.Next();
-            PageFrame*          frame = item->GetValue();
-
-            if (frame->IsSnapshot() &&
-                frame->IsAccessed(PAGE_STATE_WRITE) &&
-                frame->GetOwner() == _root->Id) {
-                // A copy of the page exists.  We can release the original.
-                MainPa.Release(frame);
-                counter++;
+    _dirty = new MapList_t;
+
+    PackOldGenerations();
+
+    EXIT;
+    return ERR_NONE;
+}
+
+///
+/// Releases the original frames recorded in the delta dropped from the
+/// bottom of the stack.  No generation can restore them any longer.
+///
+void
+Space::ReleaseChanges(MapList_t* ls)
+{
+    Int                             counter = 0;
+    Iterator<MapListElement_t*>&    it = ls->GetIterator();
+
+    while (it.HasNext()) {
+        MapListElement_t*   item = it.Next();
+        PageFrame*          prev = item->GetValue();
+        PageFrame*          cur;
+
+        if (prev != 0 && prev->IsSnapshot() &&
+            prev->GetOwner() == _root->Id &&
+            !(_map_db.Search(item->GetKey(), cur) && cur == prev)) {
+            MainPa.Release(prev);
+            counter++;
+        }
+        delete item;
+    }
+    delete ls;
+    DOUT("%ld pages are released\n", counter);
+}
+
+///
+/// Undoes the changes in the delta, the newest first.  The elements of the
+/// delta are deleted.
+///
+void
+Space::Revert(MapList_t* ls)
+{
+    Iterator<MapListElement_t*>&    it = ls->GetIterator();
+
+    while (it.HasNext()) {
+        MapListElement_t*   item = it.Next();
+        L4_Word_t           address = item->GetKey();
+        PageFrame*          prev = item->GetValue();
+        PageFrame*          cur;
+        Bool                found;
+
+        delete item;
+
+        found = _map_db.Search(address, cur);
+        if (found && cur == prev) {
+            continue;
+        }
+
+        if (found && cur->GetOwner() == _root->Id && !cur->IsShared()) {
+            Pg.Unmap(cur, PAGE_PERM_FULL);
+            MainPa.Release(cur);
+        }
+
+        if (prev != 0) {
+            prev->SetGeneration(0);
+            if (found) {
+                _map_db.Update(address, prev, cur);
+            }
+            else {
+                _map_db.Insert(address, prev);
+                _resident++;
             }
         }
-        DOUT("%ld pages are released\n", counter);
-        DOUT("Old snapshot released: IP: %.8lX SP: %.8lX AS: %p\n",
-             old_tc->ip, old_tc->sp, old);
-        delete old;
-        delete old_tc;
+        else if (found) {
+            _map_db.Remove(address, cur);
+            _resident--;
+        }
+    }
+}
+
+stat_t
+Space::RestoreIncremental(UInt generation, addr_t *ip, addr_t *sp)
+{
+    ENTER;
+
+    if (generation == 0) {
+        return ERR_INVALID_ARGUMENTS;
+    }
+    if (_thread_context.Length() < generation) {
+        return ERR_NOT_FOUND;
+    }
+
+    // Each packed page needs a new frame.  Check it before anything is
+    // reverted.
+    size_t  needed = 0;
+    for (UInt i = 0; i < generation - 1; i++) {
+        for (SnapshotPool::PackedPage* p = _packed.Get(i); p != 0;
+             p = p->next) {
+            needed++;
+        }
+    }
+    if (needed > MainPa.FreeCount()) {
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    // Undo the changes since the last snapshot.
+    Revert(_dirty);
+    delete _dirty;
+    _dirty = new MapList_t;
+
+    // Then the deltas of the newer generations.
+    for (UInt i = 0; i < generation - 1; i++) {
+        MapList_t* ls = _snapshots.Pop();
+        if (Unpack(ls, _packed.Pop()) != ERR_NONE) {
+            FATAL("snapshot restoration failed");
+        }
+        Revert(ls);
+        delete ls;
+        delete _thread_context.Pop();
+    }
+    if (_packed_generations > _snapshots.Length()) {
+        _packed_generations = _snapshots.Length();
     }
 
+    // Leave the snapshot for restoring it again.
+    ThreadContext* tc = _thread_context.Pop();
+    _thread_context.Push(tc);
+
+    *ip = tc->ip;
+    *sp = tc->sp;
+
+    DOUT("IP: %.8lX SP: %.8lX\n", *ip, *sp);
+
     EXIT;
     return ERR_NONE;
 }
 
+void
+Space::SetIncrementalSnapshot(Bool on)
+{
+    if (_incremental == on) {
+        return;
+    }
+
+    // The snapshots of the other mode cannot be restored.
+    MapList_t* ls;
+    while ((ls = _snapshots.Pop()) != 0) {
+        if (_incremental) {
+            ReleaseChanges(ls);
+        }
+        else {
+            DeleteMapList(ls);
+        }
+    }
+    ThreadContext* tc;
+    while ((tc = _thread_context.Pop()) != 0) {
+        delete tc;
+    }
+    while (_packed.Length() > 0) {
+        MainSnapshotPool.Release(_packed.Pop());
+    }
+    _packed_generations = 0;
+    DeleteMapList(_dirty);
+    _dirty = new MapList_t;
+
+    // The incremental mode tracks the pages one by one.
+    if (on) {
+        DemoteAll();
+    }
+
+    _incremental = on;
+}
+
+void
+Space::SetSnapshotDepth(UInt depth, UInt unpacked)
+{
+    if (depth != 0) {
+        _snapshots.SetDepth(depth);
+        _thread_context.SetDepth(depth);
+        _packed.SetDepth(depth);
+        while (_snapshots.Length() > _snapshots.Depth()) {
+            DropOldest();
+        }
+    }
+    if (unpacked != 0) {
+        _unpacked = unpacked < MAX_SNAPSHOT_DEPTH ?
+                    unpacked : MAX_SNAPSHOT_DEPTH;
+    }
+    PackOldGenerations();
+}
+
+///
+/// The page of the newer generation is the oldest change of the page in the
+/// newer deltas.  The page is unchanged up to now if no delta has it.
+///
+PageFrame*
+Space::NewerFrame(UInt index, L4_Word_t address)
+{
+    PageFrame*  frame = 0;
+
+    for (UInt i = index; i > 0; i--) {
+        if (FindOldest(_snapshots.Get(i - 1), address, &frame)) {
+            return frame;
+        }
+    }
+    if (FindOldest(_dirty, address, &frame)) {
+        return frame;
+    }
+    if (_map_db.Search(address, frame)) {
+        return frame;
+    }
+    return 0;
+}
+
+void
+Space::Pack(UInt index)
+{
+    MapList_t*                  ls = _snapshots.Get(index);
+    SnapshotPool::PackedPage*   packed = _packed.Get(index);
+    MapListElement_t**          items;
+    size_t                      count = ls->Length();
+    size_t                      n = 0;
+    Int                         counter = 0;
+
+    if (count == 0) {
+        return;
+    }
+
+    // The lookups below walk the lists.  Take the elements out first.
+    items = new MapListElement_t*[count];
+    Iterator<MapListElement_t*>&    it = ls->GetIterator();
+    while (it.HasNext()) {
+        items[n++] = it.Next();
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        L4_Word_t                   address = items[i]->GetKey();
+        PageFrame*                  prev = items[i]->GetValue();
+        PageFrame*                  cur;
+        PageFrame*                  base;
+        SnapshotPool::PackedPage*   page;
+        Bool                        oldest = TRUE;
+
+        // Only the copies that the snapshot holds by itself are packed.
+        if (prev == 0 || !prev->IsSnapshot() ||
+            prev->GetOwner() != _root->Id || prev->IsShared() ||
+            (_map_db.Search(address, cur) && cur == prev)) {
+            continue;
+        }
+
+        // The packed page is reverted after the other changes.  It must be
+        // the oldest change of the page in the generation.
+        for (size_t j = i + 1; j < count; j++) {
+            if (items[j]->GetKey() == address) {
+                oldest = FALSE;
+                break;
+            }
+        }
+        if (!oldest) {
+            continue;
+        }
+
+        // The base is decoded against on restoration.  It must not be
+        // written in place until then.
+        base = NewerFrame(index, address);
+        if (base == prev || (base != 0 && !base->IsCOW())) {
+            continue;
+        }
+
+        page = MainSnapshotPool.Pack(address, prev, base);
+        if (page == 0) {
+            continue;
+        }
+        page->next = packed;
+        packed = page;
+
+        ls->Remove(items[i]);
+        delete items[i];
+        Pg.Unmap(prev, PAGE_PERM_FULL);
+        MainPa.Release(prev);
+        counter++;
+    }
+    delete[] items;
+
+    _packed.Set(index, packed);
+    DOUT("%ld pages are packed\n", counter);
+}
+
+void
+Space::PackOldGenerations()
+{
+    if (!_incremental) {
+        return;
+    }
+
+    // The oldest first, so that the newer generations are not packed yet
+    // when a generation is packed.
+    while (_packed_generations < _snapshots.Length() &&
+           _snapshots.Length() - _packed_generations > _unpacked) {
+        Pack(_snapshots.Length() - _packed_generations - 1);
+        _packed_generations++;
+    }
+}
+
+stat_t
+Space::Unpack(MapList_t* ls, SnapshotPool::PackedPage* packed)
+{
+    for (SnapshotPool::PackedPage* p = packed; p != 0; p = p->next) {
+        PageFrame*  base;
+        PageFrame*  frame;
+
+        if (!_map_db.Search(p->address, base)) {
+            base = 0;
+        }
+        if (MainPa.Allocate(1, &frame) != ERR_NONE) {
+            return ERR_OUT_OF_MEMORY;
+        }
+        MainSnapshotPool.Unpack(p, base, frame);
+
+        // The copy is protected as the original was.
+        frame->SetOwner(_root->Id);
+        frame->SetOwnerRights(PAGE_PERM_READ_WRITE);
+        frame->SetSharerRights(PAGE_PERM_NONE);
+        frame->SetDestination(p->address);
+        frame->SetAttribute(PAGE_ATTR_COW | PAGE_ATTR_SNAPSHOT);
+        frame->SetAccessState(PAGE_STATE_READ | PAGE_STATE_WRITE);
+
+        ls->Append(new MapListElement_t(p->address, frame));
+    }
+    MainSnapshotPool.Release(packed);
+    return ERR_NONE;
+}
+
 void
 Space::DumpMapDB()
 {
@@ -407,6 +1009,10 @@ Space::Restore(UInt generation, addr_t *ip, addr_t *sp)
 {
     ENTER;
 
+    if (_incremental) {
+        return RestoreIncremental(generation, ip, sp);
+    }
+
     if (generation == 0) {
         return ERR_INVALID_ARGUMENTS;
     }
@@ -417,10 +1023,12 @@ Space::Restore(UInt generation, addr_t *ip, addr_t *sp)
         ReleaseOldFrames(generation, ls);
         delete ls;
         delete _thread_context.Pop();
+        _packed.Pop();
     }
 
     MapList_t* backup = _snapshots.Pop();
     ThreadContext *tc = _thread_context.Pop();
+    _packed.Pop();
     if (backup == 0) {
         return ERR_NOT_FOUND;
     }
@@ -453,6 +1061,7 @@ Space::Restore(UInt generation, addr_t *ip, addr_t *sp)
     // Clear the mapping database
     //
     _map_db.Clear();
+    _resident = 0;
 
     //
     // Restore the snapshot
@@ -470,6 +1079,7 @@ Space::Restore(UInt generation, addr_t *ip, addr_t *sp)
             BREAK("nil insertion\n");
         }
         _map_db.Insert(item->GetKey(), item->GetValue());
+        _resident++;
     }
 
 #ifdef SYS_DEBUG
@@ -500,6 +1110,7 @@ Space::Restore(UInt generation, addr_t *ip, addr_t *sp)
     //
     _snapshots.Push(backup);
     _thread_context.Push(tc);
+    _packed.Push(0);
 
     DOUT("Restore IP: %.8lX SP: %.8lX DB: %p\n", *ip, *sp, backup);
 
@@ -42,15 +42,35 @@
 #include <BPlusTree.h>
 #include <List.h>
 #include <MapElement.h>
+#include <RadixTree.h>
 #include <Types.h>
 #include <sys/Config.h>
 #include <l4/types.h>
+#include "SnapshotPool.h"
 #include "SnapshotStore.h"
 
+class PageFrame;
+
 typedef MapElement<addr_t, PageFrame*>  MapListElement_t;
 typedef List<MapListElement_t*>         MapList_t;
 
-class PageFrame;
+//
+// The mapping database.  RADIX_MAP_DB selects the two-level radix tree
+// instead of the B+ tree.
+//
+#ifdef RADIX_MAP_DB
+typedef RadixTree<addr_t, PageFrame*>   MapDB_t;
+#else
+typedef BPlusTree<addr_t, PageFrame*, 31>
+                                        MapDB_t;
+#endif // RADIX_MAP_DB
+
+//
+// The swap slots of the pages swapped out
+//
+typedef BPlusTree<addr_t, L4_Word_t, 31>
+                                        SwapDB_t;
+
 struct Thread;
 
 struct ThreadContext
@@ -79,6 +99,12 @@ private:
     ///
     static L4_Word_t        _tid_base;
 
+    ///
+    /// The address space of each thread, indexed by the thread number minus
+    /// the base.  Updated when a thread object is created or deleted.
+    ///
+    static Space*           _tid_index[Config::MAX_GLOBAL_THREADS];
+
     ///
     /// If this space is shadow task or not
     ///
@@ -89,6 +115,11 @@ private:
     ///
     L4_ThreadId_t           _pager;
 
+    ///
+    /// The number of pages mapped around a faulting page at once
+    ///
+    size_t                  _fault_around;
+
     ///
     /// The space specifier, or the root thread
     ///
@@ -123,18 +154,124 @@ private:
     ///
     /// Memory mapping database
     ///
-    BPlusTree<addr_t, PageFrame*, 31>
-                            _map_db;
+    MapDB_t                 _map_db;
 
     ///
-    /// Snapshot repository
+    /// The number of pages registered in the mapping database
     ///
-    SnapshotStore<MapList_t*, 10>       _snapshots;
+    size_t                  _resident;
 
-    SnapshotStore<ThreadContext*, 4>    _thread_context;
+    ///
+    /// The upper bound of the snapshot depth
+    ///
+    static const UInt       MAX_SNAPSHOT_DEPTH = 32;
+
+    ///
+    /// Snapshot repository.  In the incremental mode, each list holds the
+    /// changes made between the previous snapshot and the snapshot.
+    ///
+    SnapshotStore<MapList_t*, MAX_SNAPSHOT_DEPTH>       _snapshots;
+
+    SnapshotStore<ThreadContext*, MAX_SNAPSHOT_DEPTH>   _thread_context;
+
+    ///
+    /// The pages of each generation kept in the snapshot pool.  They are
+    /// removed from the list of the changes of the generation.  Used in
+    /// the incremental mode only.
+    ///
+    SnapshotStore<SnapshotPool::PackedPage*, MAX_SNAPSHOT_DEPTH>  _packed;
+
+    ///
+    /// The number of the latest generations whose pages are kept as they
+    /// are.  The older generations are packed.
+    ///
+    UInt                    _unpacked;
+
+    ///
+    /// The number of the oldest generations already packed
+    ///
+    UInt                    _packed_generations;
+
+    ///
+    /// If snapshots are taken incrementally
+    ///
+    Bool                    _incremental;
+
+    ///
+    /// The pages changed since the last snapshot in the incremental mode.
+    /// Each element holds the address and the previous frame, which is 0
+    /// if the page was newly registered.  The latest change comes first.
+    ///
+    MapList_t*              _dirty;
+
+    ///
+    /// The pages swapped out.  Null until the first page is swapped out.
+    ///
+    SwapDB_t*               _swapped;
+
+    ///
+    /// If the pages of this space must stay in memory
+    ///
+    Bool                    _pinned;
 
     void ReleaseOldFrames(UInt gen, MapList_t* ls);
 
+    ///
+    /// Write-protects the frame if written and makes it copy-on-write.
+    ///
+    void ProtectFrame(PageFrame* frame);
+
+    ///
+    /// Reverts the changes in the list, releasing the frames that replaced
+    /// the previous ones.
+    ///
+    void Revert(MapList_t* ls);
+
+    ///
+    /// Releases the list of changes pushed out of the snapshot repository.
+    ///
+    void ReleaseChanges(MapList_t* ls);
+
+    ///
+    /// Releases the full snapshot pushed out of the snapshot repository.
+    ///
+    void ReleaseSnapshot(MapList_t* ls);
+
+    ///
+    /// Removes the oldest generation from the snapshot repository.
+    ///
+    void DropOldest();
+
+    ///
+    /// Obtains the frame of the page at the address in the generation
+    /// newer than the one at the index by one.
+    ///
+    /// @return         the frame, or null if the page did not exist
+    ///
+    PageFrame* NewerFrame(UInt index, L4_Word_t address);
+
+    ///
+    /// Packs the changes of the generation at the index into the snapshot
+    /// pool.  The newer generations must not be packed.
+    ///
+    void Pack(UInt index);
+
+    ///
+    /// Packs the generations older than the latest unpacked ones.
+    ///
+    void PackOldGenerations();
+
+    ///
+    /// Decodes the packed pages into new frames and appends them to the
+    /// list of the changes, so that they are reverted last.  The newer
+    /// generations must be reverted.
+    ///
+    stat_t Unpack(MapList_t* ls, SnapshotPool::PackedPage* packed);
+
+    stat_t SnapshotIncremental(addr_t ip, addr_t sp);
+
+    stat_t RestoreIncremental(UInt generation, addr_t *ip, addr_t *sp);
+
     Space() {}
 
     ///
@@ -183,6 +320,21 @@ private:
 public:
     static void InitializeTidMap();
 
+    ///
+    /// Looks up the address space where the thread runs.
+    ///
+    /// @param tid      the thread
+    /// @return         the address space, or 0 if not found
+    ///
+    static Space* Lookup(L4_ThreadId_t tid)
+    {
+        L4_Word_t no = L4_ThreadNo(tid);
+        if (no < _tid_base || Config::MAX_GLOBAL_THREADS <= no - _tid_base) {
+            return 0;
+        }
+        return _tid_index[no - _tid_base];
+    }
+
     ///
     /// Initializes the address space object.
     ///
@@ -205,6 +357,86 @@ public:
 
     void SetPager(L4_ThreadId_t tid) { _pager = tid; }
 
+    ///
+    /// The default number of pages mapped per page fault
+    ///
+    static const size_t     DEFAULT_FAULT_AROUND = 8;
+
+    ///
+    /// The upper bound of the fault-around window.  A map item takes two
+    /// message registers, so a reply carries up to 31 items.
+    ///
+    static const size_t     MAX_FAULT_AROUND = 16;
+
+    size_t FaultAround() { return _fault_around; }
+
+    ///
+    /// Sets the size of the fault-around window.  The size is rounded down
+    /// to a power of two so that the window is aligned.  Zero and one
+    /// disable fault-around.
+    ///
+    /// @param pages    the number of pages in the window
+    ///
+    void SetFaultAround(size_t pages);
+
+    ///
+    /// Checks if the reclaimer may swap out the pages of this space.  The
+    /// pinned spaces and the spaces with snapshots are not swapped.
+    ///
+    Bool IsSwappable() { return !_pinned && !HasSnapshots(); }
+
+    Bool HasSnapshots() { return _snapshots.Length() > 0; }
+
+    ///
+    /// The default number of snapshots kept
+    ///
+    static const UInt       DEFAULT_SNAPSHOT_DEPTH = 4;
+
+    UInt SnapshotDepth() { return _snapshots.Depth(); }
+
+    UInt UnpackedGenerations() { return _unpacked; }
+
+    UInt Generations() { return _thread_context.Length(); }
+
+    ///
+    /// Sets the number of the snapshots kept and the number of the latest
+    /// ones whose pages are kept as they are.  The pages of the older
+    /// generations are compressed into the snapshot pool in the incremental
+    /// mode.  The oldest snapshots beyond the new depth are released.
+    ///
+    /// @param depth        the number of the snapshots, up to
+    ///                     MAX_SNAPSHOT_DEPTH
+    /// @param unpacked     the number of the generations not packed
+    ///
+    void SetSnapshotDepth(UInt depth, UInt unpacked);
+
+    void SetPinned(Bool pinned) { _pinned = pinned; }
+
+    ///
+    /// Records the swap slot of the page swapped out.
+    ///
+    stat_t InsertSwap(L4_Word_t address, L4_Word_t slot);
+
+    ///
+    /// Removes the swap slot of the page.
+    ///
+    /// @param address      the address of the page
+    /// @param slot         the swap slot of the page
+    /// @return             ERR_NOT_FOUND if the page is not swapped out
+    ///
+    stat_t RemoveSwap(L4_Word_t address, L4_Word_t* slot);
+
+    Bool IsSwapped(L4_Word_t address)
+    {
+        L4_Word_t slot;
+        return _swapped != 0 && _swapped->Search(address, slot);
+    }
+
+    ///
+    /// Obtains the number of the pages swapped out.
+    ///
+    size_t SwappedPages() { return _swapped == 0 ? 0 : _swapped->Length(); }
+
     const L4_Fpage_t& UtcbArea() { return _utcb_area; }
 
     const L4_Fpage_t& KipArea() { return _kip_area; }
@@ -269,11 +501,20 @@ public:
     void RemoveMap(L4_Word_t address)
     {
         PageFrame*  dummy;
-        _map_db.Remove(address, dummy);
+        Demote(address);
+        if (_map_db.Remove(address, dummy)) {
+            _resident--;
+        }
     }
 
     ///
-    /// Searches the mapping in the database.
+    /// Obtains the number of pages registered in the mapping database.
+    ///
+    size_t ResidentPages() { return _resident; }
+
+    ///
+    /// Searches the mapping in the database.  An address in a superpage
+    /// yields the corresponding page frame in the superpage.
     ///
     /// @param address      the mapping destination
     /// @param frame        the page frame where the destination is mapped
@@ -281,7 +522,59 @@ public:
     stat_t SearchMap(L4_Word_t address, PageFrame** frame);
 
     ///
-    /// Takes a snapshot of the mapping database.
+    /// Registers a superpage as a single entry.  The frames must be
+    /// physically contiguous and both addresses aligned to SUPERPAGE_SIZE.
+    ///
+    /// @param address      the virtual address of the mapping destination
+    /// @param frame        the first page frame of the superpage
+    ///
+    void InsertSuperMap(L4_Word_t address, PageFrame *frame);
+
+    ///
+    /// Searches the superpage that covers the address.
+    ///
+    /// @param address      the mapping destination
+    /// @param base         the base address of the superpage
+    /// @param frame        the first page frame of the superpage
+    ///
+    stat_t SearchSuperMap(L4_Word_t address, L4_Word_t* base,
+                          PageFrame** frame);
+
+    ///
+    /// Removes the whole superpage that covers the address.
+    ///
+    /// @param address      the mapping destination
+    ///
+    void RemoveSuperMap(L4_Word_t address);
+
+    ///
+    /// Records a change of the page at the address for the incremental
+    /// snapshot.  Insertion and replacement in the mapping database are
+    /// recorded automatically; the page fault handler calls this when it
+    /// grants write access to a registered page in place.
+    ///
+    /// @param address      the address of the page
+    /// @param prev         the frame before the change, or 0 if the page
+    ///                     is new
+    ///
+    void MarkDirty(L4_Word_t address, PageFrame* prev)
+    {
+        if (_incremental && _snapshots.Length() > 0) {
+            _dirty->Add(new MapListElement_t(address, prev));
+        }
+    }
+
+    Bool IsIncrementalSnapshot() { return _incremental; }
+
+    ///
+    /// Switches the snapshot mode.  The existing snapshots are discarded
+    /// when the mode changes.
+    ///
+    void SetIncrementalSnapshot(Bool incremental);
+
+    ///
+    /// Takes a snapshot of the mapping database.  In the incremental mode,
+    /// only the pages changed since the previous snapshot are visited.
     ///
     stat_t Snapshot(addr_t ip, addr_t sp);
 
@@ -292,6 +585,20 @@ public:
 
     void DumpMapDB();
     void DumpMap();
+
+private:
+    ///
+    /// Splits the superpage that covers the address into the entries of
+    /// single pages, so that the pages can be handled individually.
+    ///
+    /// @param address      the address in the superpage
+    ///
+    void Demote(L4_Word_t address);
+
+    ///
+    /// Splits all the superpages in the space.
+    ///
+    void DemoteAll();
 };
 
 
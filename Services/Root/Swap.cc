@@ -0,0 +1,317 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @brief  Anonymous page swapping
+/// @file   Services/Root/Swap.cc
+/// @since  October 2008
+///
+
+//#define SYS_DEBUG
+//#define SYS_DEBUG_CALL
+
+#include <Debug.h>
+#include <Ipc.h>
+#include <Protocol.h>
+#include <System.h>
+#include <Types.h>
+#include <sys/Config.h>
+
+#include "Common.h"
+#include "PageAllocator.h"
+#include "PageFrame.h"
+#include "PageFrameTable.h"
+#include "Pager.h"
+#include "Space.h"
+#include "Swap.h"
+
+#include <l4/message.h>
+#include <l4/types.h>
+
+extern Pager    Pg;
+
+SwapManager     MainSwap;
+
+void
+SwapManager::Initialize()
+{
+    _server = L4_nilthread;
+    _task = 0;
+    _window = 0;
+    _slots = 0;
+    _next = 0;
+    _used = 0;
+    _hand = 0;
+    _lock.Initialize();
+}
+
+stat_t
+SwapManager::Register(L4_ThreadId_t server, addr_t window, size_t slots)
+{
+    ENTER;
+
+    if (L4_IsNilThread(server) || slots == 0 || (window & ~PAGE_MASK) != 0) {
+        return ERR_INVALID_ARGUMENTS;
+    }
+
+    _lock.Lock();
+    if (IsEnabled()) {
+        _lock.Unlock();
+        return ERR_EXIST;
+    }
+
+    _slots = new Bitmap(slots);
+    if (_slots == 0) {
+        _lock.Unlock();
+        return ERR_OUT_OF_MEMORY;
+    }
+    _slots->Reset();
+    _next = 0;
+    _used = 0;
+    _window = window;
+    _server = server;
+    _lock.Unlock();
+
+    System.Print(System.INFO, "swap: %lu pages on %.8lX\n", slots,
+                 server.raw);
+    EXIT;
+    return ERR_NONE;
+}
+
+stat_t
+SwapManager::AllocateSlot(L4_Word_t* slot)
+{
+    size_t length = _slots->Length();
+
+    for (size_t i = 0; i < length; i++) {
+        L4_Word_t s = (_next + i) % length;
+        if (!_slots->Test(s)) {
+            _slots->Set(s);
+            _next = (s + 1) % length;
+            _used++;
+            *slot = s;
+            return ERR_NONE;
+        }
+    }
+    return ERR_OUT_OF_MEMORY;
+}
+
+void
+SwapManager::FreeSlot(L4_Word_t slot)
+{
+    if (_slots->Test(slot)) {
+        _slots->Reset(slot);
+        _used--;
+    }
+}
+
+void
+SwapManager::Discard(L4_Word_t slot)
+{
+    _lock.Lock();
+    FreeSlot(slot);
+    _lock.Unlock();
+}
+
+Space*
+SwapManager::Owner(PageFrame* frame)
+{
+    Space*      space;
+    PageFrame*  mapped;
+
+    if (frame->GetState() != PAGE_STATE_MAP ||
+        frame->GetAttribute() != PAGE_ATTR_ANON ||
+        frame->IsShared()) {
+        return 0;
+    }
+
+    space = Space::Lookup(frame->GetOwner());
+    if (space == 0 || !space->IsSwappable()) {
+        return 0;
+    }
+
+    // The frame must be the one registered for its destination.
+    if (space->SearchMap(frame->GetDestination(), &mapped) != ERR_NONE ||
+        mapped != frame) {
+        return 0;
+    }
+    return space;
+}
+
+stat_t
+SwapManager::Transfer(L4_Word_t label, PageFrame* frame, L4_Word_t rwx,
+                      L4_Word_t slot)
+{
+    L4_Msg_t        msg;
+    L4_MapItem_t    item;
+    stat_t          err;
+
+    err = Pg.CreateLendItem(_window, frame, rwx, &item);
+    if (err != ERR_NONE) {
+        return err;
+    }
+
+    L4_Clear(&msg);
+    L4_Set_Label(&msg, label);
+    L4_Append(&msg, slot);
+    L4_Append(&msg, item);
+    // Never wait for the swap server forever; the pager would hang with it.
+    err = Ipc::Call(_server, L4_TimePeriod(TRANSFER_TIMEOUT), &msg, &msg);
+
+    // Take the page back from the swap server.
+    Pg.Unmap(frame, PAGE_PERM_FULL);
+    return err;
+}
+
+stat_t
+SwapManager::Evict(Space* space, PageFrame* frame)
+{
+    L4_Word_t   address = frame->GetDestination();
+    L4_Word_t   slot;
+    stat_t      err;
+
+    if (AllocateSlot(&slot) != ERR_NONE) {
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    // Revoke the access of the task so that the page stays unchanged while
+    // it is written out.
+    Pg.Unmap(frame, PAGE_PERM_FULL);
+
+    err = Transfer(MSG_SWAP_OUT, frame, PAGE_PERM_READ, slot);
+    if (err == ERR_NONE) {
+        err = space->InsertSwap(address, slot);
+    }
+    if (err != ERR_NONE) {
+        // The page stays registered and faults in again.
+        FreeSlot(slot);
+        return err;
+    }
+
+    DOUT("swap out %.8lX (%.8lX) -> %lu\n",
+         address, Pg.PhysicalAddress(frame), slot);
+    space->RemoveMap(address);
+    MainPa.Release(frame);
+    return ERR_NONE;
+}
+
+size_t
+SwapManager::Reclaim(size_t count)
+{
+    PageFrame*  table = MainPft.Table();
+    size_t      length = MainPft.Length();
+    size_t      evicted = 0;
+
+    if (!IsEnabled()) {
+        return 0;
+    }
+
+    ENTER;
+    _lock.Lock();
+
+    // Each turn of the hand ages the unreferenced pages by one.  Give up
+    // after the pages had enough turns to get old.
+    for (size_t i = 0; i < length * (EVICT_AGE + 1) && evicted < count;
+         i++) {
+        PageFrame*  frame = &table[_hand];
+        Space*      space;
+
+        _hand = (_hand + 1) % length;
+
+        if ((space = Owner(frame)) == 0) {
+            continue;
+        }
+
+        if (Pg.IsReferenced(frame)) {
+            frame->ResetAge();
+            continue;
+        }
+
+        frame->IncrementAge();
+        if (frame->GetAge() < EVICT_AGE) {
+            continue;
+        }
+
+        if (Evict(space, frame) == ERR_NONE) {
+            evicted++;
+        }
+        else if (_used == _slots->Length()) {
+            break;
+        }
+    }
+
+    _lock.Unlock();
+    DOUT("%lu pages reclaimed\n", evicted);
+    EXIT;
+    return evicted;
+}
+
+stat_t
+SwapManager::SwapIn(Space* space, L4_Word_t address, PageFrame** frame)
+{
+    PageFrame*  f;
+    L4_Word_t   slot;
+    stat_t      err;
+
+    if (!IsEnabled()) {
+        return ERR_NOT_FOUND;
+    }
+
+    ENTER;
+    _lock.Lock();
+    if (space->RemoveSwap(address, &slot) != ERR_NONE) {
+        _lock.Unlock();
+        return ERR_NOT_FOUND;
+    }
+
+    if (MainPa.Allocate(1, &f) != ERR_NONE) {
+        err = ERR_OUT_OF_MEMORY;
+        goto error;
+    }
+
+    err = Transfer(MSG_SWAP_IN, f, PAGE_PERM_READ_WRITE, slot);
+    if (err != ERR_NONE) {
+        MainPa.Release(f);
+        goto error;
+    }
+
+    DOUT("swap in %.8lX (%.8lX) <- %lu\n",
+         address, Pg.PhysicalAddress(f), slot);
+    FreeSlot(slot);
+    _lock.Unlock();
+
+    *frame = f;
+    EXIT;
+    return ERR_NONE;
+
+error:
+    space->InsertSwap(address, slot);
+    _lock.Unlock();
+    return err;
+}
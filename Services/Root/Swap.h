@@ -0,0 +1,182 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @brief  Anonymous page swapping
+/// @file   Services/Root/Swap.h
+/// @since  October 2008
+///
+
+#ifndef ARC_ROOT_SWAP_H
+#define ARC_ROOT_SWAP_H
+
+#include <Bitmap.h>
+#include <Mutex.h>
+#include <Types.h>
+#include <l4/types.h>
+
+class PageFrame;
+class Space;
+
+///
+/// Moves private anonymous pages between the main memory and the swap
+/// server.  The reclaimer sweeps the page frame table like a clock hand and
+/// swaps out the pages that stayed unreferenced for EVICT_AGE sweeps.  The
+/// swap slots are allocated here; the swap server only reads and writes the
+/// slots, through a one-page window in its address space where the frame is
+/// lent during a request.
+///
+/// The pages of the swap server, the disk server and their pager must never
+/// be swapped out, since the pager thread waits for the swap server.  They
+/// are pinned when the swap server registers.
+///
+class SwapManager
+{
+public:
+    ///
+    /// The number of sweeps an unreferenced page survives
+    ///
+    static const UByte  EVICT_AGE = 2;
+
+    ///
+    /// The number of pages swapped out when an allocation fails
+    ///
+    static const size_t RECLAIM_BATCH = 16;
+
+    ///
+    /// The time in microseconds the pager waits for the swap server to move
+    /// a page.  The page stays in the main memory when it runs out.
+    ///
+    static const L4_Word_t  TRANSFER_TIMEOUT = 5000000;
+
+private:
+    ///
+    /// The swap server.  Swapping is disabled while it is nil.
+    ///
+    L4_ThreadId_t   _server;
+
+    ///
+    /// The task booted as the swap server.  Only this task can register.
+    ///
+    Space*          _task;
+
+    ///
+    /// The window in the swap server where frames are lent
+    ///
+    addr_t          _window;
+
+    ///
+    /// The slots in use
+    ///
+    Bitmap*         _slots;
+
+    ///
+    /// The slot where the next search begins
+    ///
+    L4_Word_t       _next;
+
+    size_t          _used;
+
+    ///
+    /// The clock hand.  The index of the page frame to visit next.
+    ///
+    L4_Word_t       _hand;
+
+    Mutex           _lock;
+
+    stat_t AllocateSlot(L4_Word_t* slot);
+
+    void FreeSlot(L4_Word_t slot);
+
+    ///
+    /// Checks if the frame is a private anonymous page of a swappable
+    /// space.
+    ///
+    Space* Owner(PageFrame* frame);
+
+    ///
+    /// Lends the frame to the swap server and asks it to move the page.
+    ///
+    stat_t Transfer(L4_Word_t label, PageFrame* frame, L4_Word_t rwx,
+                    L4_Word_t slot);
+
+    stat_t Evict(Space* space, PageFrame* frame);
+
+public:
+    void Initialize();
+
+    ///
+    /// Enables swapping.
+    ///
+    /// @param server   the swap server
+    /// @param window   the address of the window in the swap server
+    /// @param slots    the number of pages the swap area holds
+    ///
+    stat_t Register(L4_ThreadId_t server, addr_t window, size_t slots);
+
+    Bool IsEnabled() { return !L4_IsNilThread(_server); }
+
+    ///
+    /// Sets the task booted as the swap server.
+    ///
+    void SetServerTask(Space* space) { _task = space; }
+
+    Bool IsServerTask(Space* space) { return _task != 0 && _task == space; }
+
+    ///
+    /// Swaps out up to count pages.
+    ///
+    /// @return         the number of the pages swapped out
+    ///
+    size_t Reclaim(size_t count);
+
+    ///
+    /// Reads the page swapped out back to a new frame.  The frame belongs
+    /// to the space but is not mapped yet.
+    ///
+    /// @param space    the address space
+    /// @param address  the address of the page
+    /// @param frame    the new frame
+    /// @return         ERR_NOT_FOUND if the page is not swapped out
+    ///
+    stat_t SwapIn(Space* space, L4_Word_t address, PageFrame** frame);
+
+    ///
+    /// Discards the page in the slot.
+    ///
+    void Discard(L4_Word_t slot);
+
+    size_t Slots() { return _slots == 0 ? 0 : _slots->Length(); }
+
+    size_t UsedSlots() { return _used; }
+};
+
+extern SwapManager  MainSwap;
+
+#endif // ARC_ROOT_SWAP_H
@@ -183,16 +183,14 @@ stat_t
 StartThread(const Thread *thread, L4_ThreadId_t pager,
             L4_Word_t ip, L4_Word_t sp)
 {
-    L4_Msg_t	msg;
-    L4_Word_t	reg[3];
+    ThreadStartRequest  req;
 
     DOUT("EXEC ip %.8lX sp %.8lX\n", ip, sp);
-    reg[0] = thread->Id.raw;
-    reg[1] = ip;
-    reg[2] = sp;
+    req.tid = thread->Id;
+    req.ip = ip;
+    req.sp = sp;
 
-    L4_Put(&msg, MSG_PAGER_TH, 3, reg, 0, (void *)0);
-    return Ipc::Call(pager, &msg, &msg);
+    return Ipc::Call<ThreadStartMessage>(pager, MSG_PAGER_TH, req);
 }
 
 /**
@@ -280,26 +278,40 @@ DeleteTask(Space* space)
 stat_t
 FindTask(L4_ThreadId_t tid, Space **obj)
 {
-    Thread*     thread;
-    stat_t      err = ERR_NOT_FOUND;
+    Space*      space;
     ENTER;
 
+    // The index is updated along with the thread objects, so the lookup
+    // does not depend on the number of tasks.
+    space = Space::Lookup(tid);
+    if (space == 0) {
+        return ERR_NOT_FOUND;
+    }
+    *obj = space;
+
+    EXIT;
+    return ERR_NONE;
+}
+
+size_t
+CountResidentPages(size_t first, L4_Word_t *regs, size_t max)
+{
+    size_t  count = 0;
+
     _mutex.Lock();
 
     Space *cur = _space_list;
-    while (cur != 0) {
-        if (cur->FindThread(tid, &thread) == ERR_NONE) {
-            *obj = cur;
-            err = ERR_NONE;
-            break;
+    for (size_t i = 0; cur != 0 && count < max; i++) {
+        if (first <= i) {
+            regs[count * 2] = cur->GetRootThread()->Id.raw;
+            regs[count * 2 + 1] = cur->ResidentPages();
+            count++;
         }
         cur = cur->next;
     }
 
     _mutex.Unlock();
-
-    EXIT;
-    return err;
+    return count;
 }
 
 
@@ -518,7 +530,7 @@ CopyArgs(addr_t stack_page, addr_t dest, int argc, char** argv)
 /// @param size     the size of the process image in byte
 ///
 stat_t
-ExecInitialTask(L4_BootRec_t *task)
+ExecInitialTask(L4_BootRec_t *task, Space **created)
 {
     stat_t          err;
     Space*          space;
@@ -609,12 +621,16 @@ ExecInitialTask(L4_BootRec_t *task)
         FATAL("failed to start initial thread");
     }
 
+    if (created != 0) {
+        *created = space;
+    }
+
     EXIT;
     return ERR_NONE;
 }
 
 stat_t
-ExecInitialTaskPm(L4_BootRec_t *task)
+ExecInitialTaskPm(L4_BootRec_t *task, Space **created)
 {
     stat_t      err;
     Space*      space;
@@ -692,6 +708,10 @@ ExecInitialTaskPm(L4_BootRec_t *task)
         FATAL("failed to start initial thread");
     }
 
+    if (created != 0) {
+        *created = space;
+    }
+
     EXIT;
     return ERR_NONE;
 }
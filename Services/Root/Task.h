@@ -75,6 +75,16 @@ stat_t DeleteTask(Space *space);
 ///
 stat_t FindTask(L4_ThreadId_t tid, Space **space);
 
+///
+/// Obtains the number of resident pages of each address space.
+///
+/// @param first    the number of address spaces to skip
+/// @param regs     filled with pairs of the root thread and the page count
+/// @param max      the maximum number of pairs
+/// @return         the number of pairs filled
+///
+size_t CountResidentPages(size_t first, L4_Word_t *regs, size_t max);
+
 stat_t ActivateThread(const Thread* thread, L4_ThreadId_t sched,
                       L4_ThreadId_t pager);
 
@@ -114,8 +124,14 @@ void ReleaseStack(Space *s, L4_Word_t phys);
 void RegisterInitialExecutable(Space *s, L4_BootRec_t *rec);
 L4_Word_t RegisterInitialModule(Space* s, L4_BootRec_t* rec);
 
-stat_t ExecInitialTask(L4_BootRec_t *task);
-stat_t ExecInitialTaskPm(L4_BootRec_t *task);
+///
+/// Starts an initial service from the boot record.
+///
+/// @param task         the boot record
+/// @param created      the address space of the service is stored here
+///
+stat_t ExecInitialTask(L4_BootRec_t *task, Space **created = 0);
+stat_t ExecInitialTaskPm(L4_BootRec_t *task, Space **created = 0);
 stat_t ExecTask(L4_Word_t argc, char** argv, L4_ThreadId_t *tid);
 
 ///
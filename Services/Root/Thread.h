@@ -61,6 +61,8 @@ struct Thread
         TID_ROOT_OFFSET =           0x02,   // Root task
         TID_PAGER_OFFSET =          0x03,   // Root pager
         TID_INIT_OFFSET =           0x04,   // Core service
+        TID_ZERO_OFFSET =           0x05,   // Page zeroer
+        TID_MERGE_OFFSET =          0x06,   // Page merger
         TID_OFFSET =                0x10,
     };
 
@@ -0,0 +1,259 @@
+/*
+ *
+ *  Copyright (C) 2008, Waseda University.
+ *  All rights reserved.
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+///
+/// @brief  Swap server that keeps the pages evicted by the root task
+/// @file   Services/Swap/Server.cc
+/// @since  October 2008
+///
+
+//#define SYS_DEBUG
+//#define SYS_DEBUG_CALL
+
+#include <Debug.h>
+#include <Disk.h>
+#include <Ipc.h>
+#include <Protocol.h>
+#include <Server.h>
+#include <String.h>
+#include <System.h>
+#include <Types.h>
+#include <sys/Config.h>
+#include <l4/ipc.h>
+#include <l4/message.h>
+#include <l4/types.h>
+
+///
+/// The window where the root task lends a page during a request
+///
+static char _window[PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+
+///
+/// Stores the pages in a swap partition, one page per slot.  The root task
+/// allocates the slots and lends the page at the window with each request:
+///
+///   MSG_SWAP_OUT [slot]   writes the page at the window to the slot
+///   MSG_SWAP_IN  [slot]   reads the slot into the page at the window
+///
+/// The root pager waits for the reply, so this server must not cause a page
+/// fault while serving a request.  Its pages are pinned by the root task and
+/// the I/O path is run once at the initialization to fault it in.
+///
+class SwapServer : public BasicServer
+{
+protected:
+    static const Int    DEFAULT_PORT = 0;
+    static const Int    DEFAULT_DISK = 0;
+    static const Int    DEFAULT_PARTITION = 1;
+    static const char*  DEFAULT_DISK_SERVER;
+
+    Disk*           _disk;
+    Partition*      _partition;
+
+    ///
+    /// The number of the pages the partition holds
+    ///
+    size_t          _slots;
+
+    ///
+    /// The thread of the root task that sends the requests.  Given by the
+    /// root task when this server registers.
+    ///
+    L4_ThreadId_t   _root;
+
+    ///
+    /// Accepts the pages lent at the window.
+    ///
+    void Accept()
+    {
+        L4_Accept(L4_MapGrantItems(
+                L4_FpageLog2(reinterpret_cast<L4_Word_t>(_window),
+                             PAGE_BITS)));
+    }
+
+    stat_t CheckRequest(const L4_ThreadId_t& tid, L4_Msg_t& msg,
+                        L4_Word_t* slot);
+
+    stat_t HandleSwapOut(const L4_ThreadId_t& tid, L4_Msg_t& msg);
+    stat_t HandleSwapIn(const L4_ThreadId_t& tid, L4_Msg_t& msg);
+
+    virtual stat_t IpcHandler(const L4_ThreadId_t& tid, L4_Msg_t& msg);
+
+public:
+    SwapServer() : _disk(0), _partition(0), _slots(0), _root(L4_nilthread)
+    {}
+
+    virtual const char* const Name() { return "swap"; }
+    virtual stat_t Initialize(Int argc, char* argv[]);
+    virtual stat_t Exit();
+};
+
+const char* SwapServer::DEFAULT_DISK_SERVER = "pata";
+
+stat_t
+SwapServer::CheckRequest(const L4_ThreadId_t& tid, L4_Msg_t& msg,
+                         L4_Word_t* slot)
+{
+    // Only the root task moves the pages of the other tasks.
+    if (!L4_IsThreadEqual(tid, _root)) {
+        return ERR_INVALID_RIGHTS;
+    }
+    if (L4_UntypedWords(msg.tag) != 1 || L4_TypedWords(msg.tag) != 2) {
+        return ERR_INVALID_ARGUMENTS;
+    }
+
+    *slot = L4_Get(&msg, 0);
+    if (_slots <= *slot) {
+        return ERR_OUT_OF_RANGE;
+    }
+    return ERR_NONE;
+}
+
+stat_t
+SwapServer::HandleSwapOut(const L4_ThreadId_t& tid, L4_Msg_t& msg)
+{
+    L4_Word_t   slot;
+    stat_t      err;
+
+    ENTER;
+    err = CheckRequest(tid, msg, &slot);
+    if (err == ERR_NONE) {
+        DOUT("out %lu\n", slot);
+        err = _partition->WriteBlock(_window, slot);
+    }
+    Accept();
+    EXIT;
+    return Ipc::ReturnError(&msg, err);
+}
+
+stat_t
+SwapServer::HandleSwapIn(const L4_ThreadId_t& tid, L4_Msg_t& msg)
+{
+    L4_Word_t   slot;
+    stat_t      err;
+
+    ENTER;
+    err = CheckRequest(tid, msg, &slot);
+    if (err == ERR_NONE) {
+        DOUT("in %lu\n", slot);
+        err = _partition->ReadBlock(_window, slot);
+    }
+    Accept();
+    EXIT;
+    return Ipc::ReturnError(&msg, err);
+}
+
+stat_t
+SwapServer::Initialize(Int argc, char* argv[])
+{
+    const char* server = DEFAULT_DISK_SERVER;
+    Int         pn = DEFAULT_PARTITION;
+    L4_Msg_t    msg;
+    L4_Word_t   reg[5];
+    stat_t      err;
+
+    ENTER;
+
+    if (argc > 1) {
+        server = static_cast<const char*>(argv[1]);
+    }
+    if (argc > 2) {
+        pn = atoi(argv[2]);
+    }
+
+    _disk = new Disk();
+    if (_disk == 0) {
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    System.Print("'%s' looking for '%s'...\n", argv[0], server);
+    err = _disk->Initialize(server, DEFAULT_PORT, DEFAULT_DISK);
+    if (err != ERR_NONE) {
+        return err;
+    }
+    if ((err = _disk->Open()) != ERR_NONE) {
+        return err;
+    }
+
+    _partition = _disk->GetPartition(pn, Partition::LINUX_SWAP);
+    if (_partition == 0) {
+        System.Print(System.ERROR, "swap: no swap partition at %d\n", pn);
+        return ERR_NOT_FOUND;
+    }
+    _partition->SetBlockSize(PAGE_SIZE);
+    _slots = _partition->SectorCount() / (PAGE_SIZE / Disk::SECTOR_SIZE);
+    if (_slots == 0) {
+        return ERR_NOT_FOUND;
+    }
+
+    // Fault in the I/O path and the window.  The slots hold nothing yet.
+    if ((err = _partition->ReadBlock(_window, 0)) != ERR_NONE ||
+        (err = _partition->WriteBlock(_window, 0)) != ERR_NONE) {
+        return err;
+    }
+
+    // Register to the root task, pinning this server, the disk server and
+    // the pager.
+    reg[0] = L4_Myself().raw;
+    reg[1] = reinterpret_cast<L4_Word_t>(_window);
+    reg[2] = _slots;
+    reg[3] = _disk->Id().raw;
+    reg[4] = L4_Pager().raw;
+    L4_Put(&msg, MSG_ROOT_SWAP, 5, reg, 0, 0);
+    err = Ipc::Call(L4_Pager(), &msg, &msg);
+    if (err != ERR_NONE) {
+        return err;
+    }
+    _root.raw = L4_Get(&msg, 0);
+
+    System.Print("swap: %lu pages on partition %d of '%s'\n",
+                 _slots, pn, server);
+
+    Accept();
+
+    EXIT;
+    return ERR_NONE;
+}
+
+stat_t
+SwapServer::Exit()
+{
+    if (_partition != 0) {
+        _disk->ReleasePartition(_partition);
+    }
+    delete _disk;
+    return ERR_NONE;
+}
+
+ARC_SERVER(SwapServer)
+
+SERVER_HANDLER_BEGIN(SwapServer)
+    SERVER_HANDLER_CONNECT(MSG_SWAP_OUT, HandleSwapOut)
+    SERVER_HANDLER_CONNECT(MSG_SWAP_IN, HandleSwapIn)
+SERVER_HANDLER_END